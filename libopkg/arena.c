@@ -0,0 +1,193 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* arena.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#include "config.h"
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "xfuncs.h"
+
+#define ARENA_CHUNK_SIZE 65536
+#define ARENA_ALIGN (sizeof(void *) > sizeof(double) ? sizeof(void *) : sizeof(double))
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t used;
+    size_t size;
+    /* Keep data aligned for any object we hand out. */
+    union {
+        char data[1];
+        void *align_p;
+        double align_d;
+        long long align_ll;
+    } u;
+};
+
+void arena_init(arena_t * arena)
+{
+    memset(arena, 0, sizeof(arena_t));
+}
+
+static struct arena_chunk *chunk_new(arena_t * arena, size_t size)
+{
+    struct arena_chunk *c;
+
+    c = xmalloc(offsetof(struct arena_chunk, u) + size);
+    c->used = 0;
+    c->size = size;
+    arena->n_chunk_bytes += size;
+    return c;
+}
+
+static void *alloc_aligned(arena_t * arena, size_t size, size_t align)
+{
+    struct arena_chunk *c = arena->chunks;
+    size_t start;
+
+    arena->n_allocs++;
+    arena->n_bytes += size;
+
+    if (c) {
+        start = (c->used + align - 1) & ~(align - 1);
+        if (start <= c->size && c->size - start >= size) {
+            c->used = start + size;
+            return c->u.data + start;
+        }
+    }
+
+    if (size > ARENA_CHUNK_SIZE / 4) {
+        /* Large objects get a chunk of their own, kept behind the current
+         * one so that its free space isn't wasted. */
+        c = chunk_new(arena, size);
+        c->used = size;
+        if (arena->chunks) {
+            c->next = arena->chunks->next;
+            arena->chunks->next = c;
+        } else {
+            c->next = NULL;
+            arena->chunks = c;
+        }
+        return c->u.data;
+    }
+
+    c = chunk_new(arena, ARENA_CHUNK_SIZE);
+    c->next = arena->chunks;
+    arena->chunks = c;
+    c->used = size;
+    return c->u.data;
+}
+
+void *arena_alloc(arena_t * arena, size_t size)
+{
+    return alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+void *arena_calloc(arena_t * arena, size_t size)
+{
+    void *p = arena_alloc(arena, size);
+
+    memset(p, 0, size);
+    return p;
+}
+
+char *arena_strndup(arena_t * arena, const char *s, size_t len)
+{
+    char *copy;
+
+    /* Strings need no alignment, so pack them tightly. */
+    copy = alloc_aligned(arena, len + 1, 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(arena_t * arena, const char *s)
+{
+    if (!s)
+        return NULL;
+    return arena_strndup(arena, s, strlen(s));
+}
+
+char *arena_sprintf(arena_t * arena, const char *fmt, ...)
+{
+    va_list ap;
+    char buf[256];
+    char *str;
+    int n;
+
+    /* Most results are short, so format on the stack first and only do
+     * it again when that was too small. */
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+
+    if (n < 0) {
+        fprintf(stderr,
+                "%s: encountered an output or encoding"
+                " error during vsnprintf.\n", __FUNCTION__);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((size_t)n < sizeof(buf))
+        return arena_strndup(arena, buf, n);
+
+    str = alloc_aligned(arena, n + 1, 1);
+    va_start(ap, fmt);
+    vsnprintf(str, n + 1, fmt, ap);
+    va_end(ap);
+    return str;
+}
+
+void arena_reset(arena_t * arena)
+{
+    struct arena_chunk *c, *keep = NULL;
+
+    /* Keep a standard sized chunk, so that a reset arena doesn't go
+     * straight back to malloc. */
+    while (arena->chunks) {
+        c = arena->chunks;
+        arena->chunks = c->next;
+        if (!keep && c->size == ARENA_CHUNK_SIZE) {
+            keep = c;
+        } else {
+            arena->n_chunk_bytes -= c->size;
+            free(c);
+        }
+    }
+
+    if (keep) {
+        keep->used = 0;
+        keep->next = NULL;
+    }
+    arena->chunks = keep;
+    arena->n_bytes = 0;
+    arena->n_allocs = 0;
+}
+
+void arena_deinit(arena_t * arena)
+{
+    struct arena_chunk *c;
+
+    while (arena->chunks) {
+        c = arena->chunks;
+        arena->chunks = c->next;
+        free(c);
+    }
+    arena_init(arena);
+}
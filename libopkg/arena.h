@@ -0,0 +1,53 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* arena.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A region allocator for objects which all die at the same time. Memory
+ * is carved out of large chunks, and is only given back by arena_reset()
+ * or arena_deinit(), all at once. A zeroed arena_t is ready to use.
+ */
+typedef struct arena arena_t;
+struct arena_chunk;
+
+struct arena {
+    struct arena_chunk *chunks;
+    size_t n_bytes;             /* handed out since the last reset */
+    size_t n_chunk_bytes;       /* held in chunks */
+    unsigned long n_allocs;
+};
+
+void arena_init(arena_t * arena);
+void *arena_alloc(arena_t * arena, size_t size);
+void *arena_calloc(arena_t * arena, size_t size);
+char *arena_strdup(arena_t * arena, const char *s);
+char *arena_strndup(arena_t * arena, const char *s, size_t len);
+char *arena_sprintf(arena_t * arena, const char *fmt, ...)
+    __attribute__ ((format(printf, 2, 3)));
+
+/* Frees everything but the first chunk, which is kept for reuse. */
+void arena_reset(arena_t * arena);
+void arena_deinit(arena_t * arena);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* ARENA_H */
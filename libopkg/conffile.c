@@ -21,7 +21,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <solv/knownid.h>
+
 #include "opkg_message.h"
+#include "opkg_digest_cache.h"
 #include "conffile.h"
 #include "file_util.h"
 #include "sprintf_alloc.h"
@@ -52,7 +55,7 @@ int conffile_has_been_modified(conffile_t * conffile)
 
     root_filename = root_filename_alloc(filename);
 
-    md5sum = file_md5sum_alloc(root_filename);
+    md5sum = opkg_digest_cache_file_alloc(root_filename, REPOKEY_TYPE_MD5);
 
     if (md5sum && (ret = strcmp(md5sum, conffile->value))) {
         opkg_msg(INFO, "Conffile %s:\n\told md5=%s\n\tnew md5=%s\n",
@@ -569,3 +569,75 @@ int file_decompress(const char *in, const char *out)
     free(tmp_out);
     return r;
 }
+
+void file_probe_init(file_probe_t * probe)
+{
+    probe->dirfd = -1;
+    probe->dir_errno = 0;
+    probe->dir = NULL;
+    probe->dir_len = 0;
+}
+
+void file_probe_deinit(file_probe_t * probe)
+{
+    if (probe->dirfd >= 0)
+        close(probe->dirfd);
+    free(probe->dir);
+    file_probe_init(probe);
+}
+
+static void file_probe_open_dir(file_probe_t * probe, const char *path,
+                                size_t dir_len)
+{
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+
+#ifdef O_PATH
+    flags |= O_PATH;
+#endif
+
+    if (probe->dirfd >= 0)
+        close(probe->dirfd);
+    free(probe->dir);
+
+    probe->dir = xstrndup(path, dir_len);
+    probe->dir_len = dir_len;
+    probe->dirfd = open(probe->dir, flags);
+    probe->dir_errno = (probe->dirfd < 0) ? errno : 0;
+}
+
+/* Stat a path, following symlinks, using fstatat() relative to a cached fd
+ * for its parent directory. The directory is only walked again when the
+ * parent changes, so a whole package file list costs one path lookup per
+ * directory plus one fstatat() per file.
+ *
+ * Returns 0 on success or -1 with errno set, as for stat().
+ */
+int file_probe_stat(file_probe_t * probe, const char *path, struct stat *st)
+{
+    const char *base;
+    size_t dir_len;
+
+    base = strrchr(path, '/');
+    if (!base || base == path || base[1] == '\0')
+        return stat(path, st);
+
+    dir_len = base - path;
+    base++;
+
+    if (!probe->dir || probe->dir_len != dir_len
+            || strncmp(probe->dir, path, dir_len) != 0)
+        file_probe_open_dir(probe, path, dir_len);
+
+    if (probe->dirfd < 0) {
+        /* A missing parent means the file is missing too, without needing
+         * another lookup. Anything else falls back to a plain stat().
+         */
+        if (probe->dir_errno == ENOENT || probe->dir_errno == ENOTDIR) {
+            errno = probe->dir_errno;
+            return -1;
+        }
+        return stat(path, st);
+    }
+
+    return fstatat(probe->dirfd, base, st, 0);
+}
@@ -19,10 +19,22 @@
 #ifndef FILE_UTIL_H
 #define FILE_UTIL_H
 
+#include <sys/stat.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Cached parent directory for stat'ing runs of paths which share a directory,
+ * as consecutive entries in a package file list usually do.
+ */
+typedef struct {
+    int dirfd;
+    int dir_errno;
+    char *dir;
+    size_t dir_len;
+} file_probe_t;
+
 int file_exists(const char *file_name);
 int file_is_dir(const char *file_name);
 int file_is_symlink(const char *file_name);
@@ -36,6 +48,10 @@ char *file_sha256sum_alloc(const char *file_name);
 int rm_r(const char *path);
 int file_decompress(const char *in, const char *out);
 
+void file_probe_init(file_probe_t * probe);
+int file_probe_stat(file_probe_t * probe, const char *path, struct stat *st);
+void file_probe_deinit(file_probe_t * probe);
+
 /* Buffer size used for extracting files from archives. */
 #define EXTRACT_BUFFER_LEN 0x8000
 
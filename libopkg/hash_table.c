@@ -71,24 +71,10 @@ void hash_print_stats(hash_table_t * hash)
 
 void hash_table_deinit(hash_table_t * hash)
 {
-    unsigned int i;
     if (!hash)
         return;
 
-    /* free the reminaing entries */
-    for (i = 0; i < hash->n_buckets; i++) {
-        hash_entry_t *hash_entry = (hash->entries + i);
-        free(hash_entry->key);
-        /* skip the first entry as this is part of the array */
-        hash_entry = hash_entry->next;
-        while (hash_entry) {
-            hash_entry_t *old = hash_entry;
-            hash_entry = hash_entry->next;
-            free(old->key);
-            free(old);
-        }
-    }
-
+    arena_deinit(&hash->arena);
     free(hash->entries);
 
     hash->entries = NULL;
@@ -115,6 +101,7 @@ void *hash_table_get(hash_table_t * hash, const char *key)
 int hash_table_insert(hash_table_t * hash, const char *key, void *value)
 {
     unsigned int bucket_len = 0;
+    size_t len;
     int ndx = hash_index(hash, key);
     hash_entry_t *hash_entry = hash->entries + ndx;
     if (hash_entry->key) {
@@ -136,7 +123,13 @@ int hash_table_insert(hash_table_t * hash, const char *key, void *value)
                 }
                 bucket_len++;
             }
-            hash_entry->next = xcalloc(1, sizeof(hash_entry_t));
+            if (hash->free_entries) {
+                hash_entry->next = hash->free_entries;
+                hash->free_entries = hash->free_entries->next;
+            } else {
+                hash_entry->next = arena_calloc(&hash->arena,
+                                                sizeof(hash_entry_t));
+            }
             hash_entry = hash_entry->next;
             hash_entry->next = NULL;
 
@@ -148,7 +141,13 @@ int hash_table_insert(hash_table_t * hash, const char *key, void *value)
         hash->n_used_buckets++;
 
     hash->n_elements++;
-    hash_entry->key = xstrdup(key);
+    /* A reused entry still has the key it was removed with, which will do
+     * if it is long enough. */
+    len = strlen(key);
+    if (hash_entry->key && strlen(hash_entry->key) >= len)
+        memmove(hash_entry->key, key, len + 1);
+    else
+        hash_entry->key = arena_strdup(&hash->arena, key);
     hash_entry->data = value;
 
     return 0;
@@ -158,23 +157,33 @@ int hash_table_remove(hash_table_t * hash, const char *key)
 {
     int ndx = hash_index(hash, key);
     hash_entry_t *hash_entry = hash->entries + ndx;
-    hash_entry_t *next_entry = NULL, *last_entry = NULL;
+    hash_entry_t *next_entry = NULL, *last_entry = NULL, *freed = NULL;
+    char *freed_key;
     while (hash_entry) {
         if (hash_entry->key) {
             if (strcmp(key, hash_entry->key) == 0) {
-                free(hash_entry->key);
+                /* The key and any chained entry stay in the arena until
+                 * the table is deinitialised, and a chained entry goes on
+                 * the free list with its key for the next insert. */
                 if (last_entry) {
                     last_entry->next = hash_entry->next;
-                    free(hash_entry);
+                    freed = hash_entry;
                 } else {
                     next_entry = hash_entry->next;
                     if (next_entry) {
+                        freed_key = hash_entry->key;
                         memmove(hash_entry, next_entry, sizeof(hash_entry_t));
-                        free(next_entry);
+                        next_entry->key = freed_key;
+                        freed = next_entry;
                     } else {
                         memset(hash_entry, 0, sizeof(hash_entry_t));
                     }
                 }
+                if (freed) {
+                    freed->data = NULL;
+                    freed->next = hash->free_entries;
+                    hash->free_entries = freed;
+                }
                 return 1;
             }
         }
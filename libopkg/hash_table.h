@@ -19,6 +19,8 @@
 #ifndef _HASH_TABLE_H_
 #define _HASH_TABLE_H_
 
+#include "arena.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -35,6 +37,10 @@ struct hash_entry {
 struct hash_table {
     const char *name;
     hash_entry_t *entries;
+    /* Keys and chained entries live here, and go with the table. */
+    arena_t arena;
+    /* Chained entries removed from the table, for reuse. */
+    hash_entry_t *free_entries;
     unsigned int n_buckets;
     unsigned int n_elements;
 
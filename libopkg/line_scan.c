@@ -0,0 +1,134 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* line_scan.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "line_scan.h"
+#include "xfuncs.h"
+
+/* Read what is left of fd into a buffer, for files which can't be mapped. */
+static int read_whole(line_scan_t * scan, int fd, size_t size_hint)
+{
+    size_t size = size_hint ? size_hint + 1 : 4096;
+    ssize_t r;
+
+    scan->data = xmalloc(size);
+    scan->len = 0;
+    while (1) {
+        if (scan->len == size) {
+            size *= 2;
+            scan->data = xrealloc(scan->data, size);
+        }
+        r = read(fd, scan->data + scan->len, size - scan->len);
+        if (r == 0)
+            break;
+        if (r < 0) {
+            if (errno == EINTR)
+                continue;
+            free(scan->data);
+            scan->data = NULL;
+            return -1;
+        }
+        scan->len += r;
+    }
+
+    return 0;
+}
+
+int line_scan_open(line_scan_t * scan, const char *file_name)
+{
+    struct stat st;
+    void *map;
+    int fd, r = 0, saved_errno;
+
+    memset(scan, 0, sizeof(*scan));
+
+    fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &st) == -1) {
+        saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return -1;
+    }
+
+    /* Files in /proc claim to be empty, so those are read instead. */
+    if (S_ISREG(st.st_mode) && st.st_size > 0
+            && (map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd,
+                           0)) != MAP_FAILED) {
+        madvise(map, st.st_size, MADV_SEQUENTIAL);
+        scan->data = map;
+        scan->len = st.st_size;
+        scan->mapped = 1;
+    } else {
+        r = read_whole(scan, fd, S_ISREG(st.st_mode) ? st.st_size : 0);
+    }
+
+    saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return r;
+}
+
+char *line_scan_next(line_scan_t * scan, size_t * len)
+{
+    const char *start, *nl;
+    size_t left, n;
+
+    if (scan->pos >= scan->len)
+        return NULL;
+
+    start = scan->data + scan->pos;
+    left = scan->len - scan->pos;
+    scan->line_num++;
+
+    /* memchr is vectorised by the libc, so long lines cost little. */
+    nl = memchr(start, '\n', left);
+    n = nl ? (size_t)(nl - start) : left;
+    scan->missing_nl = nl == NULL;
+    scan->pos += nl ? n + 1 : n;
+
+    /* Copying out leaves the mapping read only, which costs less than
+     * writing terminators into private copies of its pages would.
+     */
+    if (n + 1 > scan->line_size) {
+        scan->line_size = n + 1 > 256 ? 2 * (n + 1) : 256;
+        scan->line = xrealloc(scan->line, scan->line_size);
+    }
+    memcpy(scan->line, start, n);
+    scan->line[n] = '\0';
+
+    if (len)
+        *len = n;
+    return scan->line;
+}
+
+void line_scan_close(line_scan_t * scan)
+{
+    if (scan->mapped)
+        munmap(scan->data, scan->len);
+    else
+        free(scan->data);
+    free(scan->line);
+    memset(scan, 0, sizeof(*scan));
+}
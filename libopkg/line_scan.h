@@ -0,0 +1,57 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* line_scan.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef LINE_SCAN_H
+#define LINE_SCAN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Reads a file line by line without a read per line or an allocation per
+ * line. The file is mapped and searched for newlines with memchr(), and
+ * each line is copied out to a buffer reused for the next, which is only
+ * grown for longer lines. Files which can't be mapped are read into memory
+ * whole instead.
+ */
+typedef struct line_scan line_scan_t;
+
+struct line_scan {
+    char *data;
+    size_t len;
+    size_t pos;
+    int mapped;
+    char *line;
+    size_t line_size;
+    unsigned int line_num;      /* of the line last returned, from 1 */
+    int missing_nl;             /* the line last returned had no newline */
+};
+
+/* Returns 0, or -1 with errno set if the file can't be read. */
+int line_scan_open(line_scan_t * scan, const char *file_name);
+
+/* Returns the next line, without its newline, until the end of the file
+ * and then NULL. The line may be modified, but only lasts until the next
+ * call.
+ */
+char *line_scan_next(line_scan_t * scan, size_t * len);
+
+void line_scan_close(line_scan_t * scan);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* LINE_SCAN_H */
@@ -57,7 +57,7 @@
 #define SWAP(n) (n)
 #endif
 
-#define BLOCKSIZE 4096
+#define BLOCKSIZE 32768
 #if BLOCKSIZE % 64 != 0
 #error "invalid BLOCKSIZE"
 #endif
@@ -25,25 +25,10 @@ extern "C" {
 
 #include "pkg.h"
 #include "opkg_message.h"
+#include "opkg_transaction.h"
 
-typedef struct _opkg_progress_data_t opkg_progress_data_t;
-
-typedef void (*opkg_progress_callback_t) (const opkg_progress_data_t *
-                                          progress, void *user_data);
 typedef void (*opkg_package_callback_t) (pkg_t * pkg, void *user_data);
 
-enum _opkg_action_t {
-    OPKG_INSTALL,
-    OPKG_REMOVE,
-    OPKG_DOWNLOAD
-};
-
-struct _opkg_progress_data_t {
-    int percentage;
-    int action;
-    pkg_t *pkg;
-};
-
 int opkg_new(void);
 void opkg_free(void);
 int opkg_re_read_config_files(void);
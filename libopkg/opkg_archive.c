@@ -772,6 +772,14 @@ int ar_extract_all(struct opkg_ar *ar, const char *prefix)
     return extract_all(ar->ar, prefix, ar->extract_flags);
 }
 
+/* Don't unlink existing files before extracting over them. Only useful when
+ * the caller already knows that the destination paths are not present.
+ */
+void ar_set_no_unlink(struct opkg_ar *ar)
+{
+    ar->extract_flags &= ~ARCHIVE_EXTRACT_UNLINK;
+}
+
 void ar_close(struct opkg_ar *ar)
 {
     archive_read_free(ar->ar);
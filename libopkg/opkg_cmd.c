@@ -47,6 +47,11 @@
 #include "xsystem.h"
 #include "xfuncs.h"
 #include "opkg_solv.h"
+#include "opkg_snapshot.h"
+#include "opkg_file_index.h"
+#include "opkg_what.h"
+#include "opkg_profile.h"
+#include "opkg_transaction.h"
 
 void populate_arch_list()
 {
@@ -635,6 +640,80 @@ static int opkg_download_cmd(int argc, char **argv)
 #endif
 }
 
+static int opkg_apply_plan_cmd(int argc, char **argv)
+{
+    populate_arch_list();
+    opkg_solv_prepare();
+    return opkg_solv_apply_plan(argv[0]);
+}
+
+/* Arguments are <operation>:<package>, solved and committed together. */
+static int opkg_transaction_cmd(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        opkg_transaction_op_t op;
+    } ops[] = {
+        {"install", OPKG_TRANSACTION_INSTALL},
+        {"remove", OPKG_TRANSACTION_REMOVE},
+        {"upgrade", OPKG_TRANSACTION_UPGRADE},
+        {"lock", OPKG_TRANSACTION_LOCK},
+    };
+    opkg_transaction_t *trans;
+    opkg_transaction_step_t step;
+    const char *name;
+    unsigned int i, j;
+    int err = 0;
+
+    populate_arch_list();
+    opkg_solv_prepare();
+
+    trans = opkg_transaction_new();
+    for (i = 0; i < (unsigned int)argc; i++) {
+        name = strchr(argv[i], ':');
+        for (j = 0; name && j < ARRAY_SIZE(ops); j++) {
+            if (strncmp(argv[i], ops[j].name, name - argv[i]) == 0
+                    && ops[j].name[name - argv[i]] == '\0')
+                break;
+        }
+        if (!name || j == ARRAY_SIZE(ops)) {
+            opkg_msg(ERROR, "%s is not <operation>:<package>.\n", argv[i]);
+            err = -1;
+            goto out;
+        }
+        if (opkg_transaction_add(trans, ops[j].op, name + 1) < 0) {
+            err = -1;
+            goto out;
+        }
+    }
+
+    if (opkg_transaction_solve(trans) < 0) {
+        err = -1;
+        goto out;
+    }
+
+    /* Only show what would be done, the commit reports what it does. */
+    if (opkg_config->noaction) {
+        for (i = 0; i < opkg_transaction_step_count(trans); i++) {
+            opkg_transaction_get_step(trans, i, &step);
+            if (step.replaces)
+                printf("upgrade %s %s %s\n", step.pkg->name,
+                       step.replaces->version, step.pkg->version);
+            else
+                printf("%s %s %s\n",
+                       step.action == OPKG_REMOVE ? "remove" : "install",
+                       step.pkg->name, step.pkg->version);
+        }
+        goto out;
+    }
+
+    err = opkg_transaction_commit(trans, NULL, NULL);
+
+ out:
+    opkg_transaction_free(trans);
+    return err;
+}
+
 static int opkg_list_cmd(int argc, char **argv)
 {
     int err;
@@ -653,41 +732,41 @@ static int opkg_list_installed_cmd(int argc, char **argv)
     populate_arch_list();
     opkg_solv_prepare();
     pkg_names = pkg_names_from_args(argc, argv);
+    if (!opkg_solv_status_loaded()) {
+        err = opkg_snapshot_list_installed(pkg_names);
+        if (err <= 0)
+            return err;
+        if (opkg_solv_load_status_files())
+            return -1;
+    }
     err = opkg_solv_process(pkg_names, MODE_LIST_INSTALLED);
+    if (err == 0 && !opkg_snapshot_valid())
+        opkg_snapshot_write();
     return err;
 }
 
 static int opkg_list_changed_conffiles_cmd(int argc, char **argv)
 {
-    unsigned int i;
-    pkg_vec_t *available;
-    pkg_t *pkg;
-    char *pkg_name = NULL;
-    conffile_list_elt_t *iter;
-    conffile_t *cf;
+    str_list_t *patterns;
+    int err;
 
-    if (argc > 0) {
-        pkg_name = argv[0];
-    }
-    available = pkg_vec_alloc();
-//    pkg_hash_fetch_all_installed(available);
-//    pkg_vec_sort(available, pkg_compare_names);
-    for (i = 0; i < available->len; i++) {
-        pkg = available->pkgs[i];
-        /* if we have package name or pattern and pkg does not match, then skip it */
-        if (pkg_name && fnmatch(pkg_name, pkg->name, 0))
-            continue;
-        if (nv_pair_list_empty(&pkg->conffiles))
-            continue;
-        for (iter = nv_pair_list_first(&pkg->conffiles); iter;
-                iter = nv_pair_list_next(&pkg->conffiles, iter)) {
-            cf = (conffile_t *) iter->data;
-            if (cf->name && cf->value && conffile_has_been_modified(cf))
-                printf("%s\n", cf->name);
-        }
-    }
-    pkg_vec_free(available);
-    return 0;
+    patterns = pkg_names_from_args(argc > 0 ? 1 : 0, argv);
+    err = opkg_verify_installed(patterns, 1);
+    if (patterns)
+        str_list_purge(patterns);
+    return err < 0 ? err : 0;
+}
+
+static int opkg_verify_cmd(int argc, char **argv)
+{
+    str_list_t *patterns;
+    int err;
+
+    patterns = pkg_names_from_args(argc, argv);
+    err = opkg_verify_installed(patterns, 0);
+    if (patterns)
+        str_list_purge(patterns);
+    return err;
 }
 
 static int opkg_list_upgradable_cmd(int argc, char **argv)
@@ -721,7 +800,16 @@ static int opkg_info_status_cmd(int argc, char **argv, int installed_only)
     populate_arch_list();
     opkg_solv_prepare();
     pkg_names = pkg_names_from_args(argc, argv);
+    if (installed_only && !opkg_solv_status_loaded()) {
+        err = opkg_snapshot_status(pkg_names);
+        if (err <= 0)
+            return err;
+        if (opkg_solv_load_status_files())
+            return -1;
+    }
     err = opkg_solv_process(pkg_names, MODE_STATUS);
+    if (installed_only && err == 0 && !opkg_snapshot_valid())
+        opkg_snapshot_write();
     return err;
     //TODO: Implement
     #if 0
@@ -891,6 +979,13 @@ static int opkg_flag_cmd(int argc, char **argv)
         populate_arch_list();
         opkg_solv_prepare();
         pkg_names = pkg_names_from_args(argc - 1, argv + 1);
+        if (!opkg_solv_status_loaded()) {
+            err = opkg_snapshot_flag(argv[0], pkg_names);
+            if (err <= 0)
+                return err;
+            if (opkg_solv_load_status_files())
+                return -1;
+        }
         err = opkg_solv_process(pkg_names, mode);
     }
     return err;
@@ -952,8 +1047,9 @@ static int opkg_files_cmd(int argc, char **argv)
 //TODO: IMPLEMENT
 #if 0
     pkg_t *pkg;
-    str_list_t *files;
-    str_list_elt_t *iter;
+    str_vec_t *files;
+    unsigned int iter = 0;
+    const char *file;
     char *pkg_version;
 
     if (argc < 1) {
@@ -972,8 +1068,8 @@ static int opkg_files_cmd(int argc, char **argv)
     printf("Package %s (%s) is installed on %s and has the following files:\n",
            pkg->name, pkg_version, pkg->dest->name);
 
-    for (iter = str_list_first(files); iter; iter = str_list_next(files, iter))
-        printf("%s\n", (char *)iter->data);
+    while ((file = str_vec_next(files, &iter)))
+        printf("%s\n", file);
 
     free(pkg_version);
     pkg_free_installed_files(pkg);
@@ -1033,219 +1129,45 @@ static int opkg_depends_cmd(int argc, char **argv)
 #endif
 }
 
-/*
-static int pkg_mark_provides(pkg_t * pkg)
+static int opkg_what_depends_conflicts_cmd(enum what_field_type type,
+                                           int recursive, int argc, char **argv)
 {
-    int provides_count = pkg->provides_count;
-    abstract_pkg_t **provides = pkg->provides;
-    int i;
-    pkg->parent->state_flag |= SF_MARKED;
-    for (i = 0; i < provides_count; i++) {
-        provides[i]->state_flag |= SF_MARKED;
-    }
-    return 0;
+    populate_arch_list();
+    opkg_solv_prepare();
+    return opkg_what_depends(type, recursive, argc, (const char **)argv);
 }
-*/
-
-enum what_field_type {
-    WHATDEPENDS,
-    WHATCONFLICTS,
-    WHATPROVIDES,
-    WHATREPLACES,
-    WHATRECOMMENDS,
-    WHATSUGGESTS
-};
 
-static int opkg_what_depends_conflicts_cmd(int what_field_type,
-                                           int recursive, int argc, char **argv)
+static int opkg_what_provides_replaces_cmd(enum what_field_type type,
+                                           int argc, char **argv)
 {
-//TODO: IMPLEMENT
-#if 0
-    depend_t *possibility;
-    compound_depend_t *cdep;
-    pkg_vec_t *available_pkgs;
-    pkg_t *pkg;
-    int i, k, l;
-    unsigned int j;
-    int changed, count;
-    const char *rel_str = NULL;
-    char *ver;
-
-    switch (what_field_type) {
-    case DEPEND:
-        rel_str = "depends on";
-        break;
-    case CONFLICTS:
-        rel_str = "conflicts with";
-        break;
-    case SUGGEST:
-        rel_str = "suggests";
-        break;
-    case RECOMMEND:
-        rel_str = "recommends";
-        break;
-    default:
-        return -1;
-    }
-
-    available_pkgs = pkg_vec_alloc();
-
-    if (opkg_config->query_all)
-        pkg_hash_fetch_available(available_pkgs);
-    else
-        pkg_hash_fetch_all_installed(available_pkgs);
-
-    /* mark the root set */
-    pkg_vec_clear_marks(available_pkgs);
-    opkg_msg(NOTICE, "Root set:\n");
-    for (i = 0; i < argc; i++)
-        pkg_vec_mark_if_matches(available_pkgs, argv[i]);
-
-    for (j = 0; j < available_pkgs->len; j++) {
-        pkg = available_pkgs->pkgs[j];
-        if (pkg->state_flag & SF_MARKED) {
-            /* mark the parent (abstract) package */
-            pkg_mark_provides(pkg);
-            opkg_msg(NOTICE, "  %s\n", pkg->name);
-        }
-    }
-
-    opkg_msg(NOTICE, "What %s root set\n", rel_str);
-    do {
-        changed = 0;
-
-        for (j = 0; j < available_pkgs->len; j++) {
-            pkg = available_pkgs->pkgs[j];
-            count = (what_field_type == CONFLICTS) ? pkg->conflicts_count :
-                    (pkg->pre_depends_count + pkg->depends_count + pkg->recommends_count + pkg->suggests_count);
-
-            /* skip this package if it is already marked */
-            if (pkg->parent->state_flag & SF_MARKED)
-                continue;
-
-            for (k = 0; k < count; k++) {
-                cdep = (what_field_type == CONFLICTS) ? &pkg->conflicts[k] : &pkg->depends[k];
-
-                if (what_field_type != cdep->type)
-                    continue;
-
-                for (l = 0; l < cdep->possibility_count; l++) {
-                    possibility = cdep->possibilities[l];
-
-                    if ((possibility->pkg->state_flag & SF_MARKED) != SF_MARKED)
-                        continue;
-
-                    /* mark the depending package so we
-                     * won't visit it again */
-                    pkg->state_flag |= SF_MARKED;
-                    pkg_mark_provides(pkg);
-                    changed++;
-
-                    ver = pkg_version_str_alloc(pkg);
-                    opkg_msg(NOTICE, "\t%s %s\t%s %s", pkg->name, ver, rel_str,
-                             possibility->pkg->name);
-                    free(ver);
-                    if (possibility->version) {
-                        opkg_msg(NOTICE, " (%s%s)",
-                                 constraint_to_str(possibility->constraint),
-                                 possibility->version);
-                    }
-                    if (!pkg_dependence_satisfiable(possibility))
-                        opkg_msg(NOTICE, " unsatisfiable");
-                    opkg_message(NOTICE, "\n");
-                    goto next_package;
-                }
-            }
- next_package:
-            ;
-        }
-    } while (changed && recursive);
-
-    pkg_vec_free(available_pkgs);
-
-    return 0;
-#endif
+    populate_arch_list();
+    opkg_solv_prepare();
+    return opkg_what_provides(type, argc, (const char **)argv);
 }
 
 static int opkg_whatdepends_recursively_cmd(int argc, char **argv)
-{//TODO: IMPLEMENT
-#if 0
-    return opkg_what_depends_conflicts_cmd(DEPEND, 1, argc, argv);
-#endif
+{
+    return opkg_what_depends_conflicts_cmd(WHATDEPENDS, 1, argc, argv);
 }
 
 static int opkg_whatdepends_cmd(int argc, char **argv)
 {
-//TODO: IMPLEMENT
-#if 0
-    return opkg_what_depends_conflicts_cmd(DEPEND, 0, argc, argv);
-#endif
+    return opkg_what_depends_conflicts_cmd(WHATDEPENDS, 0, argc, argv);
 }
 
 static int opkg_whatsuggests_cmd(int argc, char **argv)
 {
-//TODO: IMPLEMENT
-#if 0
-    return opkg_what_depends_conflicts_cmd(SUGGEST, 0, argc, argv);
-#endif
+    return opkg_what_depends_conflicts_cmd(WHATSUGGESTS, 0, argc, argv);
 }
 
 static int opkg_whatrecommends_cmd(int argc, char **argv)
 {
-//TODO: IMPLEMENT
-#if 0
-    return opkg_what_depends_conflicts_cmd(RECOMMEND, 0, argc, argv);
-#endif
+    return opkg_what_depends_conflicts_cmd(WHATRECOMMENDS, 0, argc, argv);
 }
 
 static int opkg_whatconflicts_cmd(int argc, char **argv)
 {
-//TODO: IMPLEMENT
-#if 0
-    return opkg_what_depends_conflicts_cmd(CONFLICTS, 0, argc, argv);
-#endif
-}
-
-static int opkg_what_provides_replaces_cmd(enum what_field_type what_field_type,
-                                           int argc, char **argv)
-{
-//TODO: IMPLEMENT
-#if 0
-    if (argc > 0) {
-        pkg_vec_t *available_pkgs = pkg_vec_alloc();
-        const char *rel_str = (what_field_type == WHATPROVIDES ? "provides" : "replaces");
-        int i;
-
-        pkg_info_preinstall_check();
-
-        if (opkg_config->query_all)
-            pkg_hash_fetch_available(available_pkgs);
-        else
-            pkg_hash_fetch_all_installed(available_pkgs);
-        for (i = 0; i < argc; i++) {
-            const char *target = argv[i];
-            unsigned int j;
-
-            opkg_msg(NOTICE, "What %s %s\n", rel_str, target);
-            for (j = 0; j < available_pkgs->len; j++) {
-                pkg_t *pkg = available_pkgs->pkgs[j];
-                int k;
-                int count = (what_field_type == WHATPROVIDES) ? pkg->provides_count : pkg->replaces_count;
-                for (k = 0; k < count; k++) {
-                    abstract_pkg_t *apkg = ((what_field_type == WHATPROVIDES) ? pkg->provides[k] : pkg->replaces[k]);
-                    if (fnmatch(target, apkg->name, 0) == 0) {
-                        opkg_msg(NOTICE, "    %s", pkg->name);
-                        if (strcmp(target, apkg->name) != 0)
-                            opkg_msg(NOTICE, "\t%s %s\n", rel_str, apkg->name);
-                        opkg_message(NOTICE, "\n");
-                    }
-                }
-            }
-        }
-        pkg_vec_free(available_pkgs);
-    }
-    return 0;
-#endif
+    return opkg_what_depends_conflicts_cmd(WHATCONFLICTS, 0, argc, argv);
 }
 
 static int opkg_whatprovides_cmd(int argc, char **argv)
@@ -1260,42 +1182,9 @@ static int opkg_whatreplaces_cmd(int argc, char **argv)
 
 static int opkg_search_cmd(int argc, char **argv)
 {
-    //TODO: implement through SOLV
-    /*
-    unsigned int i;
-
-    pkg_vec_t *installed;
-    pkg_t *pkg;
-    str_list_t *installed_files;
-    str_list_elt_t *iter;
-    char *installed_file;
-
-    if (argc < 1) {
-        return -1;
-    }
-
-    installed = pkg_vec_alloc();
-    pkg_hash_fetch_all_installed(installed);
-    pkg_vec_sort(installed, pkg_compare_names);
-
-    for (i = 0; i < installed->len; i++) {
-        pkg = installed->pkgs[i];
-
-        installed_files = pkg_get_installed_files(pkg);
-
-        for (iter = str_list_first(installed_files); iter;
-                iter = str_list_next(installed_files, iter)) {
-            installed_file = (char *)iter->data;
-            if (fnmatch(argv[0], installed_file, 0) == 0)
-                print_pkg(pkg);
-        }
-
-        pkg_free_installed_files(pkg);
-    }
-
-    pkg_vec_free(installed);
-*/
-    return 0;
+    populate_arch_list();
+    opkg_solv_prepare();
+    return opkg_file_index_search(argc, (const char **)argv);
 }
 
 static int opkg_compare_versions_cmd(int argc, char **argv)
@@ -1331,46 +1220,65 @@ static int opkg_print_architecture_cmd(int argc, char **argv)
 #endif
 }
 
+/* What each command needs loaded, in the table below. */
+#define NEEDS_CONF OPKG_CMD_NEEDS_CONF
+#define NEEDS_STATUS OPKG_CMD_NEEDS_STATUS
+#define NEEDS_ALL (OPKG_CMD_NEEDS_STATUS | OPKG_CMD_NEEDS_FEEDS)
+#define NEEDS_LOCK OPKG_CMD_NEEDS_LOCK
+
 /* XXX: CLEANUP: The usage strings should be incorporated into this
    array for easier maintenance */
 static opkg_cmd_t cmds[] = {
-    {"update", 0, (opkg_cmd_fun_t) opkg_update_cmd},
-    {"upgrade", 0, (opkg_cmd_fun_t) opkg_upgrade_cmd},
-    {"list", 0, (opkg_cmd_fun_t) opkg_list_cmd},
-    {"list_installed", 0, (opkg_cmd_fun_t) opkg_list_installed_cmd},
-    {"list-installed", 0, (opkg_cmd_fun_t) opkg_list_installed_cmd},
-    {"list_upgradable", 0, (opkg_cmd_fun_t) opkg_list_upgradable_cmd},
-    {"list-upgradable", 0, (opkg_cmd_fun_t) opkg_list_upgradable_cmd},
+    {"update", 0, (opkg_cmd_fun_t) opkg_update_cmd, NEEDS_CONF | NEEDS_LOCK},
+    {"upgrade", 0, (opkg_cmd_fun_t) opkg_upgrade_cmd, NEEDS_ALL | NEEDS_LOCK},
+    {"apply-plan", 1,
+        (opkg_cmd_fun_t) opkg_apply_plan_cmd, NEEDS_STATUS | NEEDS_LOCK},
+    {"transaction", 1,
+        (opkg_cmd_fun_t) opkg_transaction_cmd, NEEDS_ALL | NEEDS_LOCK},
+    {"list", 0, (opkg_cmd_fun_t) opkg_list_cmd, NEEDS_ALL},
+    {"list_installed", 0, (opkg_cmd_fun_t) opkg_list_installed_cmd, NEEDS_CONF},
+    {"list-installed", 0, (opkg_cmd_fun_t) opkg_list_installed_cmd, NEEDS_CONF},
+    {"list_upgradable", 0,
+        (opkg_cmd_fun_t) opkg_list_upgradable_cmd, NEEDS_ALL},
+    {"list-upgradable", 0,
+        (opkg_cmd_fun_t) opkg_list_upgradable_cmd, NEEDS_ALL},
     {"list_changed_conffiles", 0,
-        (opkg_cmd_fun_t) opkg_list_changed_conffiles_cmd},
+        (opkg_cmd_fun_t) opkg_list_changed_conffiles_cmd, NEEDS_STATUS},
     {"list-changed-conffiles", 0,
-        (opkg_cmd_fun_t) opkg_list_changed_conffiles_cmd},
-    {"info", 0, (opkg_cmd_fun_t) opkg_info_cmd},
-    {"flag", 1, (opkg_cmd_fun_t) opkg_flag_cmd},
-    {"status", 0, (opkg_cmd_fun_t) opkg_status_cmd},
-    {"install", 1, (opkg_cmd_fun_t) opkg_install_cmd},
-    {"remove", 1, (opkg_cmd_fun_t) opkg_remove_cmd},
-    {"clean", 0, (opkg_cmd_fun_t) opkg_clean_cmd},
-    {"configure", 0, (opkg_cmd_fun_t) opkg_configure_cmd},
-    {"files", 1, (opkg_cmd_fun_t) opkg_files_cmd},
-    {"search", 1, (opkg_cmd_fun_t) opkg_search_cmd},
-    {"download", 1, (opkg_cmd_fun_t) opkg_download_cmd},
-    {"compare_versions", 1, (opkg_cmd_fun_t) opkg_compare_versions_cmd},
-    {"compare-versions", 1, (opkg_cmd_fun_t) opkg_compare_versions_cmd},
-    {"print-architecture", 0, (opkg_cmd_fun_t) opkg_print_architecture_cmd},
-    {"print_architecture", 0, (opkg_cmd_fun_t) opkg_print_architecture_cmd},
+        (opkg_cmd_fun_t) opkg_list_changed_conffiles_cmd, NEEDS_STATUS},
+    {"info", 0, (opkg_cmd_fun_t) opkg_info_cmd, NEEDS_ALL},
+    {"flag", 1, (opkg_cmd_fun_t) opkg_flag_cmd, NEEDS_CONF | NEEDS_LOCK},
+    {"status", 0, (opkg_cmd_fun_t) opkg_status_cmd, NEEDS_CONF},
+    {"verify", 0, (opkg_cmd_fun_t) opkg_verify_cmd, NEEDS_STATUS},
+    {"install", 1, (opkg_cmd_fun_t) opkg_install_cmd, NEEDS_ALL | NEEDS_LOCK},
+    {"remove", 1, (opkg_cmd_fun_t) opkg_remove_cmd, NEEDS_STATUS | NEEDS_LOCK},
+    {"clean", 0, (opkg_cmd_fun_t) opkg_clean_cmd, NEEDS_CONF | NEEDS_LOCK},
+    {"configure", 0,
+        (opkg_cmd_fun_t) opkg_configure_cmd, NEEDS_STATUS | NEEDS_LOCK},
+    {"files", 1, (opkg_cmd_fun_t) opkg_files_cmd, NEEDS_STATUS},
+    {"search", 1, (opkg_cmd_fun_t) opkg_search_cmd, NEEDS_CONF},
+    {"download", 1, (opkg_cmd_fun_t) opkg_download_cmd, NEEDS_ALL | NEEDS_LOCK},
+    {"compare_versions", 1,
+        (opkg_cmd_fun_t) opkg_compare_versions_cmd, NEEDS_CONF},
+    {"compare-versions", 1,
+        (opkg_cmd_fun_t) opkg_compare_versions_cmd, NEEDS_CONF},
+    {"print-architecture", 0,
+        (opkg_cmd_fun_t) opkg_print_architecture_cmd, NEEDS_CONF},
+    {"print_architecture", 0,
+        (opkg_cmd_fun_t) opkg_print_architecture_cmd, NEEDS_CONF},
     {"print-installation-architecture", 0,
-        (opkg_cmd_fun_t) opkg_print_architecture_cmd},
+        (opkg_cmd_fun_t) opkg_print_architecture_cmd, NEEDS_CONF},
     {"print_installation_architecture", 0,
-        (opkg_cmd_fun_t) opkg_print_architecture_cmd},
-    {"depends", 1, (opkg_cmd_fun_t) opkg_depends_cmd},
-    {"whatdepends", 1, (opkg_cmd_fun_t) opkg_whatdepends_cmd},
-    {"whatdependsrec", 1, (opkg_cmd_fun_t) opkg_whatdepends_recursively_cmd},
-    {"whatrecommends", 1, (opkg_cmd_fun_t) opkg_whatrecommends_cmd},
-    {"whatsuggests", 1, (opkg_cmd_fun_t) opkg_whatsuggests_cmd},
-    {"whatprovides", 1, (opkg_cmd_fun_t) opkg_whatprovides_cmd},
-    {"whatreplaces", 1, (opkg_cmd_fun_t) opkg_whatreplaces_cmd},
-    {"whatconflicts", 1, (opkg_cmd_fun_t) opkg_whatconflicts_cmd},
+        (opkg_cmd_fun_t) opkg_print_architecture_cmd, NEEDS_CONF},
+    {"depends", 1, (opkg_cmd_fun_t) opkg_depends_cmd, NEEDS_ALL},
+    {"whatdepends", 1, (opkg_cmd_fun_t) opkg_whatdepends_cmd, NEEDS_ALL},
+    {"whatdependsrec", 1,
+        (opkg_cmd_fun_t) opkg_whatdepends_recursively_cmd, NEEDS_ALL},
+    {"whatrecommends", 1, (opkg_cmd_fun_t) opkg_whatrecommends_cmd, NEEDS_ALL},
+    {"whatsuggests", 1, (opkg_cmd_fun_t) opkg_whatsuggests_cmd, NEEDS_ALL},
+    {"whatprovides", 1, (opkg_cmd_fun_t) opkg_whatprovides_cmd, NEEDS_ALL},
+    {"whatreplaces", 1, (opkg_cmd_fun_t) opkg_whatreplaces_cmd, NEEDS_ALL},
+    {"whatconflicts", 1, (opkg_cmd_fun_t) opkg_whatconflicts_cmd, NEEDS_ALL},
 };
 
 opkg_cmd_t *opkg_cmd_find(const char *name)
@@ -1388,6 +1296,29 @@ opkg_cmd_t *opkg_cmd_find(const char *name)
     return NULL;
 }
 
+int opkg_cmd_load(opkg_cmd_t * cmd)
+{
+    int r;
+
+    if (cmd->needs & OPKG_CMD_NEEDS_FEEDS) {
+        opkg_profile_begin("load_feeds");
+        r = opkg_solv_load_feeds();
+        opkg_profile_end("load_feeds");
+        if (r)
+            return -1;
+    }
+
+    if (cmd->needs & OPKG_CMD_NEEDS_STATUS) {
+        opkg_profile_begin("load_status");
+        r = opkg_solv_load_status_files();
+        opkg_profile_end("load_status");
+        if (r)
+            return -1;
+    }
+
+    return 0;
+}
+
 int opkg_cmd_exec(opkg_cmd_t * cmd, int argc, const char **argv)
 {
     return (cmd->fun) (argc, argv);
@@ -25,14 +25,32 @@ extern "C" {
 
 typedef int (*opkg_cmd_fun_t) (int argc, const char **argv);
 
+/* What a command needs loaded before it runs, beyond the configuration. A
+ * command which can sometimes do without, such as one answered from the
+ * status snapshot, leaves it out and loads it itself when it must.
+ *
+ * A command which changes the system or the package lists also needs the
+ * opkg lock. opkg takes it for every command, but opkgd serves the others
+ * without it, alongside each other.
+ */
+enum opkg_cmd_needs {
+    OPKG_CMD_NEEDS_CONF = 0,
+    OPKG_CMD_NEEDS_STATUS = 1 << 0,
+    OPKG_CMD_NEEDS_FEEDS = 1 << 1,
+    OPKG_CMD_NEEDS_LOCK = 1 << 2,
+};
+
 struct opkg_cmd {
     const char *name;
     int requires_args;
     opkg_cmd_fun_t fun;
+    unsigned int needs;
 };
 typedef struct opkg_cmd opkg_cmd_t;
 
 opkg_cmd_t *opkg_cmd_find(const char *name);
+/* Loads what cmd needs which hasn't been loaded already. */
+int opkg_cmd_load(opkg_cmd_t * cmd);
 int opkg_cmd_exec(opkg_cmd_t * cmd, int argc, const char **argv);
 
 #ifdef __cplusplus
@@ -19,7 +19,9 @@
 
 #include "config.h"
 
+#include <ctype.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -31,10 +33,13 @@
 #include "opkg_conf.h"
 #include "pkg_vec.h"
 #include "pkg.h"
-#include "xregex.h"
+#include "line_scan.h"
 #include "sprintf_alloc.h"
 #include "opkg_message.h"
 #include "file_util.h"
+#include "opkg_fsync.h"
+#include "opkg_digest_cache.h"
+#include "str_intern.h"
 #include "xfuncs.h"
 
 static int lock_fd;
@@ -85,6 +90,9 @@ static opkg_option_t options[] = {
     {"combine", OPKG_OPT_TYPE_BOOL, &_conf.combine},
     {"cache_local_files", OPKG_OPT_TYPE_BOOL, &_conf.cache_local_files},
     {"batch", OPKG_OPT_TYPE_BOOL, &_conf.batch},
+    {"durability", OPKG_OPT_TYPE_STRING, &_conf.durability},
+    {"status_journal_max", OPKG_OPT_TYPE_INT, &_conf.status_journal_max},
+    {"configure_jobs", OPKG_OPT_TYPE_INT, &_conf.configure_jobs},
 #if defined(HAVE_OPENSSL)
     {"signature_ca_file", OPKG_OPT_TYPE_STRING, &_conf.signature_ca_file},
     {"signature_ca_path", OPKG_OPT_TYPE_STRING, &_conf.signature_ca_path},
@@ -258,101 +266,70 @@ int opkg_conf_set_option(const char *name, const char *value, int overwrite)
     return -1;
 }
 
+/* Split the next field off a conf line. A field is a run of non-space, or
+ * anything up to a closing quote if it opens with one.
+ */
+static char *conf_field(const char **p)
+{
+    const char *s = *p, *end;
+
+    while (isspace(*s))
+        s++;
+    if (*s == '"' && (end = strchr(s + 1, '"')) != NULL) {
+        *p = end + 1;
+        return xstrndup(s + 1, end - s - 1);
+    }
+    for (end = s; *end && !isspace(*end); end++) ;
+    *p = end;
+    return xstrndup(s, end - s);
+}
+
 static int opkg_conf_parse_file(const char *filename,
                                 pkg_src_list_t * pkg_src_list,
                                 pkg_src_list_t * dist_src_list)
 {
-    int line_num = 0;
-    int err = 0;
-    int r;
-    FILE *file;
-    regex_t valid_line_re, comment_re;
-#define regmatch_size 14
-    regmatch_t regmatch[regmatch_size];
+    line_scan_t scan;
 
-    file = fopen(filename, "r");
-    if (file == NULL) {
+    if (line_scan_open(&scan, filename) < 0) {
         opkg_perror(ERROR, "Failed to open %s", filename);
-        err = -1;
-        goto err0;
+        return -1;
     }
 
     opkg_msg(INFO, "Loading conf file %s.\n", filename);
 
-    err = xregcomp(&comment_re, "^[[:space:]]*(#.*|[[:space:]]*)$",
-            REG_EXTENDED);
-    if (err)
-        goto err1;
-
-    err = xregcomp(&valid_line_re,
-                 "^[[:space:]]*(\"([^\"]*)\"|([^[:space:]]*))"
-                 "[[:space:]]*(\"([^\"]*)\"|([^[:space:]]*))"
-                 "[[:space:]]*(\"([^\"]*)\"|([^[:space:]]*))"
-                 "([[:space:]]+([^[:space:]]+))?([[:space:]]+(.*))?[[:space:]]*$",
-                 REG_EXTENDED);
-    if (err)
-        goto err2;
-
     while (1) {
         char *line;
+        const char *p, *rest, *rest_end;
         char *type, *name, *value, *extra;
+        int garbage;
 
-        line_num++;
-
-        line = file_read_line_alloc(file);
+        line = line_scan_next(&scan, NULL);
         if (line == NULL)
             break;
 
-        r = regexec(&comment_re, line, 0, 0, 0);
-        if (r == 0)
-            goto NEXT_LINE;
-
-        r = regexec(&valid_line_re, line, regmatch_size, regmatch, 0);
-        if (r == REG_NOMATCH) {
-            opkg_msg(ERROR, "%s:%d: Ignoring invalid line: `%s'\n", filename,
-                     line_num, line);
-            goto NEXT_LINE;
-        }
-
-        /* This has to be so ugly to deal with optional quotation marks */
-        if (regmatch[2].rm_so > 0) {
-            type = xstrndup(line + regmatch[2].rm_so,
-                         regmatch[2].rm_eo - regmatch[2].rm_so);
-        } else {
-            type = xstrndup(line + regmatch[3].rm_so,
-                         regmatch[3].rm_eo - regmatch[3].rm_so);
-        }
-
-        if (regmatch[5].rm_so > 0) {
-            name = xstrndup(line + regmatch[5].rm_so,
-                         regmatch[5].rm_eo - regmatch[5].rm_so);
-        } else {
-            name = xstrndup(line + regmatch[6].rm_so,
-                         regmatch[6].rm_eo - regmatch[6].rm_so);
-        }
-
-        if (regmatch[8].rm_so > 0) {
-            value = xstrndup(line + regmatch[8].rm_so,
-                         regmatch[8].rm_eo - regmatch[8].rm_so);
-        } else {
-            value = xstrndup(line + regmatch[9].rm_so,
-                         regmatch[9].rm_eo - regmatch[9].rm_so);
-        }
-
-        extra = NULL;
-        if (regmatch[11].rm_so > 0) {
-            if (regmatch[13].rm_so > 0 && regmatch[13].rm_so != regmatch[13].rm_eo)
-                extra = xstrndup(line + regmatch[11].rm_so,
-                             regmatch[13].rm_eo - regmatch[11].rm_so);
-            else
-                extra = xstrndup(line + regmatch[11].rm_so,
-                             regmatch[11].rm_eo - regmatch[11].rm_so);
-        }
-
-        if (regmatch[13].rm_so != regmatch[13].rm_eo && strncmp(type, "dist", 4) != 0) {
+        /* Skip blank lines and comments. */
+        for (p = line; isspace(*p); p++) ;
+        if (*p == '#' || *p == '\0')
+            continue;
+
+        type = conf_field(&p);
+        name = conf_field(&p);
+        value = conf_field(&p);
+
+        /* Anything after the value is the components of a dist, and
+         * garbage otherwise if it is more than one word.
+         */
+        for (rest = p; isspace(*rest); rest++) ;
+        for (rest_end = rest + strlen(rest);
+             rest_end > rest && isspace(rest_end[-1]); rest_end--) ;
+        extra = rest < rest_end ? xstrndup(rest, rest_end - rest) : NULL;
+        for (p = rest; p < rest_end && !isspace(*p); p++) ;
+        garbage = p < rest_end;
+
+        if (garbage && strncmp(type, "dist", 4) != 0) {
             opkg_msg(ERROR,
-                     "%s:%d: Ignoring config line with trailing garbage: `%s'\n",
-                     filename, line_num, line);
+                     "%s:%u: Ignoring config line with trailing garbage: `%s'\n",
+                     filename, scan.line_num, line);
         } else {
             /* We use the opkg_config->tmp_dest_list below instead of
              * opkg_config->pkg_dest_list because we might encounter an
@@ -407,8 +384,8 @@ static int opkg_conf_parse_file(const char *filename,
                 }
                 nv_pair_list_append(&opkg_config->arch_list, name, value);
             } else {
-                opkg_msg(ERROR, "%s:%d: Ignoring invalid line: `%s'\n",
-                         filename, line_num, line);
+                opkg_msg(ERROR, "%s:%u: Ignoring invalid line: `%s'\n",
+                         filename, scan.line_num, line);
             }
 
         }
@@ -417,22 +394,10 @@ static int opkg_conf_parse_file(const char *filename,
         free(name);
         free(value);
         free(extra);
-
- NEXT_LINE:
-        free(line);
     }
 
-    regfree(&valid_line_re);
- err2:
-    regfree(&comment_re);
- err1:
-    r = fclose(file);
-    if (r == EOF) {
-        opkg_perror(ERROR, "Couldn't close %s", filename);
-        err = -1;
-    }
- err0:
-    return err;
+    line_scan_close(&scan);
+    return 0;
 }
 
 char *root_filename_alloc(char *filename)
@@ -462,11 +427,13 @@ int opkg_conf_init(void)
     pkg_dest_list_init(&opkg_config->tmp_dest_list);
     nv_pair_list_init(&opkg_config->arch_list);
     str_list_init(&opkg_config->exclude_list);
+    arena_init(&opkg_config->arena);
+    arena_init(&opkg_config->scratch);
 
     return 0;
 }
 
-static int opkg_lock()
+int opkg_lock(void)
 {
     int r;
     char *lock_dir;
@@ -505,7 +472,7 @@ static int opkg_lock()
     return 0;
 }
 
-static int opkg_unlock()
+int opkg_unlock(void)
 {
     int r;
     int err = 0;
@@ -523,6 +490,7 @@ static int opkg_unlock()
                         opkg_config->lock_file);
             err = -1;
         }
+        lock_fd = -1;
     }
 
     if (opkg_config->lock_file && file_exists(opkg_config->lock_file)) {
@@ -550,6 +518,7 @@ int opkg_conf_load(void)
 #if defined(HAVE_PATHFINDER)
     opkg_config->check_x509_path = 1;
 #endif
+    opkg_config->status_journal_max = -1;
 
     if (!opkg_config->offline_root)
         opkg_config->offline_root = xstrdup(getenv("OFFLINE_ROOT"));
@@ -603,6 +572,22 @@ int opkg_conf_load(void)
         globfree(&globbuf);
     }
 
+    /* An offline root is usually an image being built, which doesn't need
+     * flushing to disk on every transaction.
+     */
+    if (opkg_config->durability == NULL)
+        opkg_config->durability = xstrdup(opkg_config->offline_root
+                                          ? OPKG_DURABILITY_NONE
+                                          : OPKG_DURABILITY_TARGETED);
+
+    if (strcmp(opkg_config->durability, OPKG_DURABILITY_NONE)
+            && strcmp(opkg_config->durability, OPKG_DURABILITY_TARGETED)
+            && strcmp(opkg_config->durability, OPKG_DURABILITY_FULL)) {
+        opkg_msg(ERROR, "durability option '%s' not understood.\n",
+                 opkg_config->durability);
+        goto err1;
+    }
+
     if (opkg_config->lock_file == NULL)
         opkg_config->lock_file = xstrdup(OPKG_CONF_DEFAULT_LOCK_FILE);
 
@@ -666,6 +651,13 @@ int opkg_conf_load(void)
     if (opkg_config->signature_type == NULL)
         opkg_config->signature_type = xstrdup(OPKG_CONF_DEFAULT_SIGNATURE_TYPE);
 
+    /* Tools building an image read the status file of the offline root
+     * directly, so keep it complete at the end of every run there.
+     */
+    if (opkg_config->status_journal_max < 0)
+        opkg_config->status_journal_max = opkg_config->offline_root
+                ? 0 : OPKG_CONF_DEFAULT_STATUS_JOURNAL_MAX;
+
     /* if no architectures were defined, then default all, noarch, and host architecture */
     if (nv_pair_list_empty(&opkg_config->arch_list)) {
         nv_pair_list_append(&opkg_config->arch_list, "all", "1");
@@ -745,11 +737,15 @@ void opkg_conf_deinit(void)
     if (opkg_config->tmp_dir)
         rm_r(opkg_config->tmp_dir);
 
+    opkg_digest_cache_deinit();
+
     if (opkg_config->volatile_cache)
         rm_r(opkg_config->cache_dir);
 
     free(opkg_config->dest_str);
     free(opkg_config->conf_file);
+    free(opkg_config->profile_file);
+    free(opkg_config->plan_out);
 
     pkg_src_list_deinit(&opkg_config->pkg_src_list);
     pkg_src_list_deinit(&opkg_config->dist_src_list);
@@ -761,10 +757,18 @@ void opkg_conf_deinit(void)
         hash_print_stats(&opkg_config->pkg_hash);
         hash_print_stats(&opkg_config->file_hash);
         hash_print_stats(&opkg_config->obs_file_hash);
+        str_intern_print_stats();
+        printf("arena: %lu allocations, %lu bytes in %lu bytes of chunks\n",
+               opkg_config->arena.n_allocs,
+               (unsigned long)opkg_config->arena.n_bytes,
+               (unsigned long)opkg_config->arena.n_chunk_bytes);
     }
 
     hash_table_deinit(&opkg_config->file_hash);
     hash_table_deinit(&opkg_config->obs_file_hash);
+    str_intern_deinit();
+    arena_deinit(&opkg_config->scratch);
+    arena_deinit(&opkg_config->arena);
 
     opkg_unlock();
 
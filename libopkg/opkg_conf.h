@@ -26,6 +26,7 @@
 extern "C" {
 #endif
 
+#include "arena.h"
 #include "hash_table.h"
 #include "pkg_src_list.h"
 #include "pkg_dest_list.h"
@@ -51,6 +52,11 @@ extern "C" {
 
 #define OPKG_CONF_DEFAULT_SIGNATURE_TYPE "gpg"
 
+/* Size in bytes past which the status journal is folded into the status
+ * file at the end of a run.
+ */
+#define OPKG_CONF_DEFAULT_STATUS_JOURNAL_MAX (64 * 1024)
+
 typedef struct opkg_conf {
     pkg_src_list_t pkg_src_list;
     pkg_src_list_t dist_src_list;
@@ -106,6 +112,11 @@ typedef struct opkg_conf {
     int combine;
     int cache_local_files;
 	int batch;
+    char *durability;
+    int status_journal_max;
+    int configure_jobs;
+    char *profile_file;
+    char *plan_out;
 
     /* ssl options: used only when opkg is configured with '--enable-curl',
      * otherwise always NULL or 0.
@@ -156,6 +167,11 @@ typedef struct opkg_conf {
     hash_table_t pkg_hash;
     hash_table_t file_hash;
     hash_table_t obs_file_hash;
+
+    /* Package objects and other data which lives for the whole run. */
+    arena_t arena;
+    /* Short lived data, thrown away after each package is processed. */
+    arena_t scratch;
 } opkg_conf_t;
 
 enum opkg_option_type {
@@ -178,6 +194,12 @@ int opkg_conf_init(void);
 int opkg_conf_load(void);
 void opkg_conf_deinit(void);
 
+/* opkg_conf_load() takes the lock and opkg_conf_deinit() drops it. These
+ * are for a daemon, which only holds it while serving a request.
+ */
+int opkg_lock(void);
+int opkg_unlock(void);
+
 char *root_filename_alloc(char *filename);
 
 int opkg_conf_get_option(char *option, void *value);
@@ -18,12 +18,31 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
 
 #include "sprintf_alloc.h"
 #include "opkg_configure.h"
 #include "opkg_message.h"
 #include "opkg_cmd.h"
+#include "opkg_profile.h"
+#include "xfuncs.h"
+#include "xsystem.h"
+
+static void configure_failed(pkg_t * pkg, int err)
+{
+    if (!opkg_config->offline_root)
+        opkg_msg(ERROR, "%s.postinst returned %d.\n", pkg->name, err);
+    else
+        opkg_msg(NOTICE,
+                 "%s.postinst returned %d, marking as unpacked only, configuration required on target.\n",
+                 pkg->name, err);
+}
 
 int opkg_configure(pkg_t * pkg)
 {
@@ -37,14 +56,260 @@ int opkg_configure(pkg_t * pkg)
 
     err = pkg_run_script(pkg, "postinst", "configure");
     if (err) {
-        if (!opkg_config->offline_root)
-            opkg_msg(ERROR, "%s.postinst returned %d.\n", pkg->name, err);
-        else
-            opkg_msg(NOTICE,
-                     "%s.postinst returned %d, marking as unpacked only, configuration required on target.\n",
-                     pkg->name, err);
+        configure_failed(pkg, err);
         return err;
     }
 
     return 0;
 }
+
+/* Records the outcome of configuring pkg, as soon as it is known, so that
+ * the status of each package is written before anything which depends on
+ * it is configured.
+ */
+static void configure_done(pkg_t * pkg, int r, int *err)
+{
+    if (r == 0) {
+        pkg->state_status = SS_INSTALLED;
+        pkg->state_flag &= ~SF_PREFER;
+        pkg->state_flag |= SF_CHANGED;
+        pkg_write_status(pkg);
+        opkg_profile_count("packages_configured", 1);
+    } else {
+        if (!opkg_config->offline_root)
+            *err = -1;
+    }
+}
+
+enum configure_job_state {
+    JOB_WAITING,
+    JOB_RUNNING,
+    JOB_DONE
+};
+
+struct configure_job {
+    pkg_t *pkg;
+    enum configure_job_state state;
+    int ran;                    /* the postinst was started */
+    int result;
+    pid_t pid;
+    FILE *out;
+    unsigned int *deps;
+    unsigned int n_deps;
+};
+
+static int job_ready(struct configure_job *jobs, unsigned int i)
+{
+    unsigned int j;
+
+    for (j = 0; j < jobs[i].n_deps; j++)
+        if (jobs[jobs[i].deps[j]].state != JOB_DONE)
+            return 0;
+    return 1;
+}
+
+static void job_start(struct configure_job *job)
+{
+    char *cmd;
+    int fd = -1;
+
+    job->result = pkg_script_cmd_alloc(job->pkg, "postinst", "configure",
+                                       &cmd);
+    if (job->result || !cmd) {
+        job->state = JOB_DONE;
+        return;
+    }
+
+    /* The output is shown once this package's turn comes, so that it
+     * doesn't get mixed up with that of the others. */
+    job->out = tmpfile();
+    if (job->out) {
+        fd = fileno(job->out);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    } else {
+        opkg_perror(NOTICE, "Failed to capture the output of %s.postinst",
+                    job->pkg->name);
+    }
+
+    {
+        const char *argv[] = { "sh", "-c", cmd, NULL };
+        job->pid = xsystem_spawn(argv, fd);
+    }
+    free(cmd);
+
+    if (job->pid == -1) {
+        job->result = -1;
+        job->state = JOB_DONE;
+        return;
+    }
+
+    job->ran = 1;
+    job->state = JOB_RUNNING;
+    opkg_profile_count("scripts_run", 1);
+}
+
+static void job_report(struct configure_job *job)
+{
+    char buf[4096];
+    size_t n;
+
+    opkg_msg(NOTICE, "Configuring %s.\n", job->pkg->name);
+
+    if (job->out) {
+        fflush(stdout);
+        rewind(job->out);
+        while ((n = fread(buf, 1, sizeof(buf), job->out)) > 0)
+            fwrite(buf, 1, n, stdout);
+        fflush(stdout);
+        fclose(job->out);
+        job->out = NULL;
+    }
+
+    if (job->result) {
+        if (job->ran)
+            pkg_script_failed(job->pkg, "postinst", job->result);
+        configure_failed(job->pkg, job->result);
+    }
+}
+
+/* Reaps one of the running jobs from first on which has finished, waiting
+ * for one if none has yet, and returns its index. Only the jobs' own
+ * children are waited for, so that any others of a program using libopkg
+ * are left for it to reap. Returns -1 if waiting fails.
+ */
+static int job_wait(struct configure_job *jobs, unsigned int first,
+                    unsigned int n)
+{
+    sigset_t chld, old;
+    unsigned int i;
+    int status, blocked = 0;
+    pid_t pid;
+
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+
+    while (1) {
+        for (i = first; i < n; i++) {
+            if (jobs[i].state != JOB_RUNNING)
+                continue;
+            pid = waitpid(jobs[i].pid, &status, WNOHANG);
+            if (pid == 0 || (pid == -1 && errno == EINTR))
+                continue;
+
+            if (pid == -1) {
+                opkg_perror(ERROR, "%s.postinst: waitpid", jobs[i].pkg->name);
+                jobs[i].result = -1;
+            } else {
+                jobs[i].result = xsystem_status("sh", status);
+            }
+            jobs[i].state = JOB_DONE;
+            if (blocked)
+                sigprocmask(SIG_SETMASK, &old, NULL);
+            return i;
+        }
+
+        /* With SIGCHLD blocked, a job finishing after the scan above leaves
+         * it pending, so look once more before waiting for it. Scripts are
+         * only started while it isn't blocked, so they don't inherit that.
+         */
+        if (!blocked) {
+            sigprocmask(SIG_BLOCK, &chld, &old);
+            blocked = 1;
+        } else if (sigwaitinfo(&chld, NULL) == -1 && errno != EINTR) {
+            opkg_perror(ERROR, "sigwaitinfo");
+            sigprocmask(SIG_SETMASK, &old, NULL);
+            return -1;
+        }
+    }
+}
+
+static int configure_parallel(pkg_vec_t * pkgs, pkg_vec_t ** deps)
+{
+    struct configure_job *jobs;
+    unsigned int i, j, k, next = 0, n_running = 0;
+    unsigned int n = pkgs->len;
+    int r, err = 0;
+
+    jobs = xcalloc(n, sizeof(struct configure_job));
+    for (i = 0; i < n; i++) {
+        jobs[i].pkg = pkgs->pkgs[i];
+        jobs[i].pid = -1;
+        if (!deps[i] || !deps[i]->len)
+            continue;
+
+        /* Only earlier packages are waited for, so there can be no cycle,
+         * and the earliest package not yet done can always be started. */
+        jobs[i].deps = xcalloc(deps[i]->len, sizeof(unsigned int));
+        for (j = 0; j < deps[i]->len; j++)
+            for (k = 0; k < i; k++)
+                if (pkgs->pkgs[k] == deps[i]->pkgs[j]) {
+                    jobs[i].deps[jobs[i].n_deps++] = k;
+                    break;
+                }
+    }
+
+    while (next < n) {
+        for (i = next; i < n && n_running < (unsigned int)opkg_config->configure_jobs; i++) {
+            if (jobs[i].state != JOB_WAITING || !job_ready(jobs, i))
+                continue;
+            job_start(&jobs[i]);
+            if (jobs[i].state == JOB_RUNNING)
+                n_running++;
+            else
+                configure_done(jobs[i].pkg, jobs[i].result, &err);
+        }
+
+        while (next < n && jobs[next].state == JOB_DONE)
+            job_report(&jobs[next++]);
+
+        if (n_running == 0)
+            continue;
+
+        r = job_wait(jobs, next, n);
+        if (r == -1) {
+            /* Nothing more can be learned about the running scripts. */
+            for (i = next; i < n; i++) {
+                if (jobs[i].state == JOB_RUNNING) {
+                    jobs[i].result = -1;
+                    jobs[i].state = JOB_DONE;
+                    configure_done(jobs[i].pkg, jobs[i].result, &err);
+                }
+            }
+            n_running = 0;
+            continue;
+        }
+
+        n_running--;
+        configure_done(jobs[r].pkg, jobs[r].result, &err);
+    }
+
+    for (i = 0; i < n; i++)
+        free(jobs[i].deps);
+    free(jobs);
+    return err;
+}
+
+int opkg_configure_pkgs(pkg_vec_t * pkgs, pkg_vec_t ** deps)
+{
+    unsigned int i;
+    int r, err = 0;
+
+    if (deps && opkg_config->configure_jobs > 1 && !opkg_config->noaction) {
+        opkg_profile_begin("configure");
+        err = configure_parallel(pkgs, deps);
+        opkg_profile_end("configure");
+        return err;
+    }
+
+    for (i = 0; i < pkgs->len; i++) {
+        pkg_t *pkg = pkgs->pkgs[i];
+
+        opkg_msg(NOTICE, "Configuring %s.\n", pkg->name);
+        opkg_profile_begin("configure");
+        r = opkg_configure(pkg);
+        opkg_profile_end("configure");
+        configure_done(pkg, r, &err);
+    }
+
+    return err;
+}
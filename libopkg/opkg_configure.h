@@ -27,6 +27,14 @@ extern "C" {
 
 int opkg_configure(pkg_t * pkg);
 
+/* Configures the unpacked packages in pkgs, in that order, and marks
+ * those which succeed as installed. If deps is given, deps[i] holds the
+ * packages earlier in pkgs which pkgs->pkgs[i] depends on, and up to
+ * configure_jobs postinsts whose dependencies are configured are run at
+ * once. Their output is shown in the order of pkgs either way.
+ */
+int opkg_configure_pkgs(pkg_vec_t * pkgs, pkg_vec_t ** deps);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,483 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_digest_cache.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* A persistent cache of file digests, kept in <cache_dir>/digests.
+ *
+ * Each entry is keyed on the path of a file and records the device, inode,
+ * size, mtime and ctime it had when it was hashed. A file is only read again
+ * once any of these differ, so checking conffiles and cached packages
+ * doesn't cost a full read of each on every run.
+ *
+ * The file has one line per entry:
+ *
+ *   <dev> <ino> <size> <mtime_ns> <ctime_ns> <type>:<hex>[,...] <path>
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <solv/chksum.h>
+#include <solv/knownid.h>
+#include <solv/util.h>
+
+#include "hash_table.h"
+#include "opkg_conf.h"
+#include "opkg_digest_cache.h"
+#include "opkg_message.h"
+#include "opkg_work_pool.h"
+#include "sprintf_alloc.h"
+#ifdef HAVE_SHA256
+#include "sha256.h"
+#endif
+#include "xfuncs.h"
+
+struct digest_entry {
+    unsigned long long dev;
+    unsigned long long ino;
+    unsigned long long size;
+    unsigned long long mtime_ns;
+    unsigned long long ctime_ns;
+    /* Comma separated "<type>:<hex>" digests of the file. */
+    char *digests;
+};
+
+static hash_table_t digest_hash;
+static int loaded;
+static int dirty;
+
+static char *digest_cache_file_name_alloc(void)
+{
+    char *name;
+
+    sprintf_alloc(&name, "%s/digests", opkg_config->cache_dir);
+    return name;
+}
+
+static void entry_set_stat(struct digest_entry *entry, const struct stat *st)
+{
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime_ns = st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+    entry->ctime_ns = st->st_ctim.tv_sec * 1000000000ULL + st->st_ctim.tv_nsec;
+}
+
+static int entry_matches_stat(const struct digest_entry *entry,
+                              const struct stat *st)
+{
+    struct digest_entry cur;
+
+    entry_set_stat(&cur, st);
+    return entry->dev == cur.dev && entry->ino == cur.ino
+            && entry->size == cur.size && entry->mtime_ns == cur.mtime_ns
+            && entry->ctime_ns == cur.ctime_ns;
+}
+
+static void digest_cache_load(void)
+{
+    struct digest_entry *entry;
+    char *name;
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    FILE *fp;
+    char digests[512];
+    int n;
+
+    loaded = 1;
+    hash_table_init("digest-hash", &digest_hash, 256);
+
+    name = digest_cache_file_name_alloc();
+    fp = fopen(name, "r");
+    free(name);
+    if (!fp)
+        return;
+
+    while ((len = getline(&line, &size, fp)) > 0) {
+        if (line[len - 1] != '\n')
+            break;
+        line[len - 1] = '\0';
+
+        entry = xcalloc(1, sizeof(*entry));
+        n = 0;
+        if (sscanf(line, "%llu %llu %llu %llu %llu %511s %n", &entry->dev,
+                   &entry->ino, &entry->size, &entry->mtime_ns,
+                   &entry->ctime_ns, digests, &n) != 6 || n == 0
+                || line[n] == '\0') {
+            free(entry);
+            continue;
+        }
+        entry->digests = xstrdup(digests);
+        hash_table_insert(&digest_hash, line + n, entry);
+    }
+
+    free(line);
+    fclose(fp);
+}
+
+static char *entry_lookup(const struct digest_entry *entry, const char *type)
+{
+    size_t type_len = strlen(type);
+    const char *p = entry->digests;
+    const char *end;
+
+    while (*p) {
+        end = strchr(p, ',');
+        if (!end)
+            end = p + strlen(p);
+        if ((size_t)(end - p) > type_len && strncmp(p, type, type_len) == 0
+                && p[type_len] == ':')
+            return xstrndup(p + type_len + 1, end - p - type_len - 1);
+        p = *end ? end + 1 : end;
+    }
+
+    return NULL;
+}
+
+char *opkg_digest_fd_alloc(int fd, Id type)
+{
+    char buf[64 * 1024];
+    const unsigned char *sum;
+    Chksum *h;
+    ssize_t l;
+    int len;
+    char *hex;
+
+#ifdef HAVE_SHA256
+    /* Our own implementation uses the processor's SHA instructions. */
+    if (type == REPOKEY_TYPE_SHA256) {
+        struct sha256_ctx ctx;
+        unsigned char sha256sum[32];
+
+        sha256_init_ctx(&ctx);
+        while ((l = read(fd, buf, sizeof(buf))) > 0)
+            sha256_process_bytes(buf, l, &ctx);
+        if (l < 0)
+            return NULL;
+        sha256_finish_ctx(&ctx, sha256sum);
+
+        hex = xmalloc(2 * sizeof(sha256sum) + 1);
+        solv_bin2hex(sha256sum, sizeof(sha256sum), hex);
+        return hex;
+    }
+#endif
+
+    h = solv_chksum_create(type);
+    if (!h)
+        return NULL;
+
+    while ((l = read(fd, buf, sizeof(buf))) > 0)
+        solv_chksum_add(h, buf, l);
+    if (l < 0) {
+        solv_chksum_free(h, NULL);
+        return NULL;
+    }
+
+    len = 0;
+    sum = solv_chksum_get(h, &len);
+    hex = xmalloc(2 * len + 1);
+    solv_bin2hex(sum, len, hex);
+    solv_chksum_free(h, NULL);
+
+    return hex;
+}
+
+static char *cache_lookup(const char *file_name, const char *type_str,
+                          const struct stat *st)
+{
+    struct digest_entry *entry;
+
+    if (!loaded)
+        digest_cache_load();
+
+    entry = hash_table_get(&digest_hash, file_name);
+    if (entry && entry_matches_stat(entry, st))
+        return entry_lookup(entry, type_str);
+
+    return NULL;
+}
+
+/* Check whether a digest just read from fd can be cached for the file as
+ * it was when st was taken. It can't if the file changed while it was
+ * read, or so recently that a further change might not move its
+ * timestamps.
+ */
+static int digest_is_stable(int fd, const struct stat *st)
+{
+    struct digest_entry cur;
+    struct stat st_after;
+
+    entry_set_stat(&cur, st);
+    return fstat(fd, &st_after) == 0 && entry_matches_stat(&cur, &st_after)
+            && st->st_ctime < time(NULL) - 1;
+}
+
+static void cache_store(const char *file_name, const char *type_str,
+                        const char *hex, const struct stat *st)
+{
+    struct digest_entry *entry;
+    char *digests;
+
+    if (strchr(file_name, '\n'))
+        return;
+
+    entry = hash_table_get(&digest_hash, file_name);
+    if (entry && entry_matches_stat(entry, st)) {
+        sprintf_alloc(&digests, "%s,%s:%s", entry->digests, type_str, hex);
+        free(entry->digests);
+        entry->digests = digests;
+    } else {
+        if (!entry) {
+            entry = xcalloc(1, sizeof(*entry));
+            hash_table_insert(&digest_hash, file_name, entry);
+        } else {
+            free(entry->digests);
+        }
+        entry_set_stat(entry, st);
+        sprintf_alloc(&entry->digests, "%s:%s", type_str, hex);
+    }
+    dirty = 1;
+}
+
+char *opkg_digest_cache_file_alloc(const char *file_name, Id type)
+{
+    struct stat st;
+    const char *type_str;
+    char *hex;
+    int fd;
+
+    type_str = solv_chksum_type2str(type);
+    if (!type_str) {
+        opkg_msg(ERROR, "%s: unknown checksum type\n", file_name);
+        return NULL;
+    }
+
+    fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+        opkg_perror(ERROR, "Failed to open file %s", file_name);
+        if (fd != -1)
+            close(fd);
+        return NULL;
+    }
+
+    hex = cache_lookup(file_name, type_str, &st);
+    if (hex) {
+        close(fd);
+        return hex;
+    }
+
+    hex = opkg_digest_fd_alloc(fd, type);
+    if (!hex) {
+        opkg_msg(ERROR, "Couldn't compute %s for %s.\n", type_str, file_name);
+        close(fd);
+        return NULL;
+    }
+
+    if (digest_is_stable(fd, &st))
+        cache_store(file_name, type_str, hex, &st);
+    close(fd);
+
+    return hex;
+}
+
+struct digest_job {
+    const char *file_name;
+    struct stat st;
+    char *hex;
+    int stable;
+    int opened;
+    int err;
+};
+
+struct digest_jobs {
+    struct digest_job *jobs;
+    Id type;
+};
+
+/* Workers only hash files; all messages and cache updates are left to the
+ * calling thread.
+ */
+static void digest_job_run(void *arg, unsigned int i)
+{
+    struct digest_jobs *jobs = arg;
+    struct digest_job *job = &jobs->jobs[i];
+    int fd;
+
+    fd = open(job->file_name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &job->st) == -1) {
+        job->err = errno;
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+    job->opened = 1;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    errno = 0;
+    job->hex = opkg_digest_fd_alloc(fd, jobs->type);
+    if (!job->hex)
+        job->err = errno ? errno : EIO;
+    else
+        job->stable = digest_is_stable(fd, &job->st);
+    close(fd);
+}
+
+/* The same as opkg_digest_cache_file_alloc() for each of n files, setting
+ * hexes[i] for file_names[i]. Files which aren't in the cache are hashed in
+ * parallel, by a thread per processor.
+ */
+void opkg_digest_cache_files_alloc(const char **file_names, unsigned int n,
+                                   Id type, char **hexes)
+{
+    struct digest_jobs jobs;
+    struct digest_job *job;
+    const char *type_str;
+    unsigned int i, n_jobs = 0, *job_index;
+    struct stat st;
+
+    type_str = solv_chksum_type2str(type);
+
+    jobs.jobs = xcalloc(n + 1, sizeof(*jobs.jobs));
+    jobs.type = type;
+    job_index = xcalloc(n + 1, sizeof(*job_index));
+
+    for (i = 0; i < n; i++) {
+        hexes[i] = NULL;
+        if (type_str && stat(file_names[i], &st) == 0) {
+            hexes[i] = cache_lookup(file_names[i], type_str, &st);
+            if (hexes[i])
+                continue;
+        }
+        job_index[n_jobs] = i;
+        jobs.jobs[n_jobs++].file_name = file_names[i];
+    }
+
+    if (type_str && opkg_work_pool_size(n_jobs) > 1) {
+#ifdef HAVE_SHA256
+        /* Pick the block function before the workers race to. */
+        sha256_implementation();
+#endif
+        opkg_work_pool_run(n_jobs, digest_job_run, &jobs);
+
+        for (i = 0; i < n_jobs; i++) {
+            job = &jobs.jobs[i];
+            if (job->hex) {
+                if (job->stable)
+                    cache_store(job->file_name, type_str, job->hex, &job->st);
+            } else if (!job->opened) {
+                errno = job->err;
+                opkg_perror(ERROR, "Failed to open file %s", job->file_name);
+            } else {
+                errno = job->err;
+                opkg_perror(ERROR, "Couldn't compute %s for %s", type_str,
+                            job->file_name);
+            }
+            hexes[job_index[i]] = job->hex;
+        }
+    } else {
+        for (i = 0; i < n_jobs; i++)
+            hexes[job_index[i]] = opkg_digest_cache_file_alloc(
+                    jobs.jobs[i].file_name, type);
+    }
+
+    free(job_index);
+    free(jobs.jobs);
+}
+
+static void write_entry(const char *key, void *data, void *user_data)
+{
+    struct digest_entry *entry = data;
+    FILE *fp = user_data;
+    struct stat st;
+
+    /* Forget files which have gone away. */
+    if (stat(key, &st) == -1 || !entry_matches_stat(entry, &st))
+        return;
+
+    fprintf(fp, "%llu %llu %llu %llu %llu %s %s\n", entry->dev, entry->ino,
+            entry->size, entry->mtime_ns, entry->ctime_ns, entry->digests,
+            key);
+}
+
+int opkg_digest_cache_save(void)
+{
+    char *name, *tmp;
+    FILE *fp;
+    int r = 0;
+
+    if (!dirty || opkg_config->noaction || opkg_config->volatile_cache)
+        return 0;
+
+    name = digest_cache_file_name_alloc();
+    /* opkgd may be saving the cache from more than one request at once. */
+    sprintf_alloc(&tmp, "%s-opkg.%d.tmp", name, (int)getpid());
+
+    fp = fopen(tmp, "w");
+    if (!fp) {
+        /* A read-only cache is no reason to fail. */
+        if (errno != EROFS && errno != EACCES)
+            opkg_perror(NOTICE, "Can't write digest cache %s", tmp);
+        r = -1;
+        goto cleanup;
+    }
+
+    hash_table_foreach(&digest_hash, write_entry, fp);
+    if (fclose(fp) == EOF)
+        r = -1;
+    if (r == 0)
+        r = rename(tmp, name);
+    if (r != 0) {
+        opkg_perror(NOTICE, "Couldn't write digest cache %s", name);
+        unlink(tmp);
+    } else {
+        dirty = 0;
+    }
+
+ cleanup:
+    free(tmp);
+    free(name);
+    return r;
+}
+
+static void free_entry(const char *key, void *data, void *user_data)
+{
+    struct digest_entry *entry = data;
+
+    (void)key;
+    (void)user_data;
+
+    free(entry->digests);
+    free(entry);
+}
+
+void opkg_digest_cache_deinit(void)
+{
+    if (!loaded)
+        return;
+
+    opkg_digest_cache_save();
+
+    hash_table_foreach(&digest_hash, free_entry, NULL);
+    hash_table_deinit(&digest_hash);
+    loaded = 0;
+    dirty = 0;
+}
@@ -0,0 +1,38 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_digest_cache.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_DIGEST_CACHE_H
+#define OPKG_DIGEST_CACHE_H
+
+#include <solv/pooltypes.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns the digest of file_name as a newly allocated hex string, where
+ * type is a libsolv checksum type such as REPOKEY_TYPE_MD5.
+ */
+char *opkg_digest_cache_file_alloc(const char *file_name, Id type);
+/* Returns the digest of the rest of fd, bypassing the cache. */
+char *opkg_digest_fd_alloc(int fd, Id type);
+void opkg_digest_cache_files_alloc(const char **file_names, unsigned int n,
+                                   Id type, char **hexes);
+int opkg_digest_cache_save(void);
+void opkg_digest_cache_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_DIGEST_CACHE_H */
@@ -32,6 +32,8 @@ typedef int (*curl_progress_func) (void *data, double t, double d,
 int opkg_download(const char *src, const char *dest_file_name,
                   curl_progress_func cb, void *data);
 char *opkg_download_cache(const char *src, curl_progress_func cb, void *data);
+/* Returns where opkg_download_cache() keeps the file at src. */
+char *get_cache_location(const char *src);
 int opkg_download_pkg(pkg_t * pkg);
 int opkg_download_pkg_to_dir(pkg_t * pkg, const char *dir);
 char *pkg_download_signature(pkg_t * pkg);
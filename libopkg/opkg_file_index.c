@@ -0,0 +1,828 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_file_index.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* An index of the files owned by packages, which 'search' answers from a
+ * read-only mapping instead of reading every package's file list.
+ *
+ * Each dest has an index of its installed files kept next to its status
+ * file, which records the inode, size and mtime of the status file, its
+ * journal and the info dir as they were when it was written, and is rebuilt
+ * from the file lists when any of them has changed. A feed may also have a
+ * Contents file in the lists dir, named after the feed with a ".contents"
+ * suffix, in the Debian format of a path and a comma separated list of
+ * [section/]package per line, which gets an index of its own.
+ *
+ * The paths are sorted, as is a second array of them by basename, so that
+ * a path or a basename, or a glob with a literal prefix of either, is
+ * looked up by bisection and only the paths sharing that prefix are
+ * matched. Like the snapshot, an index is only a cache, so it is in host
+ * byte order and is never flushed to disk.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "opkg_conf.h"
+#include "opkg_file_index.h"
+#include "opkg_message.h"
+#include "opkg_profile.h"
+#include "opkg_solv.h"
+#include "file_util.h"
+#include "pkg.h"
+#include "pkg_dest.h"
+#include "pkg_src.h"
+#include "sprintf_alloc.h"
+#include "str_vec.h"
+#include "xfuncs.h"
+
+#define INDEX_MAGIC "OPKGFIX1"
+#define INDEX_N_SOURCES 3
+
+#define GLOB_CHARS "*?[\\"
+
+struct index_stat {
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+struct index_header {
+    char magic[8];
+    uint32_t n_owners;
+    uint32_t n_paths;
+    uint32_t strings_len;
+    uint32_t reserved;
+    struct index_stat sources[INDEX_N_SOURCES];
+};
+
+/* String fields are offsets of NUL-terminated strings in the string area,
+ * which follows the owners, the paths sorted by path and the indexes of
+ * the paths sorted by basename.
+ */
+struct index_owner {
+    uint32_t name;
+    uint32_t version;
+};
+
+struct index_path {
+    uint32_t path;
+    uint32_t base;
+    uint32_t owner;
+};
+
+struct file_index {
+    char *label;
+    int installed;
+    void *buf;
+    size_t len;
+    int mapped;
+    const struct index_header *hdr;
+    const struct index_owner *owners;
+    const struct index_path *paths;
+    const uint32_t *by_base;
+    const char *strings;
+};
+
+static void fill_stat(const char *path, struct index_stat *ss)
+{
+    struct stat st;
+
+    memset(ss, 0, sizeof(*ss));
+    if (path == NULL || stat(path, &st) == -1)
+        return;
+
+    ss->ino = st.st_ino;
+    ss->size = st.st_size;
+    ss->mtime_sec = st.st_mtim.tv_sec;
+    ss->mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+static void fill_stats(const char **sources, struct index_stat *stats)
+{
+    int i;
+
+    for (i = 0; i < INDEX_N_SOURCES; i++)
+        fill_stat(sources[i], &stats[i]);
+}
+
+/*******************************************************************************
+ * Building
+ */
+
+struct build_path {
+    const char *path;
+    uint32_t owner;
+};
+
+struct builder {
+    str_vec_t names;
+    str_vec_t versions;
+    str_vec_t strs;
+    struct build_path *paths;
+    unsigned int n_paths;
+    unsigned int paths_size;
+};
+
+struct build_base {
+    const char *base;
+    uint32_t path;
+};
+
+static void builder_init(struct builder *b)
+{
+    memset(b, 0, sizeof(*b));
+    str_vec_init(&b->names);
+    str_vec_init(&b->versions);
+    str_vec_init(&b->strs);
+}
+
+static void builder_deinit(struct builder *b)
+{
+    str_vec_deinit(&b->names);
+    str_vec_deinit(&b->versions);
+    str_vec_deinit(&b->strs);
+    free(b->paths);
+}
+
+static uint32_t builder_add_owner(struct builder *b, const char *name,
+                                  const char *version)
+{
+    str_vec_append(&b->names, name);
+    str_vec_append(&b->versions, version ? version : "");
+    return b->names.len - 1;
+}
+
+static void builder_add_path(struct builder *b, const char *path,
+                             size_t len, uint32_t owner)
+{
+    /* Directories may be listed with a trailing slash. */
+    while (len > 1 && path[len - 1] == '/')
+        len--;
+
+    if (b->n_paths == b->paths_size) {
+        b->paths_size = b->paths_size ? b->paths_size * 2 : 1024;
+        b->paths = xrealloc(b->paths, b->paths_size * sizeof(*b->paths));
+    }
+    b->paths[b->n_paths].path = str_vec_append_len(&b->strs, path, len);
+    b->paths[b->n_paths].owner = owner;
+    b->n_paths++;
+}
+
+static int compare_build_paths(const void *a, const void *b)
+{
+    const struct build_path *pa = a;
+    const struct build_path *pb = b;
+    int r;
+
+    r = strcmp(pa->path, pb->path);
+    if (r)
+        return r;
+    return (pa->owner > pb->owner) - (pa->owner < pb->owner);
+}
+
+static int compare_build_bases(const void *a, const void *b)
+{
+    const struct build_base *ba = a;
+    const struct build_base *bb = b;
+    int r;
+
+    r = strcmp(ba->base, bb->base);
+    if (r)
+        return r;
+    return (ba->path > bb->path) - (ba->path < bb->path);
+}
+
+static uint32_t put_str(char *strings, uint32_t * len, const char *s)
+{
+    uint32_t off = *len;
+    size_t n = strlen(s) + 1;
+
+    memcpy(strings + off, s, n);
+    *len += n;
+    return off;
+}
+
+/* Lay out what b holds as an index, in a buffer of *len bytes. */
+static void *builder_finish(struct builder *b, const char **sources,
+                            size_t * len)
+{
+    struct index_header *hdr;
+    struct index_owner *owners;
+    struct index_path *paths;
+    struct build_base *bases;
+    uint32_t *by_base;
+    char *strings;
+    size_t strings_size = 0;
+    uint32_t strings_len = 0;
+    unsigned int i, n_owners = b->names.len;
+    void *buf;
+
+    qsort(b->paths, b->n_paths, sizeof(*b->paths), compare_build_paths);
+
+    for (i = 0; i < n_owners; i++)
+        strings_size += strlen(b->names.strs[i]) + 1
+                + strlen(b->versions.strs[i]) + 1;
+    for (i = 0; i < b->n_paths; i++) {
+        if (i == 0 || strcmp(b->paths[i].path, b->paths[i - 1].path))
+            strings_size += strlen(b->paths[i].path) + 1;
+    }
+
+    *len = sizeof(*hdr) + n_owners * sizeof(*owners)
+            + b->n_paths * (sizeof(*paths) + sizeof(*by_base)) + strings_size;
+    buf = xcalloc(1, *len);
+    hdr = buf;
+    owners = (struct index_owner *)(hdr + 1);
+    paths = (struct index_path *)(owners + n_owners);
+    by_base = (uint32_t *) (paths + b->n_paths);
+    strings = (char *)(by_base + b->n_paths);
+
+    memcpy(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic));
+    hdr->n_owners = n_owners;
+    hdr->n_paths = b->n_paths;
+    hdr->strings_len = strings_size;
+    fill_stats(sources, hdr->sources);
+
+    for (i = 0; i < n_owners; i++) {
+        owners[i].name = put_str(strings, &strings_len, b->names.strs[i]);
+        owners[i].version = put_str(strings, &strings_len,
+                                    b->versions.strs[i]);
+    }
+
+    /* A directory shared by several packages is stored once. */
+    bases = xcalloc(b->n_paths + 1, sizeof(*bases));
+    for (i = 0; i < b->n_paths; i++) {
+        const char *path = b->paths[i].path;
+        const char *base = strrchr(path, '/');
+
+        base = base ? base + 1 : path;
+        if (i == 0 || strcmp(path, b->paths[i - 1].path))
+            paths[i].path = put_str(strings, &strings_len, path);
+        else
+            paths[i].path = paths[i - 1].path;
+        paths[i].base = paths[i].path + (base - path);
+        paths[i].owner = b->paths[i].owner;
+
+        bases[i].base = base;
+        bases[i].path = i;
+    }
+
+    qsort(bases, b->n_paths, sizeof(*bases), compare_build_bases);
+    for (i = 0; i < b->n_paths; i++)
+        by_base[i] = bases[i].path;
+    free(bases);
+
+    return buf;
+}
+
+static const char *strip_offline_root(const char *file_name)
+{
+    size_t len;
+
+    if (opkg_config->offline_root) {
+        len = strlen(opkg_config->offline_root);
+        if (strncmp(file_name, opkg_config->offline_root, len) == 0)
+            file_name += len;
+    }
+    return file_name;
+}
+
+static int build_dest(struct builder *b, void *data)
+{
+    pkg_dest_t *dest = data;
+    str_vec_t *files;
+    const char *file;
+    unsigned int i, iter;
+    uint32_t owner;
+
+    if (!opkg_solv_status_loaded() && opkg_solv_load_status_files())
+        return -1;
+
+    for (i = 0; i < opkg_solv_pkgs->len; i++) {
+        pkg_t *pkg = opkg_solv_pkgs->pkgs[i];
+        int is_installed = pkg->state_status == SS_INSTALLED
+                || pkg->state_status == SS_UNPACKED;
+        if (pkg->dest != dest || !is_installed)
+            continue;
+
+        owner = builder_add_owner(b, pkg->name, pkg->version);
+        files = pkg_get_installed_files(pkg);
+        if (files == NULL)
+            continue;
+
+        iter = 0;
+        while ((file = str_vec_next(files, &iter))) {
+            file = strip_offline_root(file);
+            builder_add_path(b, file, strlen(file), owner);
+        }
+        pkg_free_installed_files(pkg);
+    }
+
+    return 0;
+}
+
+static int build_contents(struct builder *b, void *data)
+{
+    const char *file_name = data;
+    FILE *fp;
+    char *line = NULL, *path, *loc, *end, *name, *save, *abs;
+    size_t line_size = 0;
+    ssize_t len;
+    int slot;
+
+    fp = fopen(file_name, "r");
+    if (fp == NULL) {
+        opkg_perror(ERROR, "Failed to open %s", file_name);
+        return -1;
+    }
+
+    /* The location is the last field, as a path may contain spaces. */
+    while ((len = getline(&line, &line_size, fp)) != -1) {
+        while (len > 0 && strchr(" \t\r\n", line[len - 1]))
+            line[--len] = '\0';
+        loc = line + len;
+        while (loc > line && !strchr(" \t", loc[-1]))
+            loc--;
+        end = loc;
+        while (end > line && strchr(" \t", end[-1]))
+            end--;
+        if (end == line)
+            continue;
+
+        path = line;
+        if (strncmp(path, "./", 2) == 0)
+            path++;
+        /* Older Contents files start with a header line. */
+        if (end - path == 4 && strncmp(path, "FILE", 4) == 0
+                && strcmp(loc, "LOCATION") == 0)
+            continue;
+
+        /* Contents paths are usually relative to the root. */
+        if (*path == '/') {
+            abs = xstrndup(path, end - path);
+        } else {
+            abs = xmalloc(end - path + 2);
+            abs[0] = '/';
+            memcpy(abs + 1, path, end - path);
+            abs[end - path + 1] = '\0';
+        }
+
+        for (name = strtok_r(loc, ",", &save); name;
+                name = strtok_r(NULL, ",", &save)) {
+            if (strrchr(name, '/'))
+                name = strrchr(name, '/') + 1;
+            slot = str_vec_find(&b->names, name);
+            if (slot == -1)
+                slot = builder_add_owner(b, name, NULL);
+            builder_add_path(b, abs, strlen(abs), slot);
+        }
+        free(abs);
+    }
+
+    free(line);
+    fclose(fp);
+    return 0;
+}
+
+/*******************************************************************************
+ * Reading
+ */
+
+static void index_free(struct file_index *idx)
+{
+    if (idx->mapped)
+        munmap(idx->buf, idx->len);
+    else
+        free(idx->buf);
+    free(idx->label);
+    free(idx);
+}
+
+/* Point idx into the len bytes at buf, after checking that they hold an
+ * index. Don't trust any offsets before using them.
+ */
+static int index_attach(struct file_index *idx, void *buf, size_t len)
+{
+    const struct index_header *hdr = buf;
+    unsigned int i;
+
+    idx->buf = buf;
+    idx->len = len;
+
+    if (len < sizeof(*hdr)
+            || memcmp(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic))
+            || len != sizeof(*hdr)
+               + (size_t)hdr->n_owners * sizeof(struct index_owner)
+               + (size_t)hdr->n_paths
+                 * (sizeof(struct index_path) + sizeof(uint32_t))
+               + hdr->strings_len)
+        return -1;
+
+    idx->hdr = hdr;
+    idx->owners = (const struct index_owner *)(hdr + 1);
+    idx->paths = (const struct index_path *)(idx->owners + hdr->n_owners);
+    idx->by_base = (const uint32_t *)(idx->paths + hdr->n_paths);
+    idx->strings = (const char *)(idx->by_base + hdr->n_paths);
+
+    if (hdr->strings_len && idx->strings[hdr->strings_len - 1] != '\0')
+        return -1;
+    for (i = 0; i < hdr->n_owners; i++) {
+        if (idx->owners[i].name >= hdr->strings_len
+                || idx->owners[i].version >= hdr->strings_len)
+            return -1;
+    }
+    for (i = 0; i < hdr->n_paths; i++) {
+        if (idx->paths[i].path >= hdr->strings_len
+                || idx->paths[i].base >= hdr->strings_len
+                || idx->paths[i].owner >= hdr->n_owners
+                || idx->by_base[i] >= hdr->n_paths)
+            return -1;
+    }
+
+    return 0;
+}
+
+static struct file_index *index_open(const char *file_name,
+                                     const char **sources)
+{
+    struct file_index *idx;
+    struct index_stat stats[INDEX_N_SOURCES];
+    struct stat st;
+    void *map;
+    int fd;
+
+    fd = open(file_name, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return NULL;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    idx = xcalloc(1, sizeof(*idx));
+    idx->mapped = 1;
+    if (index_attach(idx, map, st.st_size) < 0)
+        goto invalid;
+
+    fill_stats(sources, stats);
+    if (memcmp(stats, idx->hdr->sources, sizeof(stats)))
+        goto invalid;
+
+    return idx;
+
+ invalid:
+    index_free(idx);
+    return NULL;
+}
+
+static void index_save(const char *file_name, const void *buf, size_t len)
+{
+    char *tmp;
+    FILE *fp;
+    int r = 0;
+
+    if (opkg_config->noaction)
+        return;
+
+    /* Unique to this process, as the index may be saved by concurrent
+     * read-only requests to opkgd. */
+    sprintf_alloc(&tmp, "%s-opkg.%d.tmp", file_name, (int)getpid());
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        /* Not being able to cache is no reason to fail the command. */
+        if (errno != EROFS && errno != EACCES)
+            opkg_perror(NOTICE, "Can't write file index %s", tmp);
+        free(tmp);
+        return;
+    }
+
+    if (fwrite(buf, 1, len, fp) != len)
+        r = -1;
+    if (fclose(fp) == EOF)
+        r = -1;
+    if (r == 0)
+        r = rename(tmp, file_name);
+    if (r != 0) {
+        opkg_perror(NOTICE, "Couldn't write file index %s", file_name);
+        unlink(tmp);
+    }
+    free(tmp);
+}
+
+/* Open the index in file_name, or if it is missing or out of date, build
+ * a fresh one with build and save it there.
+ */
+static struct file_index *index_get(const char *file_name,
+                                    const char **sources,
+                                    int (*build) (struct builder *, void *),
+                                    void *data)
+{
+    struct file_index *idx;
+    struct builder b;
+    void *buf;
+    size_t len;
+
+    idx = index_open(file_name, sources);
+    if (idx)
+        return idx;
+
+    opkg_msg(DEBUG, "Building file index %s.\n", file_name);
+    opkg_profile_count("file_indexes_built", 1);
+
+    builder_init(&b);
+    if (build(&b, data) < 0) {
+        builder_deinit(&b);
+        return NULL;
+    }
+    buf = builder_finish(&b, sources, &len);
+    builder_deinit(&b);
+
+    index_save(file_name, buf, len);
+
+    idx = xcalloc(1, sizeof(*idx));
+    index_attach(idx, buf, len);
+    return idx;
+}
+
+static char *dest_index_name_alloc(pkg_dest_t * dest)
+{
+    char *name;
+
+    sprintf_alloc(&name, "%s.files", dest->status_file_name);
+    return name;
+}
+
+static void dest_sources(pkg_dest_t * dest, const char **sources)
+{
+    sources[0] = dest->status_file_name;
+    sources[1] = dest->journal_file_name;
+    sources[2] = dest->info_dir;
+}
+
+int opkg_file_index_valid(void)
+{
+    pkg_dest_list_elt_t *iter;
+    struct file_index *idx;
+    const char *sources[INDEX_N_SOURCES];
+    char *name;
+
+    list_for_each_entry(iter, &opkg_config->pkg_dest_list.head, node) {
+        pkg_dest_t *dest = (pkg_dest_t *) iter->data;
+
+        dest_sources(dest, sources);
+        name = dest_index_name_alloc(dest);
+        idx = index_open(name, sources);
+        free(name);
+        if (!idx)
+            return 0;
+        index_free(idx);
+    }
+
+    return 1;
+}
+
+/*******************************************************************************
+ * Searching
+ */
+
+struct search_match {
+    const struct file_index *idx;
+    uint32_t owner;
+};
+
+struct search {
+    struct file_index **indexes;
+    unsigned int n_indexes;
+    struct search_match *matches;
+    unsigned int n_matches;
+    unsigned int matches_size;
+};
+
+static void search_add_index(struct search *s, struct file_index *idx)
+{
+    s->indexes = xrealloc(s->indexes,
+                          (s->n_indexes + 1) * sizeof(*s->indexes));
+    s->indexes[s->n_indexes++] = idx;
+}
+
+static void search_add_match(struct search *s, const struct file_index *idx,
+                             uint32_t owner)
+{
+    if (s->n_matches == s->matches_size) {
+        s->matches_size = s->matches_size ? s->matches_size * 2 : 64;
+        s->matches = xrealloc(s->matches,
+                              s->matches_size * sizeof(*s->matches));
+    }
+    s->matches[s->n_matches].idx = idx;
+    s->matches[s->n_matches].owner = owner;
+    s->n_matches++;
+}
+
+static const char *index_key(const struct file_index *idx, uint32_t i,
+                             int by_base)
+{
+    if (by_base)
+        return idx->strings + idx->paths[idx->by_base[i]].base;
+    return idx->strings + idx->paths[i].path;
+}
+
+/* Return the first path, or basename, which doesn't sort before prefix. */
+static uint32_t index_lower_bound(const struct file_index *idx,
+                                  const char *prefix, size_t len, int by_base)
+{
+    uint32_t lo = 0, hi = idx->hdr->n_paths, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strncmp(index_key(idx, mid, by_base), prefix, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void index_search(const struct file_index *idx, const char *pattern,
+                         struct search *s)
+{
+    size_t prefix_len = strcspn(pattern, GLOB_CHARS);
+    int literal = pattern[prefix_len] == '\0';
+    int by_base = strchr(pattern, '/') == NULL;
+    const char *key;
+    uint32_t i, path;
+
+    /* Without a literal prefix, every path has to be matched, against the
+     * whole path as well as its basename.
+     */
+    if (prefix_len == 0) {
+        for (i = 0; i < idx->hdr->n_paths; i++) {
+            const struct index_path *p = &idx->paths[i];
+            if (fnmatch(pattern, idx->strings + p->path, 0) == 0
+                    || (by_base
+                        && fnmatch(pattern, idx->strings + p->base, 0) == 0))
+                search_add_match(s, idx, p->owner);
+        }
+        return;
+    }
+
+    /* Every path is absolute, so a relative one can only be a basename. */
+    if (!by_base && pattern[0] != '/')
+        return;
+
+    for (i = index_lower_bound(idx, pattern, prefix_len, by_base);
+            i < idx->hdr->n_paths; i++) {
+        key = index_key(idx, i, by_base);
+        if (strncmp(key, pattern, prefix_len) != 0)
+            break;
+        if (literal ? strcmp(key, pattern) != 0 : fnmatch(pattern, key, 0) != 0)
+            continue;
+        path = by_base ? idx->by_base[i] : i;
+        search_add_match(s, idx, idx->paths[path].owner);
+    }
+}
+
+static const char *owner_str(const struct search_match *m, int version)
+{
+    const struct index_owner *o = &m->idx->owners[m->owner];
+
+    return m->idx->strings + (version ? o->version : o->name);
+}
+
+static int compare_matches(const void *a, const void *b)
+{
+    const struct search_match *ma = a;
+    const struct search_match *mb = b;
+    int r;
+
+    r = strcmp(owner_str(ma, 0), owner_str(mb, 0));
+    if (r)
+        return r;
+    /* Installed packages first, so that feeds can be left out for them. */
+    if (ma->idx->installed != mb->idx->installed)
+        return mb->idx->installed - ma->idx->installed;
+    return strcmp(owner_str(ma, 1), owner_str(mb, 1));
+}
+
+static void search_print(struct search *s)
+{
+    const struct search_match *m, *prev = NULL;
+    unsigned int i;
+
+    qsort(s->matches, s->n_matches, sizeof(*s->matches), compare_matches);
+
+    for (i = 0; i < s->n_matches; i++, prev = m) {
+        m = &s->matches[i];
+        if (prev && compare_matches(prev, m) == 0)
+            continue;
+        if (prev && !m->idx->installed && prev->idx->installed
+                && strcmp(owner_str(prev, 0), owner_str(m, 0)) == 0) {
+            m = prev;
+            continue;
+        }
+
+        if (m->idx->installed)
+            printf("%s - %s\n", owner_str(m, 0), owner_str(m, 1));
+        else
+            printf("%s - available in %s\n", owner_str(m, 0), m->idx->label);
+    }
+}
+
+static void search_free(struct search *s)
+{
+    unsigned int i;
+
+    for (i = 0; i < s->n_indexes; i++)
+        index_free(s->indexes[i]);
+    free(s->indexes);
+    free(s->matches);
+}
+
+int opkg_file_index_search(int argc, const char **patterns)
+{
+    pkg_dest_list_elt_t *iter;
+    pkg_src_list_elt_t *src_iter;
+    struct search s;
+    struct file_index *idx;
+    const char *sources[INDEX_N_SOURCES];
+    char *name, *contents;
+    unsigned int i;
+    int j, err = 0;
+
+    memset(&s, 0, sizeof(s));
+
+    list_for_each_entry(iter, &opkg_config->pkg_dest_list.head, node) {
+        pkg_dest_t *dest = (pkg_dest_t *) iter->data;
+
+        dest_sources(dest, sources);
+        name = dest_index_name_alloc(dest);
+        idx = index_get(name, sources, build_dest, dest);
+        free(name);
+        if (!idx) {
+            err = -1;
+            goto out;
+        }
+        idx->label = xstrdup(dest->name);
+        idx->installed = 1;
+        search_add_index(&s, idx);
+    }
+
+    for (src_iter = void_list_first(&opkg_config->pkg_src_list); src_iter;
+            src_iter = void_list_next(&opkg_config->pkg_src_list, src_iter)) {
+        pkg_src_t *src = (pkg_src_t *) src_iter->data;
+
+        sprintf_alloc(&contents, "%s/%s.contents", opkg_config->lists_dir,
+                      src->name);
+        if (!file_exists(contents)) {
+            free(contents);
+            continue;
+        }
+
+        sources[0] = contents;
+        sources[1] = sources[2] = NULL;
+        sprintf_alloc(&name, "%s.index", contents);
+        idx = index_get(name, sources, build_contents, contents);
+        free(name);
+        free(contents);
+        if (!idx) {
+            err = -1;
+            goto out;
+        }
+        idx->label = xstrdup(src->name);
+        search_add_index(&s, idx);
+    }
+
+    for (i = 0; i < s.n_indexes; i++) {
+        for (j = 0; j < argc; j++)
+            index_search(s.indexes[i], patterns[j], &s);
+    }
+    search_print(&s);
+
+ out:
+    search_free(&s);
+    return err;
+}
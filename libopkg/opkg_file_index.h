@@ -0,0 +1,35 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_file_index.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_FILE_INDEX_H
+#define OPKG_FILE_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Check that every dest has an up to date index of its installed files. */
+int opkg_file_index_valid(void);
+
+/* Prints the packages owning a file which matches any of patterns, from
+ * the installed files of every dest and from the Contents of any feed
+ * which has them. Out of date indexes are rebuilt, loading the status
+ * files if they haven't been.
+ */
+int opkg_file_index_search(int argc, const char **patterns);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_FILE_INDEX_H */
@@ -0,0 +1,218 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_fsync.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash_table.h"
+#include "opkg_conf.h"
+#include "opkg_fsync.h"
+#include "opkg_message.h"
+#include "xfuncs.h"
+
+/* Database files (status, .list) which are flushed individually, along with
+ * the directories containing them.
+ */
+static hash_table_t synced_files;
+
+/* Directories which received extracted data or maintainer scripts. There are
+ * too many individual files to flush one at a time, so instead each
+ * filesystem these directories live on is flushed once.
+ */
+static hash_table_t synced_dirs;
+
+static int tracking;
+
+static void fsync_tracking_init(void)
+{
+    if (tracking)
+        return;
+
+    hash_table_init("fsync-files", &synced_files, 64);
+    hash_table_init("fsync-dirs", &synced_dirs, 256);
+    tracking = 1;
+}
+
+/* Record a file which opkg has written and which must be durable once the
+ * transaction is committed.
+ */
+void opkg_fsync_track_file(const char *path)
+{
+    fsync_tracking_init();
+    hash_table_insert(&synced_files, path, NULL);
+}
+
+/* Record a directory which opkg has written files into. */
+void opkg_fsync_track_dir(const char *path)
+{
+    fsync_tracking_init();
+    hash_table_insert(&synced_dirs, path, NULL);
+}
+
+static int flush_fd(int fd)
+{
+#ifdef HAVE_FDATASYNC
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+static int flush_path(const char *path, int flags)
+{
+    int fd, r;
+
+    fd = open(path, flags | O_CLOEXEC);
+    if (fd == -1) {
+        /* Removed since it was written, nothing left to flush. */
+        if (errno == ENOENT)
+            return 0;
+        opkg_perror(ERROR, "Failed to open %s for syncing", path);
+        return -1;
+    }
+
+    r = flush_fd(fd);
+    if (r == -1 && errno != EINVAL && errno != EROFS)
+        opkg_perror(ERROR, "Failed to sync %s", path);
+    else
+        r = 0;
+
+    close(fd);
+    return r;
+}
+
+/* Flush a single open file straight away, unless durability is disabled.
+ * Used where a file must reach the disk before it is renamed into place.
+ */
+int opkg_fsync_fd(int fd)
+{
+    if (strcmp(opkg_config->durability, OPKG_DURABILITY_NONE) == 0)
+        return 0;
+
+    if (flush_fd(fd) == -1 && errno != EINVAL && errno != EROFS)
+        return -1;
+
+    return 0;
+}
+
+struct fs_sync_state {
+    /* Device numbers of filesystems already flushed. */
+    dev_t *devs;
+    unsigned int n_devs;
+    int err;
+};
+
+static void sync_dir_filesystem(const char *key, void *entry, void *data)
+{
+    struct fs_sync_state *state = (struct fs_sync_state *)data;
+    struct stat st;
+    unsigned int i;
+    int fd;
+
+    (void)entry;
+
+    fd = open(key, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return;
+    }
+
+    for (i = 0; i < state->n_devs; i++) {
+        if (state->devs[i] == st.st_dev) {
+            close(fd);
+            return;
+        }
+    }
+
+    state->devs = xrealloc(state->devs, (state->n_devs + 1) * sizeof(dev_t));
+    state->devs[state->n_devs++] = st.st_dev;
+
+    opkg_msg(DEBUG, "Syncing filesystem containing %s.\n", key);
+#ifdef HAVE_SYNCFS
+    if (syncfs(fd) == -1) {
+        opkg_perror(ERROR, "Failed to sync filesystem containing %s", key);
+        state->err = -1;
+    }
+#else
+    /* Without syncfs() the best we can do is flush everything, once. */
+    if (state->n_devs == 1)
+        sync();
+#endif
+    close(fd);
+}
+
+static void sync_file(const char *key, void *entry, void *data)
+{
+    struct fs_sync_state *state = (struct fs_sync_state *)data;
+    char *dir;
+
+    (void)entry;
+
+    if (flush_path(key, O_RDONLY) < 0)
+        state->err = -1;
+
+    /* Make sure the directory entry is durable too, in case the file was
+     * newly created.
+     */
+    dir = xdirname(key);
+    if (flush_path(dir, O_RDONLY | O_DIRECTORY) < 0)
+        state->err = -1;
+    free(dir);
+}
+
+/* Make everything tracked since the last commit durable, according to the
+ * 'durability' config option, then forget it.
+ *
+ * Returns 0 on success or -1 if anything failed to flush.
+ */
+int opkg_fsync_commit(void)
+{
+    struct fs_sync_state state;
+    const char *durability = opkg_config->durability;
+
+    memset(&state, 0, sizeof(state));
+
+    if (strcmp(durability, OPKG_DURABILITY_FULL) == 0) {
+        sync();
+    } else if (strcmp(durability, OPKG_DURABILITY_TARGETED) == 0) {
+        if (tracking) {
+            /* Data before the database which describes it. */
+            hash_table_foreach(&synced_dirs, sync_dir_filesystem, &state);
+            hash_table_foreach(&synced_files, sync_file, &state);
+        }
+    } else if (strcmp(durability, OPKG_DURABILITY_NONE) != 0) {
+        opkg_msg(ERROR, "durability option '%s' not understood.\n",
+                 durability);
+        state.err = -1;
+    }
+
+    free(state.devs);
+
+    if (tracking) {
+        hash_table_deinit(&synced_files);
+        hash_table_deinit(&synced_dirs);
+        tracking = 0;
+    }
+
+    return state.err;
+}
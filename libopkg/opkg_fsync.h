@@ -0,0 +1,35 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_fsync.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_FSYNC_H
+#define OPKG_FSYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Values for the 'durability' config option. */
+#define OPKG_DURABILITY_NONE     "none"
+#define OPKG_DURABILITY_TARGETED "targeted"
+#define OPKG_DURABILITY_FULL     "full"
+
+void opkg_fsync_track_file(const char *path);
+void opkg_fsync_track_dir(const char *path);
+int opkg_fsync_fd(int fd);
+int opkg_fsync_commit(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_FSYNC_H */
@@ -35,6 +35,8 @@
 #include "opkg_download.h"
 #include "opkg_remove.h"
 #include "opkg_verify.h"
+#include "opkg_fsync.h"
+#include "opkg_trigger.h"
 
 #include "opkg_utils.h"
 #include "opkg_message.h"
@@ -89,7 +91,7 @@ static int satisfy_dependencies_for(pkg_t * pkg)
             /* The package was uninstalled when we started, but another
              * dep earlier in this loop may have depended on it and pulled
              * it in, so check first. */
-            if (is_pkg_in_pkg_vec(dep->wanted_by, pkg)) {
+            if (is_pkg_in_pkg_vec(&dep->wanted_by, pkg)) {
                 opkg_msg(NOTICE, "Breaking circular dependency on %s for %s.\n",
                          pkg->name, dep->name);
                 continue;
@@ -98,8 +100,8 @@ static int satisfy_dependencies_for(pkg_t * pkg)
                     && (dep->state_status != SS_UNPACKED);
             if (needs_install) {
                 opkg_msg(DEBUG2, "Calling opkg_install_pkg.\n");
-                if (!is_pkg_in_pkg_vec(dep->wanted_by, pkg))
-                    pkg_vec_insert(dep->wanted_by, pkg);
+                if (!is_pkg_in_pkg_vec(&dep->wanted_by, pkg))
+                    pkg_vec_insert(&dep->wanted_by, pkg);
                 err = opkg_install_pkg(dep, 0);
                 /* mark this package as having been automatically installed to
                  * satisfy a dependency */
@@ -129,8 +131,8 @@ static int satisfy_dependencies_for(pkg_t * pkg)
         /* The package was uninstalled when we started, but another
          * dep earlier in this loop may have depended on it and pulled
          * it in, so check first. */
-        if (!is_pkg_in_pkg_vec(dep->wanted_by, pkg))
-            pkg_vec_insert(dep->wanted_by, pkg);
+        if (!is_pkg_in_pkg_vec(&dep->wanted_by, pkg))
+            pkg_vec_insert(&dep->wanted_by, pkg);
         int needs_install = (dep->state_status != SS_INSTALLED)
                 && (dep->state_status != SS_UNPACKED);
         if (needs_install) {
@@ -177,16 +179,16 @@ static int check_conflicts_for(pkg_t * pkg)
 
 static int update_file_ownership(pkg_t * new_pkg, pkg_t * old_pkg)
 {
-    str_list_t *new_list, *old_list;
-    str_list_elt_t *iter, *niter;
+    str_vec_t *new_list, *old_list;
+    const char *new_file, *old_file;
+    unsigned int iter;
 
     new_list = pkg_get_installed_files(new_pkg);
     if (new_list == NULL)
         return -1;
 
-    for (iter = str_list_first(new_list), niter = str_list_next(new_list, iter);
-            iter; iter = niter, niter = str_list_next(new_list, niter)) {
-        char *new_file = (char *)iter->data;
+    iter = 0;
+    while ((new_file = str_vec_next(new_list, &iter))) {
         pkg_t *owner = file_hash_get_file_owner(new_file);
         pkg_t *obs = hash_table_get(&opkg_config->obs_file_hash, new_file);
 
@@ -205,9 +207,8 @@ static int update_file_ownership(pkg_t * new_pkg, pkg_t * old_pkg)
             return -1;
         }
 
-        for (iter = str_list_first(old_list), niter = str_list_next(old_list, iter);
-                iter; iter = niter, niter = str_list_next(old_list, niter)) {
-            char *old_file = (char *)iter->data;
+        iter = 0;
+        while ((old_file = str_vec_next(old_list, &iter))) {
             pkg_t *owner = file_hash_get_file_owner(old_file);
             if (!owner || (owner == old_pkg)) {
                 /* obsolete */
@@ -814,22 +815,27 @@ static int check_data_file_clashes(pkg_t * pkg, pkg_t * old_pkg)
      * packages involved in the clash has the potential to break the
      * other package.
      */
-    str_list_t *files_list;
-    str_list_elt_t *iter, *niter;
-    char *filename;
+    str_vec_t *files_list;
+    unsigned int iter = 0;
+    const char *filename;
+    file_probe_t probe;
+    struct stat st;
     int clashes = 0;
+    int preexisting = 0;
 
     files_list = pkg_get_installed_files(pkg);
     if (files_list == NULL)
         return -1;
 
-    for (iter = str_list_first(files_list), niter = str_list_next(files_list, iter);
-            iter; iter = niter, niter = str_list_next(files_list, iter)) {
-        filename = (char *)iter->data;
-        if (file_exists(filename) && (!file_is_dir(filename))) {
+    file_probe_init(&probe);
+    while ((filename = str_vec_next(files_list, &iter))) {
+        if (file_probe_stat(&probe, filename, &st) == 0
+                && !S_ISDIR(st.st_mode)) {
             pkg_t *owner;
             pkg_t *obs;
 
+            preexisting++;
+
             if (backup_exists_for(filename)) {
                 continue;
             }
@@ -898,8 +904,12 @@ static int check_data_file_clashes(pkg_t * pkg, pkg_t * old_pkg)
             clashes++;
         }
     }
+    file_probe_deinit(&probe);
     pkg_free_installed_files(pkg);
 
+    /* Let install_data_files() know whether it is extracting over anything. */
+    pkg->data_files_fresh = (preexisting == 0);
+
     return clashes;
 }
 
@@ -917,24 +927,23 @@ static int check_data_file_clashes_change(pkg_t * pkg, pkg_t * old_pkg)
      *
      * @@@ To change after 1.0 release.
      */
-    str_list_t *files_list;
-    str_list_elt_t *iter, *niter;
-
-    char *root_filename = NULL;
+    str_vec_t *files_list;
+    unsigned int iter = 0;
+    const char *filename;
+    file_probe_t probe;
+    struct stat st;
 
     files_list = pkg_get_installed_files(pkg);
     if (files_list == NULL)
         return -1;
 
-    for (iter = str_list_first(files_list), niter = str_list_next(files_list, iter);
-            iter; iter = niter, niter = str_list_next(files_list, niter)) {
-        char *filename = (char *)iter->data;
-        if (root_filename) {
-            free(root_filename);
-            root_filename = NULL;
-        }
-        root_filename = root_filename_alloc(filename);
-        if (file_exists(root_filename) && (!file_is_dir(root_filename))) {
+    /* Installed file names already include the dest root (and so any
+     * offline_root), so they can be probed as they are.
+     */
+    file_probe_init(&probe);
+    while ((filename = str_vec_next(files_list, &iter))) {
+        if (file_probe_stat(&probe, filename, &st) == 0
+                && !S_ISDIR(st.st_mode)) {
             pkg_t *owner;
 
             owner = file_hash_get_file_owner(filename);
@@ -961,9 +970,7 @@ static int check_data_file_clashes_change(pkg_t * pkg, pkg_t * old_pkg)
             }
         }
     }
-    if (root_filename) {
-        free(root_filename);
-    }
+    file_probe_deinit(&probe);
     pkg_free_installed_files(pkg);
 
     return 0;
@@ -1012,11 +1019,10 @@ static int postrm_upgrade_old_pkg_unwind(pkg_t * pkg, pkg_t * old_pkg)
 static int remove_obsolesced_files(pkg_t * pkg, pkg_t * old_pkg)
 {
     int err = 0;
-    str_list_t *old_files;
-    str_list_elt_t *of;
-    str_list_t *new_files;
-    str_list_elt_t *nf;
-    hash_table_t new_files_table;
+    str_vec_t *old_files;
+    str_vec_t *new_files;
+    unsigned int iter = 0;
+    const char *old;
 
     old_files = pkg_get_installed_files(old_pkg);
     if (old_files == NULL)
@@ -1028,19 +1034,11 @@ static int remove_obsolesced_files(pkg_t * pkg, pkg_t * old_pkg)
         return -1;
     }
 
-    new_files_table.entries = NULL;
-    hash_table_init("new_files", &new_files_table, 20);
-    for (nf = str_list_first(new_files); nf; nf = str_list_next(new_files, nf)) {
-        if (nf && nf->data)
-            hash_table_insert(&new_files_table, nf->data, nf->data);
-    }
-
-    for (of = str_list_first(old_files); of; of = str_list_next(old_files, of)) {
+    /* Lookups in new_files go through its hash index. */
+    while ((old = str_vec_next(old_files, &iter))) {
         pkg_t *owner;
-        char *old, *new;
-        old = (char *)of->data;
-        new = (char *)hash_table_get(&new_files_table, old);
-        if (new)
+
+        if (str_vec_contains(new_files, old))
             continue;
 
         if (file_is_dir(old)) {
@@ -1062,7 +1060,6 @@ static int remove_obsolesced_files(pkg_t * pkg, pkg_t * old_pkg)
         }
     }
 
-    hash_table_deinit(&new_files_table);
     pkg_free_installed_files(old_pkg);
     pkg_free_installed_files(pkg);
 
@@ -1078,6 +1075,7 @@ static int install_maintainer_scripts(pkg_t * pkg)
     ret = pkg_extract_control_files_to_dir_with_prefix(pkg, pkg->dest->info_dir,
                                                        prefix);
     free(prefix);
+    opkg_fsync_track_dir(pkg->dest->info_dir);
     return ret;
 }
 
@@ -1101,6 +1099,35 @@ static int remove_disappeared(pkg_t * pkg)
     return 0;
 }
 
+/* Note the files pkg now owns for triggers and their directories for the
+ * durability barrier. Called once pkg is unpacked, so that its file list
+ * is read back from the .list just written rather than from the archive.
+ * Installed file names already include the dest root.
+ */
+static void track_data_files(pkg_t * pkg)
+{
+    str_vec_t *files_list;
+    unsigned int iter = 0;
+    const char *filename;
+    char *dir;
+
+    files_list = pkg_get_installed_files(pkg);
+    if (files_list == NULL)
+        return;
+
+    while ((filename = str_vec_next(files_list, &iter))) {
+        if (file_hash_get_file_owner(filename) != pkg)
+            continue;
+
+        opkg_trigger_note_file(filename);
+
+        dir = xdirname(filename);
+        opkg_fsync_track_dir(dir);
+        free(dir);
+    }
+    pkg_free_installed_files(pkg);
+}
+
 static int install_data_files(pkg_t * pkg)
 {
     int err;
@@ -1116,6 +1143,8 @@ static int install_data_files(pkg_t * pkg)
         return err;
     }
 
+    opkg_trigger_note_activates(pkg);
+
     /* The "Essential" control field may only be present in the control
      * file and not in the Packages list. Ensure we capture it regardless.
      *
@@ -1403,13 +1432,19 @@ int opkg_install_pkg(pkg_t *old_pkg, pkg_t * pkg)
     resolve_conffiles(pkg);
 
     pkg->state_status = SS_UNPACKED;
+    track_data_files(pkg);
     old_state_flag = pkg->state_flag;
     pkg->state_flag &= ~SF_PREFER;
     opkg_msg(DEBUG, "pkg=%s old_state_flag=%x state_flag=%x\n", pkg->name,
              old_state_flag, pkg->state_flag);
 
-    if (old_pkg)
+    /* The old version's record has to be journaled too, otherwise it is
+     * still installed as far as the status snapshot is concerned.
+     */
+    if (old_pkg) {
         old_pkg->state_status = SS_NOT_INSTALLED;
+        pkg_write_status(old_pkg);
+    }
 
     time(&pkg->installed_time);
 
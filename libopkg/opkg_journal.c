@@ -0,0 +1,308 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_journal.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* Status changes made while a transaction runs are appended to a journal
+ * next to the status file rather than to the status file itself, which
+ * stays a plain snapshot that other tools can read.
+ *
+ * The journal starts with a header naming the inode of the snapshot it
+ * applies to, followed by records of the form:
+ *
+ *   @<seq> <len> <md5sum>\n
+ *   <len bytes of status paragraph>
+ *
+ * Sequence numbers start at 1 and increase by one per record. Replay stops
+ * at the first record which is short, out of sequence or fails its
+ * checksum; that is the tail of a write interrupted by a crash, and it is
+ * cut off by the next append.
+ *
+ * Compaction writes a fresh snapshot to a temporary file, renames it over
+ * the status file and then removes the journal. Should we crash between the
+ * two, the new snapshot has a different inode to the one named in the
+ * journal header so the stale journal is ignored on the next load.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "md5.h"
+#include "opkg_conf.h"
+#include "opkg_fsync.h"
+#include "opkg_journal.h"
+#include "opkg_message.h"
+#include "sprintf_alloc.h"
+#include "file_util.h"
+#include "xfuncs.h"
+
+#define JOURNAL_MAGIC "OPKG-JOURNAL 1"
+
+static void md5sum_hex(const char *buf, size_t len, char *hex)
+{
+    static const char bin2hex[16] = {
+        '0', '1', '2', '3', '4', '5', '6', '7',
+        '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+    };
+    unsigned char bin[16];
+    unsigned int i;
+
+    md5_buffer(buf, len, bin);
+    for (i = 0; i < sizeof(bin); i++) {
+        hex[i * 2] = bin2hex[bin[i] >> 4];
+        hex[i * 2 + 1] = bin2hex[bin[i] & 0xf];
+    }
+    hex[i * 2] = '\0';
+}
+
+/* Inode of the current status snapshot, or 0 if there isn't one yet. */
+static unsigned long snapshot_ino(pkg_dest_t * dest)
+{
+    struct stat st;
+
+    if (stat(dest->status_file_name, &st) == -1)
+        return 0;
+
+    return (unsigned long)st.st_ino;
+}
+
+/* Read the journal for dest, checking each record as we go. If records is
+ * non-NULL, the concatenated status paragraphs of all good records are
+ * returned through it for the caller to parse and free.
+ *
+ * Returns 0 on success, even if the journal is missing, stale or has a torn
+ * tail, or -1 if it could not be read at all.
+ */
+int opkg_journal_load(pkg_dest_t * dest, char **records, size_t * len)
+{
+    FILE *fp;
+    struct stat st;
+    char *line;
+    char *buf = NULL;
+    char md5[33], expected[33];
+    unsigned long ino, seq;
+    size_t rec_len, total = 0;
+    off_t remaining;
+    int torn = 0;
+
+    if (records) {
+        *records = NULL;
+        *len = 0;
+    }
+    dest->journal_seq = 0;
+    dest->journal_size = 0;
+
+    fp = fopen(dest->journal_file_name, "r");
+    if (fp == NULL) {
+        if (errno == ENOENT)
+            return 0;
+        opkg_perror(ERROR, "Failed to open %s", dest->journal_file_name);
+        return -1;
+    }
+
+    if (fstat(fileno(fp), &st) == -1) {
+        opkg_perror(ERROR, "Failed to stat %s", dest->journal_file_name);
+        fclose(fp);
+        return -1;
+    }
+
+    line = file_read_line_alloc(fp);
+    if (!line || sscanf(line, JOURNAL_MAGIC " %lu", &ino) != 1
+            || ino != snapshot_ino(dest)) {
+        opkg_msg(NOTICE, "Ignoring stale status journal %s.\n",
+                 dest->journal_file_name);
+        /* Force a compaction so that it gets cleared away. */
+        dest->changed = 1;
+        free(line);
+        fclose(fp);
+        return 0;
+    }
+    free(line);
+    dest->journal_size = ftell(fp);
+
+    while ((line = file_read_line_alloc(fp)) != NULL) {
+        int r = sscanf(line, "@%lu %zu %32s", &seq, &rec_len, expected);
+        free(line);
+        torn = 1;
+        if (r != 3 || seq != dest->journal_seq + 1)
+            break;
+
+        /* A length running past the end of the file is a corrupt header,
+         * don't go allocating it.
+         */
+        remaining = st.st_size - ftell(fp);
+        if (remaining < 0 || rec_len > (size_t)remaining)
+            break;
+
+        buf = xrealloc(buf, total + rec_len + 1);
+        if (fread(buf + total, 1, rec_len, fp) != rec_len)
+            break;
+
+        md5sum_hex(buf + total, rec_len, md5);
+        if (strcmp(md5, expected) != 0)
+            break;
+
+        torn = 0;
+        total += rec_len;
+        dest->journal_seq = seq;
+        dest->journal_size = ftell(fp);
+    }
+
+    if (torn)
+        opkg_msg(NOTICE,
+                 "Discarding incomplete record after entry %lu of %s.\n",
+                 dest->journal_seq, dest->journal_file_name);
+    fclose(fp);
+
+    opkg_msg(DEBUG, "Replaying %lu records from %s.\n", dest->journal_seq,
+             dest->journal_file_name);
+
+    if (records && total) {
+        buf[total] = '\0';
+        *records = buf;
+        *len = total;
+    } else {
+        free(buf);
+    }
+
+    return 0;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+    ssize_t r;
+
+    while (len) {
+        r = write(fd, buf, len);
+        if (r == -1) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        buf += r;
+        len -= r;
+    }
+
+    return 0;
+}
+
+/* Append a status paragraph, as written by pkg_print_status(), to the
+ * journal of dest.
+ */
+int opkg_journal_append_record(pkg_dest_t * dest, const char *record,
+                               size_t record_len)
+{
+    char *entry;
+    char md5[33];
+    int fd, r;
+
+    if (dest->journal_size < 0) {
+        r = opkg_journal_load(dest, NULL, NULL);
+        if (r < 0)
+            return -1;
+    }
+
+    md5sum_hex(record, record_len, md5);
+
+    fd = open(dest->journal_file_name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        opkg_perror(ERROR, "Can't open status journal %s",
+                    dest->journal_file_name);
+        return -1;
+    }
+
+    if (dest->journal_size == 0) {
+        /* New journal, or a stale one which we start over. */
+        sprintf_alloc(&entry, JOURNAL_MAGIC " %lu\n@1 %zu %s\n",
+                      snapshot_ino(dest), record_len, md5);
+        dest->journal_seq = 0;
+    } else {
+        sprintf_alloc(&entry, "@%lu %zu %s\n", dest->journal_seq + 1,
+                      record_len, md5);
+    }
+
+    /* Cut off anything past the last good record before appending. */
+    r = ftruncate(fd, dest->journal_size);
+    if (r == 0)
+        r = (lseek(fd, dest->journal_size, SEEK_SET) == -1) ? -1 : 0;
+    if (r == 0) {
+        size_t entry_len = strlen(entry);
+
+        entry = xrealloc(entry, entry_len + record_len + 1);
+        memcpy(entry + entry_len, record, record_len);
+        entry[entry_len + record_len] = '\0';
+        r = write_all(fd, entry, entry_len + record_len);
+    }
+
+    if (r == -1) {
+        opkg_perror(ERROR, "Failed to append to status journal %s",
+                    dest->journal_file_name);
+    } else {
+        dest->journal_seq++;
+        dest->journal_size += strlen(entry);
+        opkg_fsync_track_file(dest->journal_file_name);
+    }
+
+    close(fd);
+    free(entry);
+    return r;
+}
+
+/* Append the current status of pkg to its dest's journal. */
+int opkg_journal_append(pkg_t * pkg)
+{
+    FILE *stream;
+    char *record = NULL;
+    size_t record_len = 0;
+    int r;
+
+    stream = open_memstream(&record, &record_len);
+    if (stream == NULL) {
+        opkg_perror(ERROR, "Failed to allocate status record");
+        return -1;
+    }
+    pkg_print_status(pkg, stream);
+    fclose(stream);
+
+    r = opkg_journal_append_record(pkg->dest, record, record_len);
+    free(record);
+    return r;
+}
+
+int opkg_journal_needs_compaction(pkg_dest_t * dest)
+{
+    return dest->journal_size > opkg_config->status_journal_max;
+}
+
+/* Remove the journal once its records are part of a new snapshot. */
+int opkg_journal_reset(pkg_dest_t * dest)
+{
+    int r;
+
+    r = unlink(dest->journal_file_name);
+    if (r == -1 && errno != ENOENT) {
+        opkg_perror(ERROR, "Couldn't remove status journal %s",
+                    dest->journal_file_name);
+        return -1;
+    }
+
+    dest->journal_seq = 0;
+    dest->journal_size = 0;
+    return 0;
+}
@@ -0,0 +1,37 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_journal.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_JOURNAL_H
+#define OPKG_JOURNAL_H
+
+#include <stddef.h>
+
+#include "pkg.h"
+#include "pkg_dest.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int opkg_journal_load(pkg_dest_t * dest, char **records, size_t * len);
+int opkg_journal_append(pkg_t * pkg);
+int opkg_journal_append_record(pkg_dest_t * dest, const char *record,
+                               size_t record_len);
+int opkg_journal_needs_compaction(pkg_dest_t * dest);
+int opkg_journal_reset(pkg_dest_t * dest);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_JOURNAL_H */
@@ -59,6 +59,7 @@ void free_error_list(void)
         err = err->next;
         free(err_tmp);
     }
+    error_list_head = error_list_tail = NULL;
 }
 
 void print_error_list(void)
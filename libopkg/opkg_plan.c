@@ -0,0 +1,447 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_plan.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* Transaction plans.
+ *
+ * "opkg --plan-out=<file> upgrade" solves the upgrade as usual, but writes
+ * the ordered steps of the transaction to <file> instead of committing
+ * them. "opkg apply-plan <file>" then commits the same steps on any system
+ * with the same packages installed, without loading the feeds or running
+ * the solver. The file is made of lines of:
+ *
+ *     Format: 1
+ *     Fingerprint: <sha256 of the installed packages>
+ *     install <new> user|auto
+ *     upgrade <old> <new>
+ *     remove <old>
+ *
+ * where <old> is the name, version and architecture of an installed
+ * package, and <new> is the same followed by the URL of the package to
+ * install and its "<type>:<hex>" checksum, or "-" if the feed gave none.
+ */
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <solv/chksum.h>
+#include <solv/pool.h>
+#include <solv/repo.h>
+#include <solv/repo_deb.h>
+#include <solv/transaction.h>
+#include <solv/util.h>
+
+#include "opkg_conf.h"
+#include "opkg_digest_cache.h"
+#include "opkg_download.h"
+#include "opkg_message.h"
+#include "opkg_plan.h"
+#include "opkg_solv.h"
+#include "file_util.h"
+#include "hash_table.h"
+#include "pkg.h"
+#include "sprintf_alloc.h"
+#include "xfuncs.h"
+
+#define PLAN_FORMAT "1"
+#define PLAN_MAX_FIELDS 9
+
+extern Pool *opkg_solv_pool;
+
+struct plan_action {
+    Id type;
+    const char *name;
+    int has_old;
+    int has_new;
+};
+
+static const struct plan_action plan_actions[] = {
+    {SOLVER_TRANSACTION_INSTALL, "install", 0, 1},
+    {SOLVER_TRANSACTION_MULTIINSTALL, "multiinstall", 0, 1},
+    {SOLVER_TRANSACTION_UPGRADED, "upgrade", 1, 1},
+    {SOLVER_TRANSACTION_DOWNGRADED, "downgrade", 1, 1},
+    {SOLVER_TRANSACTION_REINSTALLED, "reinstall", 1, 1},
+    {SOLVER_TRANSACTION_CHANGED, "change", 1, 1},
+    {SOLVER_TRANSACTION_ERASE, "remove", 1, 0},
+};
+
+static const struct plan_action *action_by_type(Id type)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(plan_actions); i++)
+        if (plan_actions[i].type == type)
+            return &plan_actions[i];
+    return NULL;
+}
+
+static const struct plan_action *action_by_name(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE(plan_actions); i++)
+        if (strcmp(plan_actions[i].name, name) == 0)
+            return &plan_actions[i];
+    return NULL;
+}
+
+static char *solvable_key_alloc(Solvable * s)
+{
+    char *key;
+
+    sprintf_alloc(&key, "%s %s %s", pool_id2str(opkg_solv_pool, s->name),
+                  pool_id2str(opkg_solv_pool, s->evr),
+                  pool_id2str(opkg_solv_pool, s->arch));
+    return key;
+}
+
+static int strcmp_p(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Hashes the sorted name, version and architecture of every installed
+ * package. If index isn't NULL, each of them is also added to it.
+ */
+static char *fingerprint_alloc(hash_table_t * index)
+{
+    Repo *repo = opkg_solv_pool->installed;
+    Solvable *s;
+    Id p;
+    char **keys = NULL;
+    unsigned int i, n = 0;
+    Chksum *h;
+    const unsigned char *sum;
+    int len;
+    char *hex;
+
+    if (repo) {
+        FOR_REPO_SOLVABLES(repo, p, s)
+            n++;
+        keys = xcalloc(n ? n : 1, sizeof(char *));
+        i = 0;
+        FOR_REPO_SOLVABLES(repo, p, s) {
+            keys[i] = solvable_key_alloc(s);
+            if (index)
+                hash_table_insert(index, keys[i], (void *)(uintptr_t)p);
+            i++;
+        }
+        qsort(keys, n, sizeof(char *), strcmp_p);
+    }
+
+    h = solv_chksum_create(REPOKEY_TYPE_SHA256);
+    for (i = 0; i < n; i++) {
+        /* The terminating NUL keeps "a b" "c" apart from "a" "b c". */
+        solv_chksum_add(h, keys[i], strlen(keys[i]) + 1);
+        free(keys[i]);
+    }
+    free(keys);
+
+    len = 0;
+    sum = solv_chksum_get(h, &len);
+    hex = xmalloc(2 * len + 1);
+    solv_bin2hex(sum, len, hex);
+    solv_chksum_free(h, NULL);
+
+    return hex;
+}
+
+static void write_old(FILE * fp, Id p)
+{
+    Solvable *s = pool_id2solvable(opkg_solv_pool, p);
+    char *key = solvable_key_alloc(s);
+
+    fprintf(fp, " %s", key);
+    free(key);
+}
+
+static void write_new(FILE * fp, Id p)
+{
+    Solvable *s = pool_id2solvable(opkg_solv_pool, p);
+    const char *url, *chksum;
+    Id type = 0;
+
+    write_old(fp, p);
+
+    url = solvable_lookup_location(s, NULL);
+    fprintf(fp, " %s", url ? url : "-");
+
+    chksum = solvable_lookup_checksum(s, SOLVABLE_CHECKSUM, &type);
+    if (chksum)
+        fprintf(fp, " %s:%s", solv_chksum_type2str(type), chksum);
+    else
+        fprintf(fp, " -");
+}
+
+int opkg_plan_write(const char *file_name, Queue * steps)
+{
+    const struct plan_action *action;
+    FILE *fp;
+    char *fingerprint;
+    pkg_t *pkg;
+    int i;
+
+    fp = fopen(file_name, "w");
+    if (!fp) {
+        opkg_perror(ERROR, "Failed to open %s", file_name);
+        return -1;
+    }
+
+    fingerprint = fingerprint_alloc(NULL);
+    fprintf(fp, "Format: %s\n", PLAN_FORMAT);
+    fprintf(fp, "Fingerprint: %s\n", fingerprint);
+    free(fingerprint);
+
+    for (i = 0; i + 2 < steps->count; i += 3) {
+        action = action_by_type(steps->elements[i]);
+        if (!action)
+            continue;
+
+        fputs(action->name, fp);
+        if (action->has_old) {
+            write_old(fp, steps->elements[i + 1]);
+            if (action->has_new)
+                write_new(fp, steps->elements[i + 2]);
+        } else {
+            write_new(fp, steps->elements[i + 1]);
+            pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, steps->elements[i + 1]);
+            fprintf(fp, " %s", pkg && pkg->auto_installed == 0 ? "user" : "auto");
+        }
+        fputc('\n', fp);
+    }
+
+    if (fclose(fp) != 0) {
+        opkg_perror(ERROR, "Failed to write %s", file_name);
+        return -1;
+    }
+
+    opkg_msg(NOTICE, "Wrote the transaction plan to %s.\n", file_name);
+    return 0;
+}
+
+static int digest_matches(const char *file_name, Id type, const char *hex)
+{
+    char *digest;
+    int r;
+
+    if (!type)
+        return 1;
+
+    digest = opkg_digest_cache_file_alloc(file_name, type);
+    r = digest && strcmp(digest, hex) == 0;
+    free(digest);
+    return r;
+}
+
+/* Fetches the package described by f, which is its name, version,
+ * architecture, URL and checksum, and adds it to repo.
+ */
+static Id add_new(Repo * repo, char **f)
+{
+    char *cache, *hex;
+    Solvable *s;
+    Id type = 0, p;
+    int ok;
+
+    hex = strchr(f[4], ':');
+    if (hex) {
+        *hex++ = '\0';
+        type = solv_chksum_str2type(f[4]);
+        if (!type) {
+            opkg_msg(ERROR, "Unknown checksum type %s for %s.\n", f[4], f[0]);
+            return 0;
+        }
+    }
+
+    cache = get_cache_location(f[3]);
+    if (!file_exists(cache) || !digest_matches(cache, type, hex)) {
+        opkg_msg(NOTICE, "Downloading %s (%s) ...\n", f[0], f[1]);
+        free(cache);
+        cache = opkg_download_cache(f[3], NULL, NULL);
+        if (!cache) {
+            opkg_msg(ERROR, "Failed to download %s.\n", f[3]);
+            return 0;
+        }
+        if (!digest_matches(cache, type, hex)) {
+            opkg_msg(ERROR, "%s does not match the checksum in the plan.\n",
+                     f[3]);
+            unlink(cache);
+            free(cache);
+            return 0;
+        }
+    }
+
+    p = repo_add_deb(repo, cache, REPO_REUSE_REPODATA | REPO_NO_INTERNALIZE);
+    if (!p) {
+        opkg_msg(ERROR, "Failed to open package %s.\n", cache);
+        free(cache);
+        return 0;
+    }
+    free(cache);
+
+    s = pool_id2solvable(opkg_solv_pool, p);
+    ok = strcmp(pool_id2str(opkg_solv_pool, s->name), f[0]) == 0
+            && strcmp(pool_id2str(opkg_solv_pool, s->evr), f[1]) == 0
+            && strcmp(pool_id2str(opkg_solv_pool, s->arch), f[2]) == 0;
+    if (!ok) {
+        opkg_msg(ERROR, "%s is not %s %s %s.\n", f[3], f[0], f[1], f[2]);
+        return 0;
+    }
+
+    return p;
+}
+
+static Id find_old(hash_table_t * index, char **f)
+{
+    char *key;
+    Id p;
+
+    sprintf_alloc(&key, "%s %s %s", f[0], f[1], f[2]);
+    p = (Id) (uintptr_t) hash_table_get(index, key);
+    if (!p)
+        opkg_msg(ERROR, "%s (%s) is not installed.\n", f[0], f[1]);
+    free(key);
+    return p;
+}
+
+int opkg_plan_read(const char *file_name, Queue * steps)
+{
+    const struct plan_action *action;
+    hash_table_t index;
+    Repo *repo = NULL;
+    Queue added;
+    FILE *fp;
+    char *line = NULL, *tok, *save, *fingerprint;
+    char *f[PLAN_MAX_FIELDS];
+    size_t line_size = 0;
+    int i, n, line_no = 0, checked = 0, err = 0;
+    Id old, new;
+    pkg_t *pkg;
+
+    fp = fopen(file_name, "r");
+    if (!fp) {
+        opkg_perror(ERROR, "Failed to open %s", file_name);
+        return -1;
+    }
+
+    memset(&index, 0, sizeof(index));
+    hash_table_init("plan-installed", &index, 1024);
+    fingerprint = fingerprint_alloc(&index);
+    queue_init(&added);
+
+    while (getline(&line, &line_size, fp) != -1) {
+        line_no++;
+        n = 0;
+        for (tok = strtok_r(line, " \t\r\n", &save); tok;
+                tok = strtok_r(NULL, " \t\r\n", &save)) {
+            if (n < PLAN_MAX_FIELDS)
+                f[n] = tok;
+            n++;
+        }
+        if (n == 0 || f[0][0] == '#')
+            continue;
+
+        if (strcmp(f[0], "Format:") == 0) {
+            if (n != 2 || strcmp(f[1], PLAN_FORMAT) != 0) {
+                opkg_msg(ERROR, "%s: unsupported plan format.\n", file_name);
+                err = -1;
+                break;
+            }
+            continue;
+        }
+
+        if (strcmp(f[0], "Fingerprint:") == 0) {
+            if (n != 2 || strcmp(f[1], fingerprint) != 0) {
+                opkg_msg(ERROR, "The installed packages are not the ones "
+                         "%s was made for.\n", file_name);
+                err = -1;
+                break;
+            }
+            checked = 1;
+            continue;
+        }
+
+        action = action_by_name(f[0]);
+        if (!action || n != 1 + 3 * action->has_old + 5 * action->has_new
+                + !action->has_old) {
+            opkg_msg(ERROR, "%s:%d: malformed step.\n", file_name, line_no);
+            err = -1;
+            break;
+        }
+        if (!checked) {
+            opkg_msg(ERROR, "%s has no fingerprint.\n", file_name);
+            err = -1;
+            break;
+        }
+
+        old = new = 0;
+        if (action->has_old) {
+            old = find_old(&index, f + 1);
+            if (!old) {
+                err = -1;
+                break;
+            }
+        }
+        if (action->has_new) {
+            if (!repo)
+                repo = repo_create(opkg_solv_pool, "@plan");
+            new = add_new(repo, f + 1 + 3 * action->has_old);
+            if (!new) {
+                err = -1;
+                break;
+            }
+            queue_push2(&added, new, !action->has_old
+                        && strcmp(f[n - 1], "user") == 0);
+        }
+
+        queue_push(steps, action->type);
+        if (action->has_old)
+            queue_push2(steps, old, new);
+        else
+            queue_push2(steps, new, 0);
+    }
+
+    if (!err && !checked) {
+        opkg_msg(ERROR, "%s has no fingerprint.\n", file_name);
+        err = -1;
+    }
+
+    if (repo)
+        repo_internalize(repo);
+
+    for (i = 0; !err && i < added.count; i += 2) {
+        Solvable *s = pool_id2solvable(opkg_solv_pool, added.elements[i]);
+
+        pkg = pkg_new(s);
+        pkg_vec_insert(opkg_solv_pkgs, pkg);
+        pkg->dest = opkg_config->default_dest;
+        pkg->state_status = SS_NOT_INSTALLED;
+        pkg->provided_by_hand = 1;
+        pkg->local_filename = xstrdup(solvable_lookup_location(s, NULL));
+        if (added.elements[i + 1])
+            pkg->auto_installed = 0;
+    }
+
+    queue_free(&added);
+    free(fingerprint);
+    hash_table_deinit(&index);
+    free(line);
+    fclose(fp);
+
+    return err;
+}
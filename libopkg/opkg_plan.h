@@ -0,0 +1,44 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_plan.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_PLAN_H
+#define OPKG_PLAN_H
+
+#include <solv/queue.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Both take the steps of a transaction as (type, p, obs) triples in the
+ * order they are committed, where type is a SOLVER_TRANSACTION_* value and
+ * obs is the package replacing p in an upgrade, or 0.
+ */
+
+/* Writes steps to file_name, along with a fingerprint of the installed
+ * packages they apply to.
+ */
+int opkg_plan_write(const char *file_name, Queue * steps);
+
+/* Reads the steps of the plan in file_name, once the installed packages
+ * have been loaded. Fails unless those are the ones the plan was made for.
+ * The packages the plan installs are downloaded and checked against the
+ * plan, and added to the pool as if they were given on the command line.
+ */
+int opkg_plan_read(const char *file_name, Queue * steps);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_PLAN_H */
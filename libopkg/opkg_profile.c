@@ -0,0 +1,318 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_profile.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* Timings and counters for the phases of a run, written as JSON to the
+ * file given with --profile.
+ *
+ * For each phase this records the number of times it was entered and the
+ * totals of wall and CPU time spent in it, including that spent by scripts
+ * it ran, and, from /proc/self/io where there is one, the bytes and
+ * syscalls of opkg's own reads and writes. The peak RSS of the process at
+ * the end of the phase is recorded too, along with the stats of the
+ * configuration's hash tables and, at the end of the run, the memory held
+ * in the arena which packages are allocated from and by interned strings.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "hash_table.h"
+#include "opkg_conf.h"
+#include "opkg_message.h"
+#include "opkg_profile.h"
+#include "opkg_solv.h"
+#include "pkg.h"
+#include "str_intern.h"
+#include "xfuncs.h"
+
+#define PROFILE_MAX_DEPTH 32
+
+struct profile_sample {
+    double wall_ms;
+    double cpu_ms;
+    double child_cpu_ms;
+    unsigned long long read_bytes;
+    unsigned long long write_bytes;
+    unsigned long long read_syscalls;
+    unsigned long long write_syscalls;
+};
+
+struct profile_phase {
+    char *name;
+    unsigned long calls;
+    struct profile_sample total;
+    long max_rss_kb;
+};
+
+struct profile_counter {
+    char *name;
+    unsigned long value;
+};
+
+static struct profile_phase *phases;
+static unsigned int n_phases;
+static struct profile_counter *counters;
+static unsigned int n_counters;
+
+/* Phases are referred to by index, as the array may move. */
+static struct {
+    unsigned int phase;
+    struct profile_sample start;
+} stack[PROFILE_MAX_DEPTH];
+static int depth;
+
+static double timeval_ms(const struct timeval *tv)
+{
+    return tv->tv_sec * 1000.0 + tv->tv_usec / 1000.0;
+}
+
+static void read_proc_io(struct profile_sample *s)
+{
+    char key[32];
+    unsigned long long value;
+    FILE *fp;
+
+    fp = fopen("/proc/self/io", "r");
+    if (!fp)
+        return;
+
+    while (fscanf(fp, "%31[^:]: %llu\n", key, &value) == 2) {
+        if (strcmp(key, "rchar") == 0)
+            s->read_bytes = value;
+        else if (strcmp(key, "wchar") == 0)
+            s->write_bytes = value;
+        else if (strcmp(key, "syscr") == 0)
+            s->read_syscalls = value;
+        else if (strcmp(key, "syscw") == 0)
+            s->write_syscalls = value;
+    }
+    fclose(fp);
+}
+
+static long take_sample(struct profile_sample *s)
+{
+    struct timespec ts;
+    struct rusage ru, ru_children;
+
+    memset(s, 0, sizeof(*s));
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    s->wall_ms = ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+
+    getrusage(RUSAGE_SELF, &ru);
+    getrusage(RUSAGE_CHILDREN, &ru_children);
+    s->cpu_ms = timeval_ms(&ru.ru_utime) + timeval_ms(&ru.ru_stime);
+    s->child_cpu_ms = timeval_ms(&ru_children.ru_utime)
+            + timeval_ms(&ru_children.ru_stime);
+
+    read_proc_io(s);
+
+    return ru.ru_maxrss;
+}
+
+static unsigned int find_phase(const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < n_phases; i++) {
+        if (strcmp(phases[i].name, name) == 0)
+            return i;
+    }
+
+    phases = xrealloc(phases, (n_phases + 1) * sizeof(*phases));
+    memset(&phases[n_phases], 0, sizeof(*phases));
+    phases[n_phases].name = xstrdup(name);
+    return n_phases++;
+}
+
+void opkg_profile_begin(const char *phase)
+{
+    if (!opkg_config->profile_file)
+        return;
+
+    if (depth == PROFILE_MAX_DEPTH) {
+        opkg_msg(DEBUG, "Profile phases nested too deeply at %s.\n", phase);
+        return;
+    }
+
+    stack[depth].phase = find_phase(phase);
+    take_sample(&stack[depth].start);
+    depth++;
+}
+
+void opkg_profile_end(const char *phase)
+{
+    struct profile_sample end, *start;
+    struct profile_phase *p;
+    long max_rss_kb;
+
+    if (!opkg_config->profile_file || depth == 0)
+        return;
+
+    p = &phases[stack[depth - 1].phase];
+    if (strcmp(p->name, phase) != 0) {
+        opkg_msg(DEBUG, "Profile phase %s ended inside %s.\n", phase, p->name);
+        return;
+    }
+
+    max_rss_kb = take_sample(&end);
+    depth--;
+    start = &stack[depth].start;
+
+    p->calls++;
+    p->total.wall_ms += end.wall_ms - start->wall_ms;
+    p->total.cpu_ms += end.cpu_ms - start->cpu_ms;
+    p->total.child_cpu_ms += end.child_cpu_ms - start->child_cpu_ms;
+    p->total.read_bytes += end.read_bytes - start->read_bytes;
+    p->total.write_bytes += end.write_bytes - start->write_bytes;
+    p->total.read_syscalls += end.read_syscalls - start->read_syscalls;
+    p->total.write_syscalls += end.write_syscalls - start->write_syscalls;
+    if (max_rss_kb > p->max_rss_kb)
+        p->max_rss_kb = max_rss_kb;
+}
+
+void opkg_profile_count(const char *counter, unsigned long n)
+{
+    unsigned int i;
+
+    if (!opkg_config->profile_file)
+        return;
+
+    for (i = 0; i < n_counters; i++) {
+        if (strcmp(counters[i].name, counter) == 0) {
+            counters[i].value += n;
+            return;
+        }
+    }
+
+    counters = xrealloc(counters, (n_counters + 1) * sizeof(*counters));
+    counters[n_counters].name = xstrdup(counter);
+    counters[n_counters].value = n;
+    n_counters++;
+}
+
+static void write_hash_stats(FILE * fp, const hash_table_t * hash,
+                             int *first)
+{
+    /* Skip tables which were never set up. */
+    if (!hash->n_buckets)
+        return;
+
+    fprintf(fp, "%s\n    {\"name\": \"%s\", \"buckets\": %u, "
+            "\"elements\": %u, \"used_buckets\": %u, \"collisions\": %u, "
+            "\"max_bucket_len\": %u, \"hits\": %u, \"misses\": %u}",
+            *first ? "" : ",", hash->name, hash->n_buckets, hash->n_elements,
+            hash->n_used_buckets, hash->n_collisions, hash->max_bucket_len,
+            hash->n_hits, hash->n_misses);
+    *first = 0;
+}
+
+static void profile_free(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < n_phases; i++)
+        free(phases[i].name);
+    free(phases);
+    phases = NULL;
+    n_phases = 0;
+
+    for (i = 0; i < n_counters; i++)
+        free(counters[i].name);
+    free(counters);
+    counters = NULL;
+    n_counters = 0;
+
+    depth = 0;
+}
+
+/* Write the profile of the run so far, and forget it. */
+int opkg_profile_write(const char *command, int status)
+{
+    struct profile_phase *p;
+    struct rusage ru;
+    unsigned int i;
+    FILE *fp;
+    int first = 1;
+    int r = 0;
+    unsigned int n_strings;
+    size_t n_string_bytes;
+    unsigned long n_lookups;
+
+    if (!opkg_config->profile_file)
+        return 0;
+
+    fp = fopen(opkg_config->profile_file, "w");
+    if (!fp) {
+        opkg_perror(ERROR, "Can't open profile file %s",
+                    opkg_config->profile_file);
+        profile_free();
+        return -1;
+    }
+
+    getrusage(RUSAGE_SELF, &ru);
+
+    fprintf(fp, "{\n  \"version\": \"%s\",\n  \"command\": \"%s\",\n"
+            "  \"status\": %d,\n  \"max_rss_kb\": %ld,\n  \"phases\": [\n",
+            VERSION, command, status, ru.ru_maxrss);
+    for (i = 0; i < n_phases; i++) {
+        p = &phases[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"calls\": %lu, "
+                "\"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"child_cpu_ms\": %.3f, "
+                "\"read_bytes\": %llu, \"write_bytes\": %llu, "
+                "\"read_syscalls\": %llu, \"write_syscalls\": %llu, "
+                "\"max_rss_kb\": %ld}%s\n",
+                p->name, p->calls, p->total.wall_ms, p->total.cpu_ms,
+                p->total.child_cpu_ms, p->total.read_bytes,
+                p->total.write_bytes, p->total.read_syscalls,
+                p->total.write_syscalls, p->max_rss_kb,
+                i + 1 < n_phases ? "," : "");
+    }
+
+    fprintf(fp, "  ],\n  \"counters\": {");
+    for (i = 0; i < n_counters; i++)
+        fprintf(fp, "%s\n    \"%s\": %lu", i ? "," : "", counters[i].name,
+                counters[i].value);
+    fprintf(fp, "%s},\n  \"hash_tables\": [", n_counters ? "\n  " : "");
+    write_hash_stats(fp, &opkg_config->pkg_hash, &first);
+    write_hash_stats(fp, &opkg_config->file_hash, &first);
+    write_hash_stats(fp, &opkg_config->obs_file_hash, &first);
+    fprintf(fp, "\n  ],\n");
+
+    str_intern_stats(&n_strings, &n_string_bytes, &n_lookups);
+    /* Packages are allocated from the arena, along with the other data
+     * kept for the whole run. */
+    fprintf(fp, "  \"memory\": {\"packages\": %u, \"arena_bytes\": %lu, "
+            "\"arena_chunk_bytes\": %lu, "
+            "\"interned_strings\": %u, \"interned_bytes\": %lu, "
+            "\"intern_lookups\": %lu}\n}\n",
+            opkg_solv_pkgs ? opkg_solv_pkgs->len : 0,
+            (unsigned long)opkg_config->arena.n_bytes,
+            (unsigned long)opkg_config->arena.n_chunk_bytes, n_strings,
+            (unsigned long)n_string_bytes, n_lookups);
+
+    if (fclose(fp) == EOF) {
+        opkg_perror(ERROR, "Couldn't write profile file %s",
+                    opkg_config->profile_file);
+        r = -1;
+    }
+
+    profile_free();
+    return r;
+}
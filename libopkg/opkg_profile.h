@@ -0,0 +1,34 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_profile.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_PROFILE_H
+#define OPKG_PROFILE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Phases may nest, and a phase entered many times, such as "unpack", is
+ * reported once with its totals. All of these do nothing unless a profile
+ * file was asked for.
+ */
+void opkg_profile_begin(const char *phase);
+void opkg_profile_end(const char *phase);
+void opkg_profile_count(const char *counter, unsigned long n);
+int opkg_profile_write(const char *command, int status);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_PROFILE_H */
@@ -30,6 +30,8 @@
 #include "sprintf_alloc.h"
 #include "xfuncs.h"
 #include "pkg_hash.h"
+#include "opkg_fsync.h"
+#include "opkg_trigger.h"
 
 #if 0
 /*
@@ -215,10 +217,10 @@ int opkg_remove_pkg(pkg_t * pkg)
 
 void remove_data_files_and_list(pkg_t * pkg)
 {
-    str_list_t installed_dirs;
-    str_list_t *installed_files;
-    str_list_elt_t *iter;
-    char *file_name;
+    str_vec_t installed_dirs;
+    str_vec_t *installed_files;
+    unsigned int iter;
+    const char *file_name;
     conffile_t *conffile;
     int removed_a_dir;
     pkg_t *owner;
@@ -233,23 +235,25 @@ void remove_data_files_and_list(pkg_t * pkg)
         return;
     }
 
-    str_list_init(&installed_dirs);
+    str_vec_init(&installed_dirs);
+    opkg_trigger_note_activates(pkg);
+
+    /* Removals only touch the dest's own filesystem in the common case. */
+    opkg_fsync_track_dir(pkg->dest->root_dir);
 
     /* don't include trailing slash */
     if (opkg_config->offline_root)
         rootdirlen = strlen(opkg_config->offline_root);
 
-    for (iter = str_list_first(installed_files); iter;
-            iter = str_list_next(installed_files, iter)) {
-        file_name = (char *)iter->data;
-
+    iter = 0;
+    while ((file_name = str_vec_next(installed_files, &iter))) {
         owner = file_hash_get_file_owner(file_name);
         if (owner != pkg)
             /* File may have been claimed by another package. */
             continue;
 
         if (!file_is_symlink(file_name) && file_is_dir(file_name)) {
-            str_list_append(&installed_dirs, file_name);
+            str_vec_append(&installed_dirs, file_name);
             continue;
         }
 
@@ -268,6 +272,7 @@ void remove_data_files_and_list(pkg_t * pkg)
         } else
             opkg_msg(INFO, "Not deleting %s. (noaction)\n", file_name);
 
+        opkg_trigger_note_file(file_name);
         file_hash_remove(file_name);
     }
 
@@ -275,15 +280,14 @@ void remove_data_files_and_list(pkg_t * pkg)
     if (!opkg_config->noaction) {
         do {
             removed_a_dir = 0;
-            for (iter = str_list_first(&installed_dirs); iter;
-                    iter = str_list_next(&installed_dirs, iter)) {
-                file_name = (char *)iter->data;
-
+            iter = 0;
+            while ((file_name = str_vec_next(&installed_dirs, &iter))) {
                 r = rmdir(file_name);
                 if (r == 0) {
                     opkg_msg(INFO, "Deleting %s.\n", file_name);
                     removed_a_dir = 1;
-                    str_list_remove(&installed_dirs, &iter);
+                    /* iter has already moved past this one. */
+                    str_vec_remove_at(&installed_dirs, iter - 1);
                 }
             }
         } while (removed_a_dir);
@@ -293,25 +297,15 @@ void remove_data_files_and_list(pkg_t * pkg)
     pkg_remove_installed_files_list(pkg);
 
     /* Don't print warning for dirs that are provided by other packages */
-    for (iter = str_list_first(&installed_dirs); iter;
-            iter = str_list_next(&installed_dirs, iter)) {
-        file_name = (char *)iter->data;
-
+    iter = 0;
+    while ((file_name = str_vec_next(&installed_dirs, &iter))) {
         owner = file_hash_get_file_owner(file_name);
-        if (owner) {
-            free(iter->data);
-            iter->data = NULL;
-            str_list_remove(&installed_dirs, &iter);
-        }
+        if (owner)
+            str_vec_remove_at(&installed_dirs, iter - 1);
     }
 
     /* cleanup */
-    while (!void_list_empty(&installed_dirs)) {
-        iter = str_list_pop(&installed_dirs);
-        free(iter->data);
-        free(iter);
-    }
-    str_list_deinit(&installed_dirs);
+    str_vec_deinit(&installed_dirs);
 }
 
 void remove_maintainer_scripts(pkg_t * pkg)
@@ -0,0 +1,735 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_snapshot.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* A binary snapshot of the installed packages of each dest, kept next to
+ * its status file. It holds everything list-installed, status and flag need,
+ * so those commands can be answered from a read-only mapping instead of
+ * parsing the status file and journal through libsolv.
+ *
+ * The snapshot records the inode, size and mtime of the status file and its
+ * journal as they were when it was written. If either has changed since,
+ * the snapshot is ignored and the commands fall back to the status file,
+ * writing a fresh snapshot afterwards. The snapshot is only a cache, so it
+ * is in host byte order and is never flushed to disk.
+ *
+ * Each record keeps the text of the status paragraph and of the 'status'
+ * output with the Status line cut out. That line is rebuilt from the state
+ * fields, which lets 'flag' update a record in place.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <solv/pool.h>
+#include <solv/evr.h>
+
+#include "opkg_conf.h"
+#include "opkg_fsync.h"
+#include "opkg_journal.h"
+#include "opkg_message.h"
+#include "opkg_snapshot.h"
+#include "opkg_solv.h"
+#include "pkg.h"
+#include "pkg_dest.h"
+#include "pkg_vec.h"
+#include "sprintf_alloc.h"
+#include "xfuncs.h"
+
+extern Pool *opkg_solv_pool;
+
+#define SNAPSHOT_MAGIC "OPKGSNP1"
+
+struct snapshot_stat {
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+struct snapshot_header {
+    char magic[8];
+    uint32_t n_records;
+    uint32_t strings_len;
+    struct snapshot_stat status;
+    struct snapshot_stat journal;
+};
+
+/* String fields are offsets of NUL-terminated strings in the string area
+ * following the records.
+ */
+struct snapshot_record {
+    uint32_t name;
+    uint32_t version;
+    uint32_t architecture;
+    uint32_t description;
+    uint32_t conffiles;
+    uint32_t status_head;
+    uint32_t status_tail;
+    uint32_t info_head;
+    uint32_t info_tail;
+    uint32_t state_want;
+    uint32_t state_flag;
+    uint32_t state_status;
+    int32_t auto_installed;
+};
+
+#define RECORD_N_STRINGS 9
+
+struct snapshot {
+    pkg_dest_t *dest;
+    int fd;
+    void *map;
+    size_t len;
+    const struct snapshot_header *hdr;
+    const struct snapshot_record *records;
+    const char *strings;
+};
+
+struct snapshot_match {
+    struct snapshot *snap;
+    const struct snapshot_record *rec;
+};
+
+static void fill_stat(const char *path, struct snapshot_stat *ss)
+{
+    struct stat st;
+
+    memset(ss, 0, sizeof(*ss));
+    if (stat(path, &st) == -1)
+        return;
+
+    ss->ino = st.st_ino;
+    ss->size = st.st_size;
+    ss->mtime_sec = st.st_mtim.tv_sec;
+    ss->mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+static char *snapshot_file_name_alloc(pkg_dest_t * dest)
+{
+    char *name;
+
+    sprintf_alloc(&name, "%s.snapshot", dest->status_file_name);
+    return name;
+}
+
+/*******************************************************************************
+ * Writing
+ */
+
+struct strbuf {
+    char *buf;
+    size_t len;
+    size_t size;
+};
+
+static uint32_t strbuf_add(struct strbuf *sb, const char *s, size_t len)
+{
+    uint32_t off = sb->len;
+
+    if (sb->len + len + 1 > sb->size) {
+        sb->size = (sb->len + len + 1) * 2;
+        sb->buf = xrealloc(sb->buf, sb->size);
+    }
+    memcpy(sb->buf + sb->len, s, len);
+    sb->buf[sb->len + len] = '\0';
+    sb->len += len + 1;
+
+    return off;
+}
+
+static uint32_t strbuf_add_str(struct strbuf *sb, const char *s)
+{
+    return strbuf_add(sb, s ? s : "", s ? strlen(s) : 0);
+}
+
+/* Add the text written by print for pkg as two strings, either side of its
+ * Status line.
+ */
+static void add_split_text(struct strbuf *sb, pkg_t * pkg,
+                           void (*print) (pkg_t *, FILE *),
+                           uint32_t * head, uint32_t * tail)
+{
+    FILE *stream;
+    char *text = NULL;
+    size_t len = 0;
+    char *status, *end;
+
+    stream = open_memstream(&text, &len);
+    print(pkg, stream);
+    fclose(stream);
+
+    status = strstr(text, "\nStatus: ");
+    if (status) {
+        status++;
+        end = strchr(status, '\n');
+        end = end ? end + 1 : text + len;
+    } else {
+        status = end = text + len;
+    }
+
+    *head = strbuf_add(sb, text, status - text);
+    *tail = strbuf_add(sb, end, text + len - end);
+    free(text);
+}
+
+static void print_status_text(pkg_t * pkg, FILE * fp)
+{
+    pkg_print_status(pkg, fp);
+}
+
+static void print_info_text(pkg_t * pkg, FILE * fp)
+{
+    pkg_formatted_info(fp, pkg);
+}
+
+static int compare_names_versions(const char *name_a, const char *ver_a,
+                                  const char *name_b, const char *ver_b)
+{
+    int r;
+
+    r = strcmp(name_a, name_b);
+    if (r)
+        return r;
+
+    return pool_evrcmp_str(opkg_solv_pool, ver_a ? ver_a : "",
+                           ver_b ? ver_b : "", EVRCMP_COMPARE);
+}
+
+static int compare_pkgs(const void *a, const void *b)
+{
+    const pkg_t *pa = *(const pkg_t **)a;
+    const pkg_t *pb = *(const pkg_t **)b;
+
+    return compare_names_versions(pa->name, pa->version, pb->name,
+                                  pb->version);
+}
+
+static int snapshot_write_dest(pkg_dest_t * dest)
+{
+    struct snapshot_header hdr;
+    struct snapshot_record *records;
+    struct strbuf sb;
+    pkg_t **pkgs;
+    unsigned int i, n = 0;
+    char *name, *tmp;
+    FILE *fp;
+    int r = 0;
+
+    pkgs = xcalloc(opkg_solv_pkgs->len + 1, sizeof(pkg_t *));
+    for (i = 0; i < opkg_solv_pkgs->len; i++) {
+        pkg_t *pkg = opkg_solv_pkgs->pkgs[i];
+        int is_installed = pkg->state_status == SS_INSTALLED
+                || pkg->state_status == SS_UNPACKED;
+        if (pkg->dest == dest && is_installed)
+            pkgs[n++] = pkg;
+    }
+    qsort(pkgs, n, sizeof(pkg_t *), compare_pkgs);
+
+    memset(&sb, 0, sizeof(sb));
+    records = xcalloc(n + 1, sizeof(struct snapshot_record));
+    for (i = 0; i < n; i++) {
+        pkg_t *pkg = pkgs[i];
+        struct snapshot_record *rec = &records[i];
+        conffile_list_elt_t *iter;
+        FILE *stream;
+        char *conffiles = NULL;
+        size_t conffiles_len = 0;
+
+        rec->name = strbuf_add_str(&sb, pkg->name);
+        rec->version = strbuf_add_str(&sb, pkg->version);
+        rec->architecture = strbuf_add_str(&sb, pkg->architecture);
+        rec->description = strbuf_add_str(&sb, pkg->description);
+
+        stream = open_memstream(&conffiles, &conffiles_len);
+        for (iter = nv_pair_list_first(&pkg->conffiles); iter;
+                iter = nv_pair_list_next(&pkg->conffiles, iter)) {
+            conffile_t *cf = (conffile_t *) iter->data;
+            if (cf->name && cf->value)
+                fprintf(stream, "%s %s\n", cf->name, cf->value);
+        }
+        fclose(stream);
+        rec->conffiles = strbuf_add(&sb, conffiles, conffiles_len);
+        free(conffiles);
+
+        add_split_text(&sb, pkg, print_status_text, &rec->status_head,
+                       &rec->status_tail);
+        add_split_text(&sb, pkg, print_info_text, &rec->info_head,
+                       &rec->info_tail);
+
+        rec->state_want = pkg->state_want;
+        rec->state_flag = pkg->state_flag;
+        rec->state_status = pkg->state_status;
+        rec->auto_installed = pkg->auto_installed;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.n_records = n;
+    hdr.strings_len = sb.len;
+    fill_stat(dest->status_file_name, &hdr.status);
+    fill_stat(dest->journal_file_name, &hdr.journal);
+
+    name = snapshot_file_name_alloc(dest);
+    /* Caches are also written by commands run without the lock, alongside
+     * each other, so each writes its own temporary file. */
+    sprintf_alloc(&tmp, "%s-opkg.%d.tmp", name, (int)getpid());
+    fp = fopen(tmp, "w");
+    if (fp == NULL) {
+        /* Not being able to cache is no reason to fail the command. */
+        if (errno != EROFS && errno != EACCES)
+            opkg_perror(NOTICE, "Can't write snapshot %s", tmp);
+        r = -1;
+        goto cleanup;
+    }
+
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1
+            || (n && fwrite(records, sizeof(*records), n, fp) != n)
+            || (sb.len && fwrite(sb.buf, 1, sb.len, fp) != sb.len))
+        r = -1;
+    if (fclose(fp) == EOF)
+        r = -1;
+    if (r == 0)
+        r = rename(tmp, name);
+    if (r != 0) {
+        opkg_perror(NOTICE, "Couldn't write snapshot %s", name);
+        unlink(tmp);
+    }
+
+ cleanup:
+    free(tmp);
+    free(name);
+    free(sb.buf);
+    free(records);
+    free(pkgs);
+    return r;
+}
+
+/* Write a fresh snapshot of the installed packages of every dest, from the
+ * packages loaded from their status files.
+ */
+int opkg_snapshot_write(void)
+{
+    pkg_dest_list_elt_t *iter;
+    int r = 0;
+
+    if (opkg_config->noaction || !opkg_solv_status_loaded())
+        return 0;
+
+    list_for_each_entry(iter, &opkg_config->pkg_dest_list.head, node) {
+        if (snapshot_write_dest((pkg_dest_t *) iter->data) < 0)
+            r = -1;
+    }
+
+    return r;
+}
+
+/*******************************************************************************
+ * Reading
+ */
+
+static void snapshot_close(struct snapshot *snap)
+{
+    if (snap->map)
+        munmap(snap->map, snap->len);
+    if (snap->fd >= 0)
+        close(snap->fd);
+    free(snap);
+}
+
+static struct snapshot *snapshot_open(pkg_dest_t * dest, int writable)
+{
+    struct snapshot *snap;
+    struct snapshot_stat ss;
+    struct stat st;
+    char *name;
+    unsigned int i, j;
+
+    snap = xcalloc(1, sizeof(*snap));
+    snap->dest = dest;
+
+    name = snapshot_file_name_alloc(dest);
+    snap->fd = open(name, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    free(name);
+    if (snap->fd == -1 || fstat(snap->fd, &st) == -1
+            || (size_t)st.st_size < sizeof(struct snapshot_header))
+        goto invalid;
+
+    snap->len = st.st_size;
+    snap->map = mmap(NULL, snap->len, PROT_READ, MAP_SHARED, snap->fd, 0);
+    if (snap->map == MAP_FAILED) {
+        snap->map = NULL;
+        goto invalid;
+    }
+
+    snap->hdr = snap->map;
+    snap->records = (const struct snapshot_record *)(snap->hdr + 1);
+    snap->strings = (const char *)(snap->records + snap->hdr->n_records);
+
+    if (memcmp(snap->hdr->magic, SNAPSHOT_MAGIC, sizeof(snap->hdr->magic))
+            || snap->len != sizeof(struct snapshot_header)
+               + (size_t)snap->hdr->n_records * sizeof(struct snapshot_record)
+               + snap->hdr->strings_len)
+        goto invalid;
+
+    fill_stat(dest->status_file_name, &ss);
+    if (memcmp(&ss, &snap->hdr->status, sizeof(ss)))
+        goto invalid;
+    fill_stat(dest->journal_file_name, &ss);
+    if (memcmp(&ss, &snap->hdr->journal, sizeof(ss)))
+        goto invalid;
+
+    /* Don't trust any offsets before using them. */
+    if (snap->hdr->n_records
+            && (snap->hdr->strings_len == 0
+                || snap->strings[snap->hdr->strings_len - 1] != '\0'))
+        goto invalid;
+    for (i = 0; i < snap->hdr->n_records; i++) {
+        const uint32_t *offs = (const uint32_t *)&snap->records[i];
+        for (j = 0; j < RECORD_N_STRINGS; j++) {
+            if (offs[j] >= snap->hdr->strings_len)
+                goto invalid;
+        }
+    }
+
+    return snap;
+
+ invalid:
+    snapshot_close(snap);
+    return NULL;
+}
+
+/* Check that every dest has an up to date snapshot. */
+int opkg_snapshot_valid(void)
+{
+    pkg_dest_list_elt_t *iter;
+    struct snapshot *snap;
+
+    list_for_each_entry(iter, &opkg_config->pkg_dest_list.head, node) {
+        snap = snapshot_open((pkg_dest_t *) iter->data, 0);
+        if (!snap)
+            return 0;
+        snapshot_close(snap);
+    }
+
+    return 1;
+}
+
+struct snapshot_query {
+    struct snapshot **snaps;
+    unsigned int n_snaps;
+    struct snapshot_match *matches;
+    unsigned int n_matches;
+};
+
+static const char *rec_str(const struct snapshot_match *m, uint32_t off)
+{
+    return m->snap->strings + off;
+}
+
+static int compare_matches(const void *a, const void *b)
+{
+    const struct snapshot_match *ma = a;
+    const struct snapshot_match *mb = b;
+
+    return compare_names_versions(rec_str(ma, ma->rec->name),
+                                  rec_str(ma, ma->rec->version),
+                                  rec_str(mb, mb->rec->name),
+                                  rec_str(mb, mb->rec->version));
+}
+
+static void query_free(struct snapshot_query *q)
+{
+    unsigned int i;
+
+    for (i = 0; i < q->n_snaps; i++)
+        snapshot_close(q->snaps[i]);
+    free(q->snaps);
+    free(q->matches);
+}
+
+/* Collect the records of installed packages whose names match any of
+ * patterns, or all of them if patterns is NULL, sorted as the solver based
+ * listing would be.
+ *
+ * Returns 0 on success, or 1 if a snapshot is missing or out of date, or a
+ * pattern matched no package name. Patterns may also name provides, files
+ * and so on, which only the slow path knows how to resolve.
+ */
+static int query(str_list_t * patterns, int writable, struct snapshot_query *q)
+{
+    pkg_dest_list_elt_t *iter;
+    str_list_elt_t *pn;
+    struct snapshot *snap;
+    unsigned int i, n_patterns = 0, n_alloc = 0;
+    int *matched = NULL;
+    int r = 0;
+
+    memset(q, 0, sizeof(*q));
+
+    if (patterns) {
+        for (pn = str_list_first(patterns); pn;
+                pn = str_list_next(patterns, pn))
+            n_patterns++;
+        matched = xcalloc(n_patterns + 1, sizeof(int));
+    }
+
+    list_for_each_entry(iter, &opkg_config->pkg_dest_list.head, node) {
+        snap = snapshot_open((pkg_dest_t *) iter->data, writable);
+        if (!snap) {
+            r = 1;
+            goto out;
+        }
+        q->snaps = xrealloc(q->snaps, (q->n_snaps + 1) * sizeof(*q->snaps));
+        q->snaps[q->n_snaps++] = snap;
+
+        for (i = 0; i < snap->hdr->n_records; i++) {
+            const struct snapshot_record *rec = &snap->records[i];
+            const char *name = snap->strings + rec->name;
+            int want = (patterns == NULL);
+            unsigned int p = 0;
+
+            if (patterns) {
+                for (pn = str_list_first(patterns); pn;
+                        pn = str_list_next(patterns, pn), p++) {
+                    if (fnmatch(pn->data, name, 0) == 0) {
+                        matched[p] = 1;
+                        want = 1;
+                    }
+                }
+            }
+            if (!want)
+                continue;
+
+            if (q->n_matches == n_alloc) {
+                n_alloc = n_alloc ? n_alloc * 2 : 64;
+                q->matches = xrealloc(q->matches,
+                                      n_alloc * sizeof(*q->matches));
+            }
+            q->matches[q->n_matches].snap = snap;
+            q->matches[q->n_matches].rec = rec;
+            q->n_matches++;
+        }
+    }
+
+    for (i = 0; i < n_patterns; i++) {
+        if (!matched[i]) {
+            r = 1;
+            goto out;
+        }
+    }
+
+    qsort(q->matches, q->n_matches, sizeof(*q->matches), compare_matches);
+
+ out:
+    free(matched);
+    if (r)
+        query_free(q);
+    return r;
+}
+
+static void print_status_line(FILE * fp, const struct snapshot_record *rec)
+{
+    char *flag = pkg_state_flag_to_str(rec->state_flag);
+
+    fprintf(fp, "Status: %s %s %s\n", pkg_state_want_to_str(rec->state_want),
+            flag, pkg_state_status_to_str(rec->state_status));
+    free(flag);
+}
+
+int opkg_snapshot_list_installed(str_list_t * patterns)
+{
+    struct snapshot_query q;
+    const struct snapshot_match *m;
+    unsigned int i;
+
+    if (query(patterns, 0, &q))
+        return 1;
+
+    for (i = 0; i < q.n_matches; i++) {
+        m = &q.matches[i];
+        if (*rec_str(m, m->rec->description))
+            printf("%s - %s - %s\n", rec_str(m, m->rec->name),
+                   rec_str(m, m->rec->version),
+                   rec_str(m, m->rec->description));
+        else
+            printf("%s - %s\n", rec_str(m, m->rec->name),
+                   rec_str(m, m->rec->version));
+    }
+
+    query_free(&q);
+    return 0;
+}
+
+int opkg_snapshot_status(str_list_t * patterns)
+{
+    struct snapshot_query q;
+    const struct snapshot_match *m;
+    unsigned int i;
+
+    /* Reporting modified conffiles needs the full package. */
+    if (opkg_config->verbosity >= INFO)
+        return 1;
+
+    if (query(patterns, 0, &q))
+        return 1;
+
+    for (i = 0; i < q.n_matches; i++) {
+        m = &q.matches[i];
+        fputs(rec_str(m, m->rec->info_head), stdout);
+        print_status_line(stdout, m->rec);
+        fputs(rec_str(m, m->rec->info_tail), stdout);
+    }
+
+    query_free(&q);
+    return 0;
+}
+
+static char *status_record_alloc(const struct snapshot_match *m,
+                                 const struct snapshot_record *rec,
+                                 size_t * len)
+{
+    FILE *stream;
+    char *text = NULL;
+
+    stream = open_memstream(&text, len);
+    fputs(rec_str(m, rec->status_head), stream);
+    print_status_line(stream, rec);
+    fputs(rec_str(m, rec->status_tail), stream);
+    fclose(stream);
+
+    return text;
+}
+
+int opkg_snapshot_flag(const char *flag, str_list_t * patterns)
+{
+    struct snapshot_query q;
+    struct snapshot_record *updated;
+    char **texts;
+    size_t *lens;
+    unsigned int i;
+    int is_status, err = 0;
+    char *state_str;
+
+    /* Leave anything but a plain state change to the slow path. */
+    if (opkg_config->noaction || patterns == NULL)
+        return 1;
+
+    is_status = (strcmp(flag, "installed") == 0)
+            || (strcmp(flag, "unpacked") == 0);
+    if (!is_status && strcmp(flag, "hold") && strcmp(flag, "noprune")
+            && strcmp(flag, "user") && strcmp(flag, "ok"))
+        return 1;
+
+    if (query(patterns, 1, &q))
+        return 1;
+
+    updated = xcalloc(q.n_matches + 1, sizeof(*updated));
+    texts = xcalloc(q.n_matches + 1, sizeof(char *));
+    lens = xcalloc(q.n_matches + 1, sizeof(size_t));
+
+    for (i = 0; i < q.n_matches; i++) {
+        updated[i] = *q.matches[i].rec;
+        if (is_status)
+            updated[i].state_status = pkg_state_status_from_str(flag);
+        else
+            updated[i].state_flag = pkg_state_flag_from_str(flag);
+        texts[i] = status_record_alloc(&q.matches[i], &updated[i], &lens[i]);
+    }
+
+    /* Compacting needs every package loaded, so if these records would push
+     * a journal over the limit, go the slow way before changing anything.
+     */
+    for (i = 0; i < q.n_snaps; i++) {
+        pkg_dest_t *dest = q.snaps[i]->dest;
+        long size;
+        unsigned int j;
+
+        if (dest->journal_size < 0 && opkg_journal_load(dest, NULL, NULL) < 0) {
+            err = 1;
+            goto out;
+        }
+        size = dest->journal_size;
+        for (j = 0; j < q.n_matches; j++) {
+            if (q.matches[j].snap == q.snaps[i])
+                size += lens[j] + 64;
+        }
+        if (size > opkg_config->status_journal_max) {
+            err = 1;
+            goto out;
+        }
+    }
+
+    state_str = is_status ? xstrdup(flag)
+            : pkg_state_flag_to_str(pkg_state_flag_from_str(flag));
+
+    for (i = 0; i < q.n_matches; i++) {
+        struct snapshot *snap = q.matches[i].snap;
+        off_t off = (const char *)q.matches[i].rec - (const char *)snap->map;
+
+        opkg_msg(NOTICE, "Setting flags for package %s to %s.\n",
+                 rec_str(&q.matches[i], updated[i].name), state_str);
+
+        if (opkg_journal_append_record(snap->dest, texts[i], lens[i]) < 0) {
+            err = -1;
+            break;
+        }
+        if (pwrite(snap->fd, &updated[i], sizeof(updated[i]), off)
+                != sizeof(updated[i]))
+            err = -1;
+    }
+    free(state_str);
+
+    /* Flush the journal as the configured durability asks, as a commit
+     * would, before the snapshot claims it.
+     */
+    if (opkg_fsync_commit()) {
+        opkg_msg(ERROR, "Failed to flush the status to disk.\n");
+        err = -1;
+    }
+
+    /* The journal has grown, so record its new state or, if updating a
+     * record failed, leave the snapshot stale so it gets rebuilt.
+     */
+    if (err == 0) {
+        for (i = 0; i < q.n_snaps; i++) {
+            struct snapshot_stat ss;
+
+            fill_stat(q.snaps[i]->dest->journal_file_name, &ss);
+            if (pwrite(q.snaps[i]->fd, &ss, sizeof(ss),
+                       offsetof(struct snapshot_header, journal)) != sizeof(ss))
+                opkg_perror(NOTICE, "Couldn't update snapshot");
+        }
+    }
+
+ out:
+    for (i = 0; i < q.n_matches; i++)
+        free(texts[i]);
+    free(texts);
+    free(lens);
+    free(updated);
+    query_free(&q);
+    return err;
+}
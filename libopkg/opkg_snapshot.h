@@ -0,0 +1,37 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_snapshot.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_SNAPSHOT_H
+#define OPKG_SNAPSHOT_H
+
+#include "str_list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int opkg_snapshot_write(void);
+int opkg_snapshot_valid(void);
+
+/* These return 0 or -1 if the command was handled from the snapshots, or 1
+ * if the caller must load the status files and do it the slow way.
+ */
+int opkg_snapshot_list_installed(str_list_t * patterns);
+int opkg_snapshot_status(str_list_t * patterns);
+int opkg_snapshot_flag(const char *flag, str_list_t * patterns);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_SNAPSHOT_H */
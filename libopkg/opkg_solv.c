@@ -46,8 +46,14 @@
 #include "xfuncs.h"
 #include "opkg_upgrade.h"
 #include "opkg_configure.h"
+#include "opkg_profile.h"
 #include "xsystem.h"
 #include "opkg_remove.h"
+#include "opkg_fsync.h"
+#include "opkg_snapshot.h"
+#include "opkg_trigger.h"
+#include "opkg_journal.h"
+#include "opkg_plan.h"
 
 typedef struct {
     char *arch;
@@ -69,6 +75,30 @@ Repo *unpacked_repo;
 void opkg_solv_prepare_arch();
 static void get_excludes(Queue *q);
 
+/* Counts the whatprovides indexes created, so that what is prepared from
+ * one can tell when it has been replaced.
+ */
+static unsigned int whatprovides_gen;
+
+/* What jobs see of the pool beyond the solvables as loaded, prepared once
+ * for each whatprovides index and set of excludes. Recommends which can be
+ * met are promoted to requires, as libsolv doesn't hold to them itself, by
+ * giving those solvables a second requires array. A job swaps the arrays
+ * in and back out again, so the pool is left as it was for the next.
+ */
+struct prepared_pool {
+    unsigned int gen;           /* whatprovides_gen, or 0 if unprepared */
+    Queue excludes;
+    Map considered;             /* all but the excludes */
+    Queue promoted;             /* (p, requires with recommends) pairs */
+    Solver *solver;
+};
+
+static struct prepared_pool prepared;
+
+/* Requires swapped out by the running job, as (p, requires) pairs. */
+static Queue job_saved;
+
 void opkg_solv_init()
 {
     opkg_solv_arch_vec = NULL;
@@ -120,25 +150,32 @@ static void print_pkg(pkg_t * pkg)
         printf("%s - %s\n", pkg->name, pkg->version);
 }
 
-str_list_t* read_status_tmp(const char *file_name)
+static int add_status_journal(Repo *repo, pkg_dest_t * dest)
 {
-    str_list_t *status;
-    char line[500];
+    char *records;
+    size_t len;
     FILE *fp;
-    fp = fopen(file_name, "r");
-    if (fp == NULL)
-        return NULL;
+    int r;
 
-    //read line by line
-    status = str_list_alloc();
-    while (fgets(line, sizeof(line), fp) != NULL) {
-        size_t ln = strlen(line) - 1;
-        if (line[ln] == '\n')
-            line[ln] = '\0';
-        str_list_append(status, line);
+    r = opkg_journal_load(dest, &records, &len);
+    if (r < 0 || records == NULL)
+        return r;
+
+    fp = fmemopen(records, len, "r");
+    if (fp == NULL) {
+        opkg_perror(ERROR, "Failed to read journal %s", dest->journal_file_name);
+        free(records);
+        return -1;
     }
+
+    r = repo_add_debpackages(repo, fp, REPO_REUSE_REPODATA | REPO_NO_INTERNALIZE);
+    if (r)
+        opkg_msg(ERROR, "Component %s: %s\n", dest->journal_file_name,
+                 pool_errstr(opkg_solv_pool));
+
     fclose(fp);
-    return status;
+    free(records);
+    return r ? -1 : 0;
 }
 
 int opkg_solv_add_from_file(const char *file_name, pkg_src_t * src,
@@ -161,7 +198,7 @@ int opkg_solv_add_from_file(const char *file_name, pkg_src_t * src,
     }
 
     fp = fopen(file_name, "r");
-    if (fp == NULL) {
+    if (fp == NULL && !(is_status_file && errno == ENOENT)) {
         opkg_perror(ERROR, "Failed to open %s", file_name);
         return -1;
     }
@@ -177,12 +214,24 @@ int opkg_solv_add_from_file(const char *file_name, pkg_src_t * src,
         repo = repo_create(opkg_solv_pool, src->name);
     }
 
-    if (repo_add_debpackages(repo, fp, REPO_REUSE_REPODATA | REPO_NO_INTERNALIZE)) {
+    if (fp && repo_add_debpackages(repo, fp, REPO_REUSE_REPODATA | REPO_NO_INTERNALIZE)) {
         opkg_msg(ERROR, "Component %s: %s\n", file_name, pool_errstr(opkg_solv_pool));
         fclose(fp);
         return -1;
     }
 
+    /* Replay the journal on top of the snapshot. Records are complete
+     * paragraphs, so the later copies win in the dedup below.
+     */
+    if (is_status_file) {
+        ret = add_status_journal(repo, dest);
+        if (ret) {
+            if (fp)
+                fclose(fp);
+            return ret;
+        }
+    }
+
     /* remove duplicate solvables (used for transaction) from status file
      * using only the last solvable
      */
@@ -194,7 +243,11 @@ int opkg_solv_add_from_file(const char *file_name, pkg_src_t * src,
                             break;
                         if (solvable_identical(s, s2)) {
                             repo_free_solvable(repo, s2 - opkg_solv_pool->solvables, 1);
-                            dest->changed = 1;
+                            /* Duplicates are expected from the journal, but
+                             * in the snapshot itself they need compacting.
+                             */
+                            if (dest->journal_seq == 0)
+                                dest->changed = 1;
                         }
                     }
     }
@@ -241,11 +294,6 @@ int opkg_solv_add_from_file(const char *file_name, pkg_src_t * src,
 
     repo_internalize(repo); // CHECK IF NEEDED ???
 
-    if (is_status_file) {
-        // Assume that status file parsed first
-        pkg_info_preinstall_check(opkg_solv_pkgs);
-    }
-
 #if 0
     do {
         pkg = pkg_new();
@@ -293,7 +341,8 @@ int opkg_solv_add_from_file(const char *file_name, pkg_src_t * src,
     free(buf);
 
 #endif
-    fclose(fp);
+    if (fp)
+        fclose(fp);
 
     return ret;
 }
@@ -326,6 +375,8 @@ int opkg_solv_add_from_dist(pkg_src_t * dist)
 /*
  * Load in feed files from the cached "src" and/or "src/gz" locations.
  */
+static int feeds_loaded;
+
 int opkg_solv_load_feeds(void)
 {
     pkg_src_list_elt_t *iter;
@@ -333,6 +384,10 @@ int opkg_solv_load_feeds(void)
     char *list_file;
     int r;
 
+    if (feeds_loaded)
+        return 0;
+    feeds_loaded = 1;
+
     opkg_msg(INFO, "\n");
 
     for (iter = void_list_first(&opkg_config->dist_src_list); iter;
@@ -393,6 +448,9 @@ int opkg_solv_load_feeds(void)
     return 0;
 }
 
+static int status_loaded;
+static int file_owners_loaded;
+
 /*
  * Load in status files from the configured "dest"s.
  */
@@ -401,6 +459,10 @@ int opkg_solv_load_status_files(void)
     pkg_dest_list_elt_t *iter;
     pkg_dest_t *dest;
 
+    if (status_loaded)
+        return 0;
+    status_loaded = 1;
+
     opkg_msg(INFO, "\n");
 
     for (iter = void_list_first(&opkg_config->pkg_dest_list); iter;
@@ -408,7 +470,8 @@ int opkg_solv_load_status_files(void)
 
         dest = (pkg_dest_t *) iter->data;
 
-        if (file_exists(dest->status_file_name)) {
+        if (file_exists(dest->status_file_name)
+                || file_exists(dest->journal_file_name)) {
             int r = opkg_solv_add_from_file(dest->status_file_name, NULL, dest, 1);
             if (r != 0)
                 return -1;
@@ -418,6 +481,57 @@ int opkg_solv_load_status_files(void)
     return 0;
 }
 
+void opkg_solv_create_whatprovides(void)
+{
+    /* Creating a repo drops the index, so one still here is up to date. */
+    if (opkg_solv_pool->whatprovides)
+        return;
+
+    pool_addfileprovides(opkg_solv_pool);
+    pool_createwhatprovides(opkg_solv_pool);
+    whatprovides_gen++;
+}
+
+int opkg_solv_status_loaded(void)
+{
+    return status_loaded;
+}
+
+/*
+ * Record which installed package owns each file, for the clash checks and
+ * file removal of a transaction. Only packages installed in a dest have
+ * file lists, and the status files load those of each dest together.
+ */
+int opkg_solv_load_file_owners(void)
+{
+    pkg_vec_t *installed;
+    unsigned int i;
+
+    if (file_owners_loaded)
+        return 0;
+
+    if (opkg_solv_load_status_files())
+        return -1;
+    file_owners_loaded = 1;
+
+    installed = pkg_vec_alloc();
+    for (i = 0; i < opkg_solv_pkgs->len; i++) {
+        pkg_t *pkg = opkg_solv_pkgs->pkgs[i];
+
+        if (pkg->dest && pkg->state_status != SS_NOT_INSTALLED)
+            pkg_vec_insert(installed, pkg);
+    }
+
+    opkg_profile_begin("preinstall_check");
+    pkg_info_preinstall_check(installed);
+    opkg_profile_end("preinstall_check");
+    opkg_profile_count("file_lists_read", installed->len);
+
+    pkg_vec_free(installed);
+
+    return 0;
+}
+
 /*
  * Adds architecture to internal list with sorting by priority
  */
@@ -474,6 +588,7 @@ static opkg_intercept_t opkg_prep_intercepts(void)
 static int opkg_finalize_intercepts(opkg_intercept_t ctx)
 {
     DIR *dir;
+    char *path;
     int err = 0;
 
     setenv("PATH", ctx->oldpath, 1);
@@ -483,8 +598,6 @@ static int opkg_finalize_intercepts(opkg_intercept_t ctx)
     if (dir) {
         struct dirent *de;
         while (de = readdir(dir), de != NULL) {
-            char *path;
-
             if (de->d_name[0] == '.')
                 continue;
 
@@ -499,13 +612,33 @@ static int opkg_finalize_intercepts(opkg_intercept_t ctx)
     } else
         opkg_perror(ERROR, "Failed to open dir %s", ctx->statedir);
 
+    /* Triggers activated by maintainer scripts through opkg-trigger. */
+    sprintf_alloc(&path, "%s/%s", ctx->statedir, OPKG_TRIGGER_INTERCEPT_FILE);
+    opkg_trigger_read_activations(path);
+    free(path);
+
     rm_r(ctx->statedir);
     free(ctx->statedir);
     free(ctx);
 
+    if (opkg_trigger_run() != 0)
+        err = -1;
+
     return err;
 }
 
+static char *status_tmp_name_alloc(pkg_dest_t * dest)
+{
+    char *tmp;
+
+    sprintf_alloc(&tmp, "%s-opkg.tmp", dest->status_file_name);
+    return tmp;
+}
+
+/* Fold the status journal of each dest which needs it into a new status
+ * file snapshot. State changes themselves are already on disk in the
+ * journal, so dests with a small journal are left alone.
+ */
 int write_status_files(void)
 {
     pkg_dest_list_elt_t *iter;
@@ -514,6 +647,7 @@ int write_status_files(void)
     unsigned int i;
     int ret = 0;
     int r;
+    char *tmp;
 
     if (opkg_config->noaction)
         return 0;
@@ -521,15 +655,16 @@ int write_status_files(void)
     list_for_each_entry(iter, &opkg_config->pkg_dest_list.head, node) {
         dest = (pkg_dest_t *) iter->data;
 
-        if (!dest->changed)
+        if (!dest->changed && !opkg_journal_needs_compaction(dest))
             continue;
 
-        dest->status_fp = fopen(dest->status_file_name, "w");
+        tmp = status_tmp_name_alloc(dest);
+        dest->status_fp = fopen(tmp, "w");
         if (dest->status_fp == NULL && errno != EROFS) {
-            opkg_perror(ERROR, "Can't open status file %s",
-                    dest->status_file_name);
+            opkg_perror(ERROR, "Can't open status file %s", tmp);
             ret = -1;
         }
+        free(tmp);
     }
 
     //   pkg_hash_fetch_available(all);
@@ -556,13 +691,30 @@ int write_status_files(void)
 
     list_for_each_entry(iter, &opkg_config->pkg_dest_list.head, node) {
         dest = (pkg_dest_t *) iter->data;
-        if (dest->status_fp) {
-            r = fclose(dest->status_fp);
-            if (r == EOF) {
-                opkg_perror(ERROR, "Couldn't close %s", dest->status_file_name);
+        if (!dest->status_fp)
+            continue;
+
+        tmp = status_tmp_name_alloc(dest);
+        r = fflush(dest->status_fp);
+        if (r == 0)
+            r = opkg_fsync_fd(fileno(dest->status_fp));
+        if (fclose(dest->status_fp) == EOF)
+            r = -1;
+        dest->status_fp = NULL;
+
+        if (r == 0)
+            r = rename(tmp, dest->status_file_name);
+        if (r != 0) {
+            opkg_perror(ERROR, "Couldn't write %s", dest->status_file_name);
+            unlink(tmp);
+            ret = -1;
+        } else {
+            opkg_fsync_track_file(dest->status_file_name);
+            if (opkg_journal_reset(dest) < 0)
                 ret = -1;
-            }
+            dest->changed = 0;
         }
+        free(tmp);
     }
 
     return ret;
@@ -573,7 +725,10 @@ int write_changed_filelists(void)
     unsigned int i;
     int err, ret = 0;
 
-    if (opkg_config->noaction)
+    /* The lists are written from the file owners, so without them nothing
+     * can have changed.
+     */
+    if (opkg_config->noaction || !file_owners_loaded)
         return 0;
 
     opkg_msg(INFO, "Saving changed filelists.\n");
@@ -593,17 +748,30 @@ int write_changed_filelists(void)
     return ret;
 }
 
-static void write_all_status_files(void)
+static int write_all_status_files(void)
 {
+    int err = 0;
+
     if (!opkg_config->noaction) {
         opkg_msg(INFO, "Writing status file.\n");
-        write_status_files();
-        write_changed_filelists();
-        if (!opkg_config->offline_root)
-            sync();
+        opkg_profile_begin("write_status");
+        if (write_status_files())
+            err = -1;
+        if (write_changed_filelists())
+            err = -1;
+        if (opkg_fsync_commit()) {
+            opkg_msg(ERROR, "Failed to flush the status to disk.\n");
+            err = -1;
+        }
+        /* Only describe a status which is known to be safe. */
+        if (err == 0)
+            opkg_snapshot_write();
+        opkg_profile_end("write_status");
     } else {
         opkg_msg(DEBUG, "Nothing to be done.\n");
     }
+
+    return err;
 }
 
 static void sigint_handler(int sig)
@@ -642,24 +810,98 @@ void print_pkg_trans(Id type, pkg_t *pkg)
                 pkg->version, pkg->dest->name);
 }
 
-int process_job(Solver *solver, Queue *job)
+/* Finds, for each package in pkgs, the earlier ones which satisfy its
+ * dependencies, so that opkg_configure_pkgs() can configure packages
+ * which don't depend on each other at the same time.
+ */
+static pkg_vec_t **configure_deps_alloc(pkg_vec_t *pkgs)
 {
-    Transaction *trans;
-    Queue checkq;
-    int newpkgs, i;
-    Id p;
-    pkg_t *pkg;
-    int mode, err, r;
-    opkg_intercept_t ic;
+    Pool *pool = opkg_solv_pool;
+    pkg_vec_t **deps;
+    unsigned int i, j;
+    Id req, *reqp, p, pp;
+    Solvable *s;
+
+    if (opkg_config->configure_jobs <= 1)
+        return NULL;
+
+    opkg_solv_create_whatprovides();
+
+    deps = xcalloc(pkgs->len, sizeof(pkg_vec_t *));
+    for (i = 0; i < pkgs->len; i++) {
+        s = pool_id2solvable(pool, pkgs->pkgs[i]->id);
+        if (!s->requires)
+            continue;
+
+        deps[i] = pkg_vec_alloc();
+        reqp = s->repo->idarraydata + s->requires;
+        while ((req = *reqp++) != 0) {
+            if (req == SOLVABLE_PREREQMARKER)
+                continue;
+            FOR_PROVIDES(p, pp, req) {
+                for (j = 0; j < i; j++) {
+                    if (pkgs->pkgs[j]->id == p) {
+                        pkg_vec_insert(deps[i], pkgs->pkgs[j]);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    return deps;
+}
+
+static void configure_deps_free(pkg_vec_t **deps, unsigned int len)
+{
+    unsigned int i;
+
+    if (!deps)
+        return;
+    for (i = 0; i < len; i++)
+        pkg_vec_free(deps[i]);
+    free(deps);
+}
+
+static void transaction_steps(Transaction *trans, Queue *steps);
+static int commit_steps(Queue *steps);
+
+/* Told how far commit_steps() has got, if set, by opkg_solv_commit(). */
+static opkg_progress_callback_t commit_progress;
+static void *commit_progress_data;
+
+static void report_progress(int action, pkg_t *pkg, unsigned int done,
+                            unsigned int total)
+{
+    opkg_progress_data_t progress;
+
+    if (!commit_progress)
+        return;
+    progress.percentage = total ? done * 100 / total : 100;
+    progress.action = action;
+    progress.pkg = pkg;
+    commit_progress(&progress, commit_progress_data);
+}
+
+/* Solves job, asking which solution to take for each problem if ask is
+ * set, and otherwise printing them all. Returns 0 once solved, or 1 if
+ * problems remain.
+ */
+static int solve_problems(Solver *solver, Queue *job, int ask)
+{
+    int r;
 
     for (;;)
     {
         Id problem, solution;
         int pcnt, scnt;
 
-        if (!solver_solve(solver, job))
-            break;
-        if (!opkg_config->batch) {
+        opkg_profile_begin("solve");
+        r = solver_solve(solver, job);
+        opkg_profile_end("solve");
+        if (!r)
+            return 0;
+        if (ask) {
             pcnt = solver_problem_count(solver);
             printf("Found %d problems:\n", pcnt);
             for (problem = 1; problem <= pcnt; problem++) {
@@ -708,11 +950,29 @@ int process_job(Solver *solver, Queue *job)
             //         solver_printsolution(solver, problem, 1);
             //          solver_take_solution(solver, problem, 1, job);
             solver_printallsolutions(solver);
-            return 0;
+            return 1;
         }
     }
+}
+
+int process_job(Solver *solver, Queue *job)
+{
+    Transaction *trans;
+    Queue steps;
+    int err;
+
+    if (solve_problems(solver, job, !opkg_config->batch))
+        return 0;
 
     trans = solver_create_transaction(solver);
+    if (opkg_config->plan_out) {
+        queue_init(&steps);
+        transaction_steps(trans, &steps);
+        transaction_free(trans);
+        err = opkg_plan_write(opkg_config->plan_out, &steps);
+        queue_free(&steps);
+        return err;
+    }
     if (!trans->steps.count)
     {
         printf("Nothing to do.\n");
@@ -734,129 +994,204 @@ int process_job(Solver *solver, Queue *job)
         }
     }
 
+    queue_init(&steps);
+    transaction_steps(trans, &steps);
+    transaction_free(trans);
+
+    err = commit_steps(&steps);
+    queue_free(&steps);
+    return err;
+}
+
+/* Takes the steps of trans, in the order to commit them, as (type, p, obs)
+ * triples, where obs is the package replacing p in an upgrade, or 0.
+ */
+static void transaction_steps(Transaction *trans, Queue *steps)
+{
+    int i, mode;
+    Id p, type;
+
+    transaction_order(trans, 0);
+    mode = SOLVER_TRANSACTION_SHOW_OBSOLETES | SOLVER_TRANSACTION_OBSOLETE_IS_UPGRADE;
+    for (i = 0; i < trans->steps.count; i++) {
+        p = trans->steps.elements[i];
+        type = transaction_type(trans, p, mode);
+        switch (type) {
+            case SOLVER_TRANSACTION_DOWNGRADED:
+            case SOLVER_TRANSACTION_UPGRADED:
+            case SOLVER_TRANSACTION_REINSTALLED:
+            case SOLVER_TRANSACTION_CHANGED:
+                queue_push(steps, type);
+                queue_push2(steps, p, transaction_obs_pkg(trans, p));
+                break;
+            case SOLVER_TRANSACTION_ERASE:
+            case SOLVER_TRANSACTION_INSTALL:
+            case SOLVER_TRANSACTION_MULTIINSTALL:
+                queue_push(steps, type);
+                queue_push2(steps, p, 0);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Downloads the new packages of steps, as given by transaction_steps(),
+ * then unpacks and configures them.
+ */
+static int commit_steps(Queue *steps)
+{
+    int i, err, r;
+    Id p, type;
+    pkg_t *pkg, *pkg2;
+    opkg_intercept_t ic;
+    pkg_vec_t *configure, **deps;
+    /* Each step counts once for downloading and once for committing. */
+    unsigned int n_steps = steps->count / 3, total = 2 * n_steps;
+
+    /* Nothing else needs to know who owns what. */
+    if (opkg_solv_load_file_owners())
+        return -1;
+
     /* download all new packages */
-    queue_init(&checkq);
-    newpkgs = transaction_installedresult(trans, &checkq);
-    for (i = 0; i < newpkgs; i++)
+    for (i = 0; i < steps->count; i += 3)
     {
-        p = checkq.elements[i];
+        type = steps->elements[i];
+        switch (type) {
+            case SOLVER_TRANSACTION_DOWNGRADED:
+            case SOLVER_TRANSACTION_UPGRADED:
+            case SOLVER_TRANSACTION_REINSTALLED:
+            case SOLVER_TRANSACTION_CHANGED:
+                p = steps->elements[i + 2];
+                break;
+            case SOLVER_TRANSACTION_INSTALL:
+            case SOLVER_TRANSACTION_MULTIINSTALL:
+                p = steps->elements[i + 1];
+                break;
+            default:
+                continue;
+        }
         pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, p);
         assert(pkg != NULL);
         if (pkg->provided_by_hand)
             continue;
 
-        if (opkg_download_pkg(pkg)) {
+        report_progress(OPKG_DOWNLOAD, pkg, i / 3, total);
+        opkg_profile_begin("download");
+        r = opkg_download_pkg(pkg);
+        opkg_profile_end("download");
+        if (r) {
             opkg_msg(ERROR, "Failed to download %s. "
                     "Perhaps you need to run 'opkg update'?\n", pkg->name);
             return -1;
         }
+        opkg_profile_count("packages_downloaded", 1);
         fflush(stdout);
     }
-    queue_free(&checkq);
 
-    if (opkg_config->download_only) {
-        transaction_free(trans);
+    if (opkg_config->download_only)
         return 0;
-    }
 
     /* and finally commit the transaction */
     printf("Committing transaction:\n\n");
-    transaction_order(trans, 0);
-    mode = SOLVER_TRANSACTION_SHOW_OBSOLETES | SOLVER_TRANSACTION_OBSOLETE_IS_UPGRADE;
-    for (i = 0; i < trans->steps.count; i++)
+    for (i = 0; i < steps->count; i += 3)
     {
-        pkg_t *pkg2;
-        Id type;
-
-        p = trans->steps.elements[i];
+        type = steps->elements[i];
+        p = steps->elements[i + 1];
         pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, p);
 
-        type = transaction_type(trans, p, mode);
         switch(type)
         {
             case SOLVER_TRANSACTION_DOWNGRADED:
             case SOLVER_TRANSACTION_UPGRADED:
             case SOLVER_TRANSACTION_REINSTALLED:
             case SOLVER_TRANSACTION_CHANGED:
-                pkg2 = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, transaction_obs_pkg(trans, p));
+                pkg2 = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, steps->elements[i + 2]);
                 pkg2->dest = pkg->dest;
                 print_pkg_trans(type, pkg2);
-                if (opkg_upgrade_pkg(pkg, pkg2)) {
+                report_progress(OPKG_INSTALL, pkg2, n_steps + i / 3, total);
+                opkg_profile_begin("upgrade");
+                r = opkg_upgrade_pkg(pkg, pkg2);
+                opkg_profile_end("upgrade");
+                if (r) {
                     return -1;
                 }
+                opkg_profile_count("packages_upgraded", 1);
                 break;
             case SOLVER_TRANSACTION_ERASE:
                 print_pkg_trans(type, pkg);
+                report_progress(OPKG_REMOVE, pkg, n_steps + i / 3, total);
+                opkg_profile_begin("remove");
                 opkg_remove_pkg(pkg);
+                opkg_profile_end("remove");
+                opkg_profile_count("packages_removed", 1);
                 break;
             case SOLVER_TRANSACTION_INSTALL:
             case SOLVER_TRANSACTION_MULTIINSTALL:
                 pkg->dest = opkg_config->default_dest;
                 print_pkg_trans(type, pkg);
-                if (opkg_install_pkg(NULL, pkg)) {
+                report_progress(OPKG_INSTALL, pkg, n_steps + i / 3, total);
+                opkg_profile_begin("install");
+                r = opkg_install_pkg(NULL, pkg);
+                opkg_profile_end("install");
+                if (r) {
                     return -1;
                 }
+                opkg_profile_count("packages_installed", 1);
                 break;
             default:
                 break;
         }
+        arena_reset(&opkg_config->scratch);
     }
 
     if (opkg_config->offline_root && !opkg_config->force_postinstall) {
         opkg_msg(INFO,
                 "Offline root mode: not configuring unpacked packages.\n");
-        transaction_free(trans);
+        report_progress(OPKG_INSTALL, NULL, total, total);
         return 0;
     }
     opkg_msg(INFO, "Configuring unpacked packages.\n");
 
     /* Configuring packages */
     ic = opkg_prep_intercepts();
-    if (ic == NULL) {
-        transaction_free(trans);
+    if (ic == NULL)
         return -1;
-    }
-    err = 0;
-
-    for (i = 0; i < trans->steps.count; i++) {
-        Id type;
+    configure = pkg_vec_alloc();
 
-        p = trans->steps.elements[i];
-        type = transaction_type(trans, p, mode);
+    for (i = 0; i < steps->count; i += 3) {
+        type = steps->elements[i];
         switch (type) {
             case SOLVER_TRANSACTION_DOWNGRADED:
             case SOLVER_TRANSACTION_UPGRADED:
             case SOLVER_TRANSACTION_REINSTALLED:
             case SOLVER_TRANSACTION_CHANGED:
-                pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, transaction_obs_pkg(trans, p));
+                pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, steps->elements[i + 2]);
                 break;
             case SOLVER_TRANSACTION_INSTALL:
             case SOLVER_TRANSACTION_MULTIINSTALL:
-                pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, p);
+                pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, steps->elements[i + 1]);
                 break;
             default:
                 continue;
         }
 
-        if (pkg->state_status == SS_UNPACKED) {
-            opkg_msg(NOTICE, "Configuring %s.\n", pkg->name);
-            r = opkg_configure(pkg);
-            if (r == 0) {
-                pkg->state_status = SS_INSTALLED;
-                pkg->state_flag &= ~SF_PREFER;
-                pkg->state_flag |= SF_CHANGED;
-                pkg_write_status(pkg);
-            } else {
-                if (!opkg_config->offline_root)
-                    err = -1;
-            }
-        }
+        if (pkg->state_status == SS_UNPACKED)
+            pkg_vec_insert(configure, pkg);
     }
+
+    deps = configure_deps_alloc(configure);
+    err = opkg_configure_pkgs(configure, deps);
+    configure_deps_free(deps, configure->len);
+    pkg_vec_free(configure);
+
+    opkg_profile_begin("intercepts");
     r = opkg_finalize_intercepts(ic);
+    opkg_profile_end("intercepts");
     if (r != 0)
         err = -1;
 
-    transaction_free(trans);
+    report_progress(OPKG_INSTALL, NULL, total, total);
     return err;
 }
 
@@ -918,7 +1253,7 @@ static int add_pkgs(Queue *job, str_list_t *pkg_names)
     if (commandlinerepo)
         repo_internalize(commandlinerepo);
 
-    pool_createwhatprovides(opkg_solv_pool);
+    opkg_solv_create_whatprovides();
     /* add found packages to cache with Auto-Installed property */
     queue_init(&q);
     selection_solvables(opkg_solv_pool, job, &q);
@@ -972,6 +1307,7 @@ static void get_excludes(Queue *q)
 
     queue_empty(q);
     selection_solvables(opkg_solv_pool, &job, q);
+    queue_free(&job);
 }
 
 /*
@@ -1009,6 +1345,7 @@ int configure_old_pkgs()
     int err, r;
     opkg_intercept_t ic;
     Solvable *s;
+    pkg_vec_t *configure, **deps;
 
     if (opkg_config->offline_root && !opkg_config->force_postinstall) {
         opkg_msg(INFO,
@@ -1027,93 +1364,155 @@ int configure_old_pkgs()
         return -1;
     }
 
-    err = 0;
+    configure = pkg_vec_alloc();
     FOR_REPO_SOLVABLES(opkg_solv_pool->installed, p, s) {
             pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, p);
             if (pkg->state_want != SW_INSTALL || pkg->state_status != SS_UNPACKED)
                 continue;
-            opkg_msg(NOTICE, "Configuring %s.\n", pkg->name);
-            r = opkg_configure(pkg);
-            if (r == 0) {
-                pkg->state_status = SS_INSTALLED;
-                pkg->state_flag &= ~SF_PREFER;
-                pkg->state_flag |= SF_CHANGED;
-                pkg_write_status(pkg);
-            } else {
-                if (!opkg_config->offline_root)
-                    err = -1;
-            }
+            pkg_vec_insert(configure, pkg);
         }
 
+    deps = configure_deps_alloc(configure);
+    err = opkg_configure_pkgs(configure, deps);
+    configure_deps_free(deps, configure->len);
+    pkg_vec_free(configure);
+
     r = opkg_finalize_intercepts(ic);
     if (r != 0)
         err = -1;
     return err;
 }
 
-void prepare_recommends()
+/* Whether rec can be met by something which isn't excluded. */
+static int recommend_met(Pool *pool, Id rec, Queue *excludes)
 {
-    int i;
-    Id rec, *recp;
-    Id p2, pp2, p;
-    Solvable *s;
-    Queue excludes;
+    Id p, pp;
+    int i, exists = 0;
+
+    FOR_PROVIDES(p, pp, rec) {
+        exists = 1;
+        for (i = 0; i < excludes->count; i++) {
+            if (p == excludes->elements[i])
+                return 0;
+        }
+    }
+    return exists;
+}
 
+static void prepared_pool_free(void)
+{
+    if (!prepared.gen)
+        return;
+    queue_free(&prepared.excludes);
+    map_free(&prepared.considered);
+    queue_free(&prepared.promoted);
+    solver_free(prepared.solver);
+    prepared.gen = 0;
+}
+
+void opkg_solv_prepare_pool(void)
+{
     Pool *pool = opkg_solv_pool;
+    Queue excludes;
+    Solvable *s;
+    Offset req, rec, off;
+    Id p, id;
+    int i;
+
+    opkg_solv_create_whatprovides();
 
     queue_init(&excludes);
     get_excludes(&excludes);
-
-    if (!opkg_solv_pool->considered) {
-        opkg_solv_pool->considered = solv_calloc(1, sizeof(Map));
-        map_init(opkg_solv_pool->considered, opkg_solv_pool->nsolvables);
-        map_setall(opkg_solv_pool->considered);
+    if (prepared.gen == whatprovides_gen
+            && excludes.count == prepared.excludes.count
+            && memcmp(excludes.elements, prepared.excludes.elements,
+                      excludes.count * sizeof(Id)) == 0) {
+        queue_free(&excludes);
+        return;
     }
 
+    opkg_profile_begin("prepare_pool");
+    prepared_pool_free();
+    prepared.gen = whatprovides_gen;
+    prepared.excludes = excludes;
+
+    map_init(&prepared.considered, pool->nsolvables);
+    map_setall(&prepared.considered);
     for (i = 0; i < excludes.count; i++)
-        MAPCLR(pool->considered, excludes.elements[i]);
+        MAPCLR(&prepared.considered, excludes.elements[i]);
 
+    /* Adding to the arrays reallocates them, so they are indexed. */
+    queue_init(&prepared.promoted);
     FOR_POOL_SOLVABLES(p) {
-            s = pool_id2solvable(pool, p);
-            recp = s->repo->idarraydata + s->recommends;
-            while ((rec = *recp++) != 0) {           /* go through all recommends */
-                int exlude = 0;
-                int exists = 0;
-                FOR_PROVIDES(p2, pp2, rec) {
-                    exists = 1;
-                    for (i = 0; i < excludes.count; i++) {
-                        if (p2 == excludes.elements[i]) {
-                            exlude = 1;
-                            break;
-                        }
-                    }
-                    if (exlude)
-                        break;
-                }
-                if (!exlude && exists) {
-                    /* Currently libsolv doesn't respect RECOMMENDS as a strong dependency,
-                     * so we should move all RECOMMENDS to REQUIRES (DEPENDS)
-                     * Also as RECOMMENDS is not an absolute dependency we should check it
-                     * before we move it into REQUIRES */
-                    solvable_add_deparray(s, SOLVABLE_REQUIRES, rec, -SOLVABLE_PREREQMARKER);
-                }
+        s = pool_id2solvable(pool, p);
+        if (!s->recommends)
+            continue;
+
+        req = 0;
+        for (rec = s->recommends; (id = s->repo->idarraydata[rec]); rec++) {
+            if (!recommend_met(pool, id, &excludes))
+                continue;
+            /* Copy the requires to a new array first, as adding to the
+             * last one in the repo would extend it in place. The copy
+             * keeps any prerequisite marker where it was. */
+            if (!req && s->requires) {
+                for (off = s->requires; s->repo->idarraydata[off]; off++)
+                    req = repo_addid(s->repo, req, s->repo->idarraydata[off]);
             }
+            req = repo_addid_dep(s->repo, req, id, -SOLVABLE_PREREQMARKER);
         }
-    queue_free(&excludes);
+        if (req)
+            queue_push2(&prepared.promoted, p, req);
+    }
+
+    prepared.solver = solver_create(pool);
+    opkg_profile_end("prepare_pool");
 }
 
-void clear_dependencies() {
-    Id p;
-    Solvable *s;
-    Queue empty;
+static void job_swap_requires(Id p, Offset req)
+{
+    Solvable *s = pool_id2solvable(opkg_solv_pool, p);
 
-    queue_init(&empty);
+    queue_push2(&job_saved, p, s->requires);
+    s->requires = req;
+}
+
+/* Set up what the next job sees of the prepared pool. */
+static void job_begin(void)
+{
     Pool *pool = opkg_solv_pool;
-    FOR_POOL_SOLVABLES(p) {
-            s = pool_id2solvable(pool, p);
-            solvable_set_deparray(s, SOLVABLE_REQUIRES, &empty, -SOLVABLE_PREREQMARKER);
+    Solver *solv = prepared.solver;
+    Id p;
+    int i;
+
+    solver_set_flag(solv, SOLVER_FLAG_ALLOW_UNINSTALL, 1);
+    solver_set_flag(solv, SOLVER_FLAG_IGNORE_RECOMMENDED, 0);
+
+    if (opkg_config->force_depends) {
+        FOR_POOL_SOLVABLES(p) {
+            if (pool_id2solvable(pool, p)->requires)
+                job_swap_requires(p, 0);
         }
-    queue_free(&empty);
+    } else if (!opkg_config->no_install_recommends) {
+        pool->considered = &prepared.considered;
+        for (i = 0; i < prepared.promoted.count; i += 2)
+            job_swap_requires(prepared.promoted.elements[i],
+                              prepared.promoted.elements[i + 1]);
+    } else {
+        solver_set_flag(solv, SOLVER_FLAG_IGNORE_RECOMMENDED, 1);
+    }
+}
+
+/* Put back the pool as loaded. */
+static void job_end(void)
+{
+    int i;
+
+    for (i = 0; i < job_saved.count; i += 2)
+        pool_id2solvable(opkg_solv_pool, job_saved.elements[i])->requires =
+                job_saved.elements[i + 1];
+    queue_free(&job_saved);
+    opkg_solv_pool->considered = NULL;
 }
 
 void prepare_job(Queue *job) {
@@ -1219,8 +1618,9 @@ void list_files(Queue *selection)
     Queue packages;
     pkg_t *pkg;
     int i;
-    str_list_t *files;
-    str_list_elt_t *iter;
+    str_vec_t *files;
+    unsigned int iter;
+    const char *file;
 
     queue_init(&packages);
     get_packages_from_selection(selection, &packages);
@@ -1233,8 +1633,9 @@ void list_files(Queue *selection)
         printf("Package %s (%s) is installed on %s and has the following files:\n",
                 pkg->name, pkg->version, pkg->dest->name);
 
-        for (iter = str_list_first(files); iter; iter = str_list_next(files, iter))
-            printf("%s\n", (char *)iter->data);
+        iter = 0;
+        while ((file = str_vec_next(files, &iter)))
+            printf("%s\n", file);
 
         pkg_free_installed_files(pkg);
     }
@@ -1291,7 +1692,7 @@ void set_installed_packages_flag(Queue *selection, opkg_solv_mode_t mode)
             pkg->state_flag = pkg_state;
         opkg_msg(NOTICE, "Setting flags for package %s to %s.\n", pkg->name,
                 pkg_state_str);
-        pkg->dest->changed = 1;
+        pkg_write_status(pkg);
     }
     free(pkg_state_str);
     queue_free(&packages);
@@ -1318,20 +1719,141 @@ void prepare_reinstall(Queue *job)
     }
 }
 
-int opkg_solv_process(str_list_t *pkg_names, opkg_solv_mode_t mode)
+static Id solver_how(opkg_solv_mode_t mode)
 {
+    switch (mode) {
+    case MODE_INSTALL:
+        return SOLVER_INSTALL;
+    case MODE_REMOVE:
+        return SOLVER_ERASE;
+    case MODE_UPGRADE:
+        return SOLVER_UPDATE;
+    case MODE_DIST_UPGRADE:
+        return SOLVER_DISTUPGRADE;
+    case MODE_LOCK:
+        return SOLVER_LOCK;
+    default:
+        return 0;
+    }
+}
+
+/* Sets what is done to each selection in job. */
+static void job_set_how(Queue *job, Id opmode)
+{
+    int i;
+
+    for (i = 0; i < job->count; i += 2) {
+        job->elements[i] |= opmode;
+        if (opmode == SOLVER_LOCK)
+            continue;
+        if (opmode & SOLVER_UPDATE && pool_isemptyupdatejob(opkg_solv_pool, job->elements[i], job->elements[i + 1]))
+            job->elements[i] ^= SOLVER_UPDATE ^ SOLVER_INSTALL;
+        if (opkg_config->autoremove)
+            job->elements[i] |= SOLVER_CLEANDEPS;
+        if (!opkg_config->force_reinstall)
+            job->elements[i] |= SOLVER_FORCEBEST;
+    }
+
+    if (opmode & SOLVER_INSTALL && opmode != SOLVER_LOCK
+            && opkg_config->force_reinstall)
+        prepare_reinstall(job);
+}
+
+int opkg_solv_job_add(Queue *job, str_list_t *pkg_names,
+                      opkg_solv_mode_t mode)
+{
+    Id opmode = solver_how(mode);
+    Queue sel;
     int i;
+
+    if (!opmode) {
+        opkg_msg(ERROR, "Unknown mode %d.\n", mode);
+        return -1;
+    }
+
+    opkg_solv_create_whatprovides();
+
+    queue_init(&sel);
+    if (pkg_names)
+        add_pkgs(&sel, pkg_names);
+    else
+        queue_push2(&sel, SOLVER_SOLVABLE_ALL, 0);
+    if (sel.count == 0) {
+        queue_free(&sel);
+        return -1;
+    }
+
+    job_set_how(&sel, opmode);
+    for (i = 0; i < sel.count; i++)
+        queue_push(job, sel.elements[i]);
+    queue_free(&sel);
+
+    return 0;
+}
+
+int opkg_solv_solve(Queue *job, Queue *steps)
+{
+    Transaction *trans;
+    Queue held;
+    int err = 0;
+
+    queue_empty(steps);
+    opkg_solv_prepare_pool();
+    job_begin();
+
+    /* Hold locks are added to a copy, so that job can be solved again. */
+    queue_init_clone(&held, job);
+    prepare_job(&held);
+    if (solve_problems(prepared.solver, &held, 0)) {
+        err = -1;
+    } else {
+        trans = solver_create_transaction(prepared.solver);
+        transaction_steps(trans, steps);
+        transaction_free(trans);
+    }
+    queue_free(&held);
+
+    job_end();
+    return err;
+}
+
+int opkg_solv_commit(Queue *steps, opkg_progress_callback_t progress,
+                     void *user_data)
+{
+    int err = 0;
+
+    signal(SIGINT, sigint_handler);
+
+    commit_progress = progress;
+    commit_progress_data = user_data;
+
+    opkg_solv_create_whatprovides();
+
+    if (configure_old_pkgs())
+        err = -1;
+    if (steps->count == 0)
+        printf("Nothing to do.\n");
+    else if (commit_steps(steps))
+        err = -1;
+
+    if (write_all_status_files())
+        err = -1;
+    commit_progress = NULL;
+    commit_progress_data = NULL;
+
+    return err;
+}
+
+int opkg_solv_process(str_list_t *pkg_names, opkg_solv_mode_t mode)
+{
     int err = 0;
-    int opmode;
-    int count;
+    Id opmode;
 
-	Solver *solv = 0;
 	Queue job;
 
     signal(SIGINT, sigint_handler);
 
-	pool_addfileprovides(opkg_solv_pool);
-    pool_createwhatprovides(opkg_solv_pool);
+    opkg_solv_create_whatprovides();
 
     queue_init(&job);
     if (pkg_names)
@@ -1364,67 +1886,62 @@ int opkg_solv_process(str_list_t *pkg_names, opkg_solv_mode_t mode)
     }
     if ((mode >= MODE_FLAG_HOLD) && (mode <= MODE_FLAG_UNPACKED)) {
         set_installed_packages_flag(&job, mode);
-        write_all_status_files();
+        err = write_all_status_files();
         queue_free(&job);
-        return 0;
+        return err;
     }
 
-    if (mode == MODE_INSTALL)
-        opmode = SOLVER_INSTALL;
-    else if (mode == MODE_REMOVE)
-        opmode = SOLVER_ERASE;
-    else if (mode == MODE_UPGRADE)
-        opmode = SOLVER_UPDATE;
-    else if (mode == MODE_DIST_UPGRADE)
-        opmode = SOLVER_DISTUPGRADE;
-    else {
+    opmode = solver_how(mode);
+    if (!opmode || opmode == SOLVER_LOCK) {
         opkg_msg(ERROR, "Unknown mode %d.\n", mode);
         queue_free(&job);
         return -1;
     }
 
-    solv = solver_create(opkg_solv_pool);
-    solver_set_flag(solv, SOLVER_FLAG_ALLOW_UNINSTALL, 1);
-
-    if (!opkg_config->force_depends) {
-        if (!opkg_config->no_install_recommends) {
-            prepare_recommends();
-        } else {
-            solver_set_flag(solv, SOLVER_FLAG_IGNORE_RECOMMENDED, 1);
-        }
-    } else {
-        clear_dependencies();
-    }
-
-    count = job.count;
-    for (i = 0; i < count; i += 2) {
-        job.elements[i] |= opmode;
-        if (opmode & SOLVER_UPDATE && pool_isemptyupdatejob(opkg_solv_pool, job.elements[i], job.elements[i + 1]))
-            job.elements[i] ^= SOLVER_UPDATE ^ SOLVER_INSTALL;
-        if (opkg_config->autoremove)
-            job.elements[i] |= SOLVER_CLEANDEPS;
-        if (!opkg_config->force_reinstall)
-            job.elements[i] |= SOLVER_FORCEBEST;
-    }
-
-    if (opmode & SOLVER_INSTALL && opkg_config->force_reinstall)
-        prepare_reinstall(&job);
+    opkg_solv_prepare_pool();
+    job_begin();
 
+    job_set_how(&job, opmode);
     prepare_job(&job);
 
-    if (configure_old_pkgs())
+    /* Writing a plan leaves the system as it is. */
+    if (!opkg_config->plan_out && configure_old_pkgs())
         err = -1;
-	if (process_job(solv, &job))
+	if (process_job(prepared.solver, &job))
 		err = -1;
+    job_end();
 
-    write_all_status_files();
+    if (write_all_status_files())
+        err = -1;
 
-    solver_free(solv);
     queue_free(&job);
 
     return err;
 }
 
+int opkg_solv_apply_plan(const char *file_name)
+{
+    Queue steps;
+    int err = 0;
+
+    signal(SIGINT, sigint_handler);
+
+    queue_init(&steps);
+    opkg_profile_begin("read_plan");
+    if (opkg_plan_read(file_name, &steps))
+        err = -1;
+    opkg_profile_end("read_plan");
+    if (err) {
+        queue_free(&steps);
+        return err;
+    }
+
+    err = opkg_solv_commit(&steps, NULL, NULL);
+    queue_free(&steps);
+
+    return err;
+}
+
 opkg_solv_mode_t opkg_solv_mode_from_flag_str(const char *str)
 {
     typedef struct {
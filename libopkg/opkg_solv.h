@@ -19,7 +19,10 @@
 #ifndef OPKG_SOLV_H
 #define OPKG_SOLV_H
 
+#include <solv/queue.h>
+
 #include "str_list.h"
+#include "pkg_vec.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -41,13 +44,68 @@ typedef enum {
     MODE_FLAG_USER,
     MODE_FLAG_OK,
     MODE_FLAG_INSTALLED,
-    MODE_FLAG_UNPACKED
+    MODE_FLAG_UNPACKED,
+    MODE_LOCK
 } opkg_solv_mode_t;
 
+typedef struct _opkg_progress_data_t opkg_progress_data_t;
+
+typedef void (*opkg_progress_callback_t) (const opkg_progress_data_t *
+                                          progress, void *user_data);
+
+enum _opkg_action_t {
+    OPKG_INSTALL,
+    OPKG_REMOVE,
+    OPKG_DOWNLOAD
+};
+
+struct _opkg_progress_data_t {
+    int percentage;
+    int action;
+    pkg_t *pkg;
+};
+
+extern pkg_vec_t *opkg_solv_pkgs;
+
 void opkg_solv_init();
 void opkg_solv_add_arch(const char *arch, int priority);
 void opkg_solv_prepare();
+int opkg_solv_load_feeds(void);
+int opkg_solv_load_status_files(void);
+int opkg_solv_status_loaded(void);
+int opkg_solv_load_file_owners(void);
+/* Indexes what each package provides, unless that has already been done
+ * since the last repo was added, as it is in a daemon which serves many
+ * requests from the same pool.
+ */
+void opkg_solv_create_whatprovides(void);
+/* Prepares the pool for solving jobs, on top of the whatprovides index,
+ * unless that has already been done for the same index and excludes.
+ * opkg_solv_process() runs each job over what this prepared and then puts
+ * the pool back as it was, so consecutive jobs share the preparation.
+ */
+void opkg_solv_prepare_pool(void);
 int opkg_solv_process(str_list_t *pkg_names, opkg_solv_mode_t mode);
+/* Adds the packages matching pkg_names, or all of them if it is NULL, to
+ * job, to be installed, removed, upgraded or kept as they are by mode.
+ * Returns -1 if nothing matches.
+ */
+int opkg_solv_job_add(Queue *job, str_list_t *pkg_names,
+                      opkg_solv_mode_t mode);
+/* Solves job over the prepared pool, without asking about problems or
+ * committing anything, and takes the steps of the transaction as (type, p,
+ * obs) triples in the order they would be committed. Returns -1 if job
+ * has problems, which are printed.
+ */
+int opkg_solv_solve(Queue *job, Queue *steps);
+/* Commits steps, downloading every package first and writing the status
+ * files once at the end. progress, if given, is told about each package
+ * as it is downloaded, installed or removed.
+ */
+int opkg_solv_commit(Queue *steps, opkg_progress_callback_t progress,
+                     void *user_data);
+/* Commits the transaction written by --plan-out to file_name. */
+int opkg_solv_apply_plan(const char *file_name);
 opkg_solv_mode_t opkg_solv_mode_from_flag_str(const char *str);
 
 #ifdef __cplusplus
@@ -0,0 +1,134 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_transaction.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+
+#include <solv/queue.h>
+#include <solv/transaction.h>
+
+#include "opkg_message.h"
+#include "opkg_solv.h"
+#include "opkg_transaction.h"
+#include "str_list.h"
+#include "xfuncs.h"
+
+struct opkg_transaction {
+    Queue job;
+    Queue steps;
+    int solved;
+};
+
+opkg_transaction_t *opkg_transaction_new(void)
+{
+    opkg_transaction_t *trans = xcalloc(1, sizeof(*trans));
+
+    queue_init(&trans->job);
+    queue_init(&trans->steps);
+    return trans;
+}
+
+void opkg_transaction_free(opkg_transaction_t * trans)
+{
+    if (!trans)
+        return;
+    queue_free(&trans->job);
+    queue_free(&trans->steps);
+    free(trans);
+}
+
+int opkg_transaction_add(opkg_transaction_t * trans, opkg_transaction_op_t op,
+                         const char *name)
+{
+    static const opkg_solv_mode_t modes[] = {
+        [OPKG_TRANSACTION_INSTALL] = MODE_INSTALL,
+        [OPKG_TRANSACTION_REMOVE] = MODE_REMOVE,
+        [OPKG_TRANSACTION_UPGRADE] = MODE_UPGRADE,
+        [OPKG_TRANSACTION_LOCK] = MODE_LOCK,
+    };
+    str_list_t names;
+    int r;
+
+    if ((unsigned int)op >= sizeof(modes) / sizeof(modes[0])) {
+        opkg_msg(ERROR, "Unknown transaction operation %d.\n", op);
+        return -1;
+    }
+
+    str_list_init(&names);
+    str_list_append(&names, (char *)name);
+    r = opkg_solv_job_add(&trans->job, &names, modes[op]);
+    str_list_deinit(&names);
+
+    trans->solved = 0;
+    queue_empty(&trans->steps);
+    return r;
+}
+
+int opkg_transaction_solve(opkg_transaction_t * trans)
+{
+    if (opkg_solv_solve(&trans->job, &trans->steps) < 0)
+        return -1;
+    trans->solved = 1;
+    return 0;
+}
+
+unsigned int opkg_transaction_step_count(opkg_transaction_t * trans)
+{
+    return trans->steps.count / 3;
+}
+
+int opkg_transaction_get_step(opkg_transaction_t * trans, unsigned int i,
+                              opkg_transaction_step_t * step)
+{
+    Id type, p, obs;
+
+    if (i >= opkg_transaction_step_count(trans))
+        return -1;
+
+    type = trans->steps.elements[3 * i];
+    p = trans->steps.elements[3 * i + 1];
+    obs = trans->steps.elements[3 * i + 2];
+
+    /* In an upgrade, p is the installed version and obs replaces it. */
+    step->replaces = NULL;
+    if (obs) {
+        step->action = OPKG_INSTALL;
+        step->pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, obs);
+        step->replaces = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, p);
+    } else {
+        step->action = type == SOLVER_TRANSACTION_ERASE ? OPKG_REMOVE
+                : OPKG_INSTALL;
+        step->pkg = pkg_vec_get_pkg_by_id(opkg_solv_pkgs, p);
+    }
+
+    return 0;
+}
+
+int opkg_transaction_commit(opkg_transaction_t * trans,
+                            opkg_progress_callback_t callback,
+                            void *user_data)
+{
+    int err;
+
+    if (!trans->solved && opkg_transaction_solve(trans) < 0)
+        return -1;
+
+    err = opkg_solv_commit(&trans->steps, callback, user_data);
+
+    /* The pool no longer matches the plan. */
+    trans->solved = 0;
+    queue_empty(&trans->steps);
+    return err;
+}
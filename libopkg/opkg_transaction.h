@@ -0,0 +1,77 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_transaction.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_TRANSACTION_H
+#define OPKG_TRANSACTION_H
+
+#include "pkg.h"
+#include "opkg_solv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Several operations solved together and committed as one: a single solve,
+ * a single download stage and a single write of the status files, however
+ * many packages are involved. The feeds and status files must have been
+ * loaded, and the lock taken, as for an opkg command.
+ */
+typedef struct opkg_transaction opkg_transaction_t;
+
+typedef enum {
+    OPKG_TRANSACTION_INSTALL,
+    OPKG_TRANSACTION_REMOVE,
+    OPKG_TRANSACTION_UPGRADE,
+    /* Keep the package as it is, installed or not. */
+    OPKG_TRANSACTION_LOCK
+} opkg_transaction_op_t;
+
+typedef struct {
+    int action;                 /* OPKG_INSTALL or OPKG_REMOVE */
+    pkg_t *pkg;
+    pkg_t *replaces;            /* the version pkg upgrades, or NULL */
+} opkg_transaction_step_t;
+
+opkg_transaction_t *opkg_transaction_new(void);
+void opkg_transaction_free(opkg_transaction_t * trans);
+
+/* Adds op on the packages matching name, which may be a glob, or for an
+ * install the path or URL of a package file. Returns -1 if nothing
+ * matches.
+ */
+int opkg_transaction_add(opkg_transaction_t * trans, opkg_transaction_op_t op,
+                         const char *name);
+
+/* Solves every operation added so far. Returns -1 if they can't all be
+ * done, printing the problems.
+ */
+int opkg_transaction_solve(opkg_transaction_t * trans);
+
+/* The plan, once solved, in the order it would be committed. */
+unsigned int opkg_transaction_step_count(opkg_transaction_t * trans);
+int opkg_transaction_get_step(opkg_transaction_t * trans, unsigned int i,
+                              opkg_transaction_step_t * step);
+
+/* Commits the plan, solving first if that hasn't been done since the last
+ * operation was added. callback, if given, is told about each package as
+ * it is downloaded, installed or removed.
+ */
+int opkg_transaction_commit(opkg_transaction_t * trans,
+                            opkg_progress_callback_t callback,
+                            void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_TRANSACTION_H */
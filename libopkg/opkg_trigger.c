@@ -0,0 +1,407 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_trigger.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* Deferred triggers.
+ *
+ * A package says what it is interested in with a "triggers" control file,
+ * kept as <pkg>.triggers in the info dir of its dest, made of lines of:
+ *
+ *     interest <path or name>
+ *     activate <name>
+ *
+ * An interest in an absolute path is activated when any package installs
+ * or removes a file at or below that path. Any other name is activated by
+ * a package which declares "activate <name>" being installed or removed,
+ * or by a maintainer script running "opkg-trigger <name>" while packages
+ * are configured. Once every package is configured, the postinst of each
+ * package with activated interests is run once, as
+ *
+ *     postinst triggered "<name> <name> ..."
+ *
+ * so that caches and the like are rebuilt once per transaction rather
+ * than once per package.
+ */
+
+#include "config.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opkg_trigger.h"
+#include "hash_table.h"
+#include "opkg_message.h"
+#include "opkg_profile.h"
+#include "opkg_solv.h"
+#include "sprintf_alloc.h"
+#include "str_vec.h"
+#include "xfuncs.h"
+
+#define TRIGGERS_SUFFIX ".triggers"
+
+/* Files installed or removed, without any offline root. */
+static str_vec_t files;
+/* The same files sorted, once they are all known, to match interests. */
+static const char **sorted_files;
+static unsigned int n_sorted_files;
+/* Named triggers activated. */
+static str_vec_t events;
+
+typedef void (*trigger_line_fn) (const char *directive, const char *arg,
+                                 void *data);
+
+static void read_triggers(const char *path, trigger_line_fn fn, void *data)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t line_size = 0;
+    char *directive, *arg, *save;
+
+    fp = fopen(path, "r");
+    if (!fp)
+        return;
+
+    while (getline(&line, &line_size, fp) != -1) {
+        directive = strtok_r(line, " \t\r\n", &save);
+        if (!directive || directive[0] == '#')
+            continue;
+        arg = strtok_r(NULL, " \t\r\n", &save);
+        if (!arg) {
+            opkg_msg(ERROR, "%s: '%s' needs an argument.\n", path, directive);
+            continue;
+        }
+        fn(directive, arg, data);
+    }
+
+    free(line);
+    fclose(fp);
+}
+
+static char *triggers_file_alloc(pkg_t * pkg)
+{
+    char *path;
+
+    sprintf_alloc(&path, "%s/%s%s", pkg->dest->info_dir, pkg->name,
+                  TRIGGERS_SUFFIX);
+    return path;
+}
+
+void opkg_trigger_activate(const char *name)
+{
+    if (!str_vec_contains(&events, name)) {
+        opkg_msg(DEBUG, "Activated trigger %s.\n", name);
+        str_vec_append(&events, name);
+    }
+}
+
+static void note_activate(const char *directive, const char *arg, void *data)
+{
+    if (strcmp(directive, "activate") == 0)
+        opkg_trigger_activate(arg);
+}
+
+void opkg_trigger_note_activates(pkg_t * pkg)
+{
+    char *path;
+
+    if (!pkg->dest)
+        return;
+
+    path = triggers_file_alloc(pkg);
+    read_triggers(path, note_activate, NULL);
+    free(path);
+}
+
+void opkg_trigger_note_file(const char *file_name)
+{
+    size_t len;
+
+    if (opkg_config->offline_root) {
+        len = strlen(opkg_config->offline_root);
+        if (strncmp(file_name, opkg_config->offline_root, len) == 0)
+            file_name += len;
+    }
+
+    str_vec_append(&files, file_name);
+}
+
+void opkg_trigger_read_activations(const char *file_name)
+{
+    FILE *fp;
+    char *line = NULL;
+    size_t line_size = 0;
+    char *name, *save;
+
+    fp = fopen(file_name, "r");
+    if (!fp)
+        return;
+
+    while (getline(&line, &line_size, fp) != -1) {
+        for (name = strtok_r(line, " \t\r\n", &save); name;
+                name = strtok_r(NULL, " \t\r\n", &save))
+            opkg_trigger_activate(name);
+    }
+
+    free(line);
+    fclose(fp);
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+static void sort_files(void)
+{
+    const char *file_name;
+    unsigned int iter = 0;
+
+    sorted_files = xcalloc(str_vec_count(&files) + 1, sizeof(*sorted_files));
+    n_sorted_files = 0;
+    while ((file_name = str_vec_next(&files, &iter)))
+        sorted_files[n_sorted_files++] = file_name;
+    qsort(sorted_files, n_sorted_files, sizeof(*sorted_files), compare_paths);
+}
+
+/* Index of the first sorted file whose first len bytes don't sort before
+ * prefix.
+ */
+static unsigned int files_lower_bound(const char *prefix, size_t len)
+{
+    unsigned int lo = 0, hi = n_sorted_files, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strncmp(sorted_files[mid], prefix, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static int interest_activated(const char *interest)
+{
+    size_t len;
+    unsigned int i;
+    char *dir;
+    int found;
+
+    if (interest[0] != '/')
+        return str_vec_contains(&events, interest);
+
+    len = strlen(interest);
+    while (len > 1 && interest[len - 1] == '/')
+        len--;
+
+    /* Everything is below the root. */
+    if (len == 1)
+        return n_sorted_files > 0;
+
+    /* The path itself sorts first of those it is a prefix of. */
+    i = files_lower_bound(interest, len);
+    if (i < n_sorted_files && strncmp(sorted_files[i], interest, len) == 0
+            && sorted_files[i][len] == '\0')
+        return 1;
+
+    sprintf_alloc(&dir, "%.*s/", (int)len, interest);
+    i = files_lower_bound(dir, len + 1);
+    found = i < n_sorted_files && strncmp(sorted_files[i], dir, len + 1) == 0;
+    free(dir);
+    return found;
+}
+
+struct trigger_hits {
+    char *names;
+};
+
+static void note_interest(const char *directive, const char *arg, void *data)
+{
+    struct trigger_hits *hits = data;
+    char *names;
+
+    if (strcmp(directive, "interest") != 0 || !interest_activated(arg))
+        return;
+
+    if (hits->names) {
+        sprintf_alloc(&names, "%s %s", hits->names, arg);
+        free(hits->names);
+        hits->names = names;
+    } else {
+        hits->names = xstrdup(arg);
+    }
+}
+
+/* Installed packages, keyed on "<dest name>/<pkg name>". */
+static hash_table_t installed_pkgs;
+
+static void index_installed_pkgs(void)
+{
+    unsigned int i;
+    pkg_t *pkg;
+    char *key;
+
+    hash_table_init("trigger-pkgs", &installed_pkgs, opkg_solv_pkgs->len + 1);
+    for (i = 0; i < opkg_solv_pkgs->len; i++) {
+        pkg = opkg_solv_pkgs->pkgs[i];
+        if (!pkg->dest || pkg->state_status == SS_NOT_INSTALLED)
+            continue;
+        sprintf_alloc(&key, "%s/%s", pkg->dest->name, pkg->name);
+        if (!hash_table_get(&installed_pkgs, key))
+            hash_table_insert(&installed_pkgs, key, pkg);
+        free(key);
+    }
+}
+
+/* The package called name installed in dest, if there is one. */
+static pkg_t *find_installed_pkg(pkg_dest_t * dest, const char *name)
+{
+    pkg_t *pkg;
+    char *key;
+
+    sprintf_alloc(&key, "%s/%s", dest->name, name);
+    pkg = hash_table_get(&installed_pkgs, key);
+    free(key);
+    return pkg;
+}
+
+/* The arguments for the postinst, with the names quoted as one word for the
+ * shell that runs it.
+ */
+static char *triggered_args_alloc(const char *names)
+{
+    char *args, *p;
+    const char *q;
+
+    /* Each quote becomes '\'' and the whole is wrapped in another pair. */
+    args = xmalloc(strlen("triggered ''") + 4 * strlen(names) + 1);
+    p = args + sprintf(args, "triggered '");
+    for (q = names; *q; q++) {
+        if (*q == '\'') {
+            memcpy(p, "'\\''", 4);
+            p += 4;
+        } else {
+            *p++ = *q;
+        }
+    }
+    strcpy(p, "'");
+    return args;
+}
+
+static int is_triggers_file(const struct dirent *de)
+{
+    size_t len = strlen(de->d_name);
+    size_t suffix_len = strlen(TRIGGERS_SUFFIX);
+
+    return len > suffix_len
+            && strcmp(de->d_name + len - suffix_len, TRIGGERS_SUFFIX) == 0;
+}
+
+static int run_dest_triggers(pkg_dest_t * dest)
+{
+    struct dirent **entries;
+    struct trigger_hits hits;
+    char *path, *args, *pkg_name;
+    pkg_t *pkg;
+    int i, n, r, err = 0;
+
+    n = scandir(dest->info_dir, &entries, is_triggers_file, alphasort);
+    if (n == -1)
+        return 0;
+
+    for (i = 0; i < n; i++) {
+        hits.names = NULL;
+        sprintf_alloc(&path, "%s/%s", dest->info_dir, entries[i]->d_name);
+        read_triggers(path, note_interest, &hits);
+        free(path);
+
+        if (!hits.names)
+            goto next;
+
+        pkg_name = xstrndup(entries[i]->d_name,
+                            strlen(entries[i]->d_name) - strlen(TRIGGERS_SUFFIX));
+        pkg = find_installed_pkg(dest, pkg_name);
+
+        if (!pkg) {
+            opkg_msg(INFO, "Ignoring triggers of %s, which isn't installed.\n",
+                     pkg_name);
+            goto done;
+        }
+
+        /* A package whose postinst failed is left unpacked, and isn't in a
+         * state to be triggered until it has been configured.
+         */
+        if (pkg->state_status != SS_INSTALLED) {
+            opkg_msg(NOTICE, "Not processing triggers for unconfigured "
+                     "package %s.\n", pkg_name);
+            goto done;
+        }
+
+        opkg_msg(NOTICE, "Processing triggers for %s: %s.\n", pkg_name,
+                 hits.names);
+        args = triggered_args_alloc(hits.names);
+        r = pkg_run_script(pkg, "postinst", args);
+        free(args);
+        opkg_profile_count("triggers_run", 1);
+        if (r) {
+            opkg_msg(ERROR, "%s.postinst triggered returned %d.\n",
+                     pkg_name, r);
+            err = -1;
+        }
+
+ done:
+        free(pkg_name);
+        free(hits.names);
+ next:
+        free(entries[i]);
+    }
+    free(entries);
+
+    return err;
+}
+
+int opkg_trigger_run(void)
+{
+    pkg_dest_list_elt_t *iter;
+    int err = 0;
+
+    if (str_vec_count(&files) == 0 && str_vec_count(&events) == 0)
+        return 0;
+
+    if (opkg_config->noaction
+            || (opkg_config->offline_root && !opkg_config->force_postinstall)) {
+        opkg_msg(INFO, "Not running triggers.\n");
+        goto out;
+    }
+
+    opkg_profile_begin("triggers");
+    sort_files();
+    index_installed_pkgs();
+    for (iter = void_list_first(&opkg_config->pkg_dest_list); iter;
+            iter = void_list_next(&opkg_config->pkg_dest_list, iter)) {
+        if (run_dest_triggers((pkg_dest_t *) iter->data))
+            err = -1;
+    }
+    hash_table_deinit(&installed_pkgs);
+    opkg_profile_end("triggers");
+
+ out:
+    free(sorted_files);
+    sorted_files = NULL;
+    n_sorted_files = 0;
+    str_vec_deinit(&files);
+    str_vec_deinit(&events);
+    return err;
+}
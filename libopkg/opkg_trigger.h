@@ -0,0 +1,46 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_trigger.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_TRIGGER_H
+#define OPKG_TRIGGER_H
+
+#include "pkg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Name of the file in the intercept dir to which opkg-trigger appends. */
+#define OPKG_TRIGGER_INTERCEPT_FILE ".triggers"
+
+/* Records the "activate" triggers of pkg, which is being installed or
+ * removed.
+ */
+void opkg_trigger_note_activates(pkg_t * pkg);
+/* Records that file_name was installed or removed. */
+void opkg_trigger_note_file(const char *file_name);
+/* Records an activation of the named trigger. */
+void opkg_trigger_activate(const char *name);
+/* Records the triggers named in file_name, one per line. */
+void opkg_trigger_read_activations(const char *file_name);
+
+/* Runs the postinst of each package interested in what was recorded,
+ * once, and forgets the activations.
+ */
+int opkg_trigger_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_TRIGGER_H */
@@ -16,13 +16,24 @@
 
 #include "config.h"
 
+#include <errno.h>
+#include <fnmatch.h>
 #include <malloc.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#include <solv/knownid.h>
 
 #include "file_util.h"
 #include "opkg_conf.h"
+#include "opkg_digest_cache.h"
 #include "opkg_message.h"
+#include "opkg_solv.h"
 #include "opkg_verify.h"
+#include "pkg.h"
+#include "pkg_vec.h"
+#include "xfuncs.h"
 
 #ifdef HAVE_GPGME
 #include "opkg_gpg.h"
@@ -108,3 +119,167 @@ int opkg_verify_signature(const char *file, const char *sigfile)
              opkg_config->signature_type);
     return -1;
 }
+
+static int pkg_name_matches(const pkg_t * pkg, str_list_t * patterns)
+{
+    str_list_elt_t *iter;
+
+    if (!patterns)
+        return 1;
+
+    for (iter = str_list_first(patterns); iter;
+            iter = str_list_next(patterns, iter)) {
+        if (fnmatch(iter->data, pkg->name, 0) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+struct conffile_check {
+    pkg_t *pkg;
+    conffile_t *cf;
+    char *file_name;
+    char *md5sum;
+    int unhashed;               /* missing, or nothing to compare with */
+};
+
+static void print_result(const char *result, const pkg_t * pkg,
+                         const char *file_name)
+{
+    printf("%s\t%s\t%s\n", result, pkg->name, file_name);
+}
+
+/* Check the installed packages whose names match any of patterns, or all of
+ * them if patterns is NULL, against what their file lists and conffile
+ * md5sums say should be on disk.
+ *
+ * Each problem is printed as a "<result>\t<package>\t<file>" line, where
+ * result is "missing" or "modified"; with -V2 files which are fine are
+ * printed as "ok" too. If conffiles_only is set, only the names of modified
+ * conffiles are printed, one per line.
+ *
+ * Conffiles are hashed through the digest cache, by a worker per processor.
+ * The file lists record no size, mode or digest for other files, so those
+ * are only checked for presence.
+ *
+ * Returns 0 if everything matched, 1 if a problem was found, or -1 on
+ * error.
+ */
+int opkg_verify_installed(str_list_t * patterns, int conffiles_only)
+{
+    pkg_vec_t *pkgs;
+    struct conffile_check *checks = NULL;
+    const char **file_names;
+    char **md5sums;
+    unsigned int i, j, n, n_checks = 0, n_alloc = 0;
+    conffile_list_elt_t *iter;
+    str_vec_t *files;
+    const char *file;
+    unsigned int fiter;
+    struct stat st;
+    int problems = 0;
+
+    pkgs = pkg_vec_alloc();
+    for (i = 0; i < opkg_solv_pkgs->len; i++) {
+        pkg_t *pkg = opkg_solv_pkgs->pkgs[i];
+        int is_installed = pkg->state_status == SS_INSTALLED
+                || pkg->state_status == SS_UNPACKED;
+        if (is_installed && pkg_name_matches(pkg, patterns))
+            pkg_vec_insert(pkgs, pkg);
+    }
+    pkg_vec_sort(pkgs, pkg_compare_names);
+
+    /* Hash every conffile up front, so that the workers have plenty to do. */
+    for (i = 0; i < pkgs->len; i++) {
+        pkg_t *pkg = pkgs->pkgs[i];
+
+        for (iter = nv_pair_list_first(&pkg->conffiles); iter;
+                iter = nv_pair_list_next(&pkg->conffiles, iter)) {
+            conffile_t *cf = (conffile_t *) iter->data;
+            char *file_name;
+            int unhashed;
+
+            if (!cf->name)
+                continue;
+            file_name = root_filename_alloc(cf->name);
+            unhashed = !cf->value || stat(file_name, &st) == -1
+                    || !S_ISREG(st.st_mode);
+            /* Reported as missing with the rest of the files, but when
+             * listing changed conffiles they count as modified.
+             */
+            if (unhashed && !conffiles_only) {
+                free(file_name);
+                continue;
+            }
+
+            if (n_checks == n_alloc) {
+                n_alloc = n_alloc ? n_alloc * 2 : 64;
+                checks = xrealloc(checks, n_alloc * sizeof(*checks));
+            }
+            checks[n_checks].pkg = pkg;
+            checks[n_checks].cf = cf;
+            checks[n_checks].file_name = file_name;
+            checks[n_checks].md5sum = NULL;
+            checks[n_checks].unhashed = unhashed;
+            n_checks++;
+        }
+    }
+
+    file_names = xcalloc(n_checks + 1, sizeof(char *));
+    md5sums = xcalloc(n_checks + 1, sizeof(char *));
+    for (i = 0, n = 0; i < n_checks; i++) {
+        if (!checks[i].unhashed)
+            file_names[n++] = checks[i].file_name;
+    }
+    opkg_digest_cache_files_alloc(file_names, n, REPOKEY_TYPE_MD5, md5sums);
+    for (i = 0, n = 0; i < n_checks; i++) {
+        if (!checks[i].unhashed)
+            checks[i].md5sum = md5sums[n++];
+    }
+    free(file_names);
+    free(md5sums);
+
+    for (i = 0, j = 0; i < pkgs->len; i++) {
+        pkg_t *pkg = pkgs->pkgs[i];
+
+        if (!conffiles_only) {
+            files = pkg_get_installed_files(pkg);
+            fiter = 0;
+            while ((file = str_vec_next(files, &fiter))) {
+                if (lstat(file, &st) == -1) {
+                    print_result("missing", pkg, file);
+                    problems = 1;
+                } else if (opkg_config->verbosity >= INFO) {
+                    print_result("ok", pkg, file);
+                }
+            }
+            pkg_free_installed_files(pkg);
+            arena_reset(&opkg_config->scratch);
+        }
+
+        for (; j < n_checks && checks[j].pkg == pkg; j++) {
+            struct conffile_check *c = &checks[j];
+            int modified = !c->md5sum || strcmp(c->md5sum, c->cf->value);
+
+            if (modified)
+                problems = 1;
+            if (conffiles_only) {
+                if (modified)
+                    printf("%s\n", c->cf->name);
+            } else if (modified) {
+                print_result("modified", pkg, c->file_name);
+            } else if (opkg_config->verbosity >= INFO) {
+                print_result("ok", pkg, c->file_name);
+            }
+        }
+    }
+
+    for (i = 0; i < n_checks; i++) {
+        free(checks[i].file_name);
+        free(checks[i].md5sum);
+    }
+    free(checks);
+    pkg_vec_free(pkgs);
+
+    return problems;
+}
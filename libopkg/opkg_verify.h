@@ -17,6 +17,8 @@
 #ifndef OPKG_VERIFY_H
 #define OPKG_VERIFY_H
 
+#include "str_list.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,6 +26,7 @@ extern "C" {
 int opkg_verify_md5sum(const char *file, const char *md5sum);
 int opkg_verify_sha256sum(const char *file, const char *sha256sum);
 int opkg_verify_signature(const char *file, const char *sigfile);
+int opkg_verify_installed(str_list_t * patterns, int conffiles_only);
 
 #ifdef __cplusplus
 }
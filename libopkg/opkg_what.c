@@ -0,0 +1,383 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_what.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* The what* queries, answered from the pool.
+ *
+ * What provides a name is looked up in the pool's whatprovides index. The
+ * reverse direction, what depends on or replaces a name, is answered from
+ * an index built once per query from the dependencies of every package
+ * considered, which lists each dependency under every name it mentions.
+ * A package's dependents are then those listed under the names it provides
+ * whose dependency it actually satisfies, and the recursive query visits
+ * each package once however many paths lead to it.
+ */
+
+#include "config.h"
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include <solv/pool.h>
+#include <solv/poolid.h>
+#include <solv/repo.h>
+#include <solv/bitmap.h>
+#include <solv/queue.h>
+#include <solv/util.h>
+
+#include "opkg_conf.h"
+#include "opkg_message.h"
+#include "opkg_solv.h"
+#include "opkg_what.h"
+
+extern Pool *opkg_solv_pool;
+
+#define GLOB_CHARS "*?[\\"
+
+/* The dependencies of type, listed under each name they mention. Those
+ * under name n are the (solvable, dep) pairs from entries[2 * start[n]] up
+ * to entries[2 * start[n + 1]].
+ */
+struct rdep_index {
+    Id n_names;
+    Offset *start;
+    Id *entries;
+};
+
+static int is_candidate(Pool * pool, Id p)
+{
+    Solvable *s = pool_id2solvable(pool, p);
+
+    if (!s->repo)
+        return 0;
+    return opkg_config->query_all || s->repo == pool->installed;
+}
+
+static Offset dep_field(Solvable * s, enum what_field_type type)
+{
+    switch (type) {
+    case WHATDEPENDS:
+        return s->requires;
+    case WHATRECOMMENDS:
+        return s->recommends;
+    case WHATSUGGESTS:
+        return s->suggests;
+    case WHATCONFLICTS:
+        return s->conflicts;
+    case WHATREPLACES:
+        /* repo_deb reads Replaces into the obsoletes. */
+        return s->obsoletes;
+    default:
+        return 0;
+    }
+}
+
+static const char *rel_str(enum what_field_type type)
+{
+    switch (type) {
+    case WHATDEPENDS:
+        return "depends on";
+    case WHATRECOMMENDS:
+        return "recommends";
+    case WHATSUGGESTS:
+        return "suggests";
+    case WHATCONFLICTS:
+        return "conflicts with";
+    case WHATPROVIDES:
+        return "provides";
+    case WHATREPLACES:
+        return "replaces";
+    }
+    return NULL;
+}
+
+/* Push the names mentioned by dep, which may be a version constraint on a
+ * name or alternatives joined by '|'.
+ */
+static void dep_names(Pool * pool, Id dep, Queue * names)
+{
+    Reldep *rd;
+
+    while (ISRELDEP(dep)) {
+        rd = GETRELDEP(pool, dep);
+        if (rd->flags == REL_AND || rd->flags == REL_OR
+                || rd->flags == REL_WITH || rd->flags == REL_COND
+                || rd->flags == REL_UNLESS)
+            dep_names(pool, rd->evr, names);
+        dep = rd->name;
+    }
+    queue_push(names, dep);
+}
+
+static void rdep_index_build(struct rdep_index *idx, Pool * pool,
+                             enum what_field_type type)
+{
+    Queue names;
+    Solvable *s;
+    Offset off;
+    Id p, n, dep, *dp;
+    int pass, i;
+
+    idx->n_names = pool->ss.nstrings;
+    idx->start = solv_calloc(idx->n_names + 1, sizeof(Offset));
+    idx->entries = NULL;
+
+    /* Count the entries under each name, then fill them in. */
+    queue_init(&names);
+    for (pass = 0; pass < 2; pass++) {
+        FOR_POOL_SOLVABLES(p) {
+            s = pool_id2solvable(pool, p);
+            off = dep_field(s, type);
+            if (!off || !is_candidate(pool, p))
+                continue;
+            for (dp = s->repo->idarraydata + off; (dep = *dp) != 0; dp++) {
+                if (dep == SOLVABLE_PREREQMARKER)
+                    continue;
+                queue_empty(&names);
+                dep_names(pool, dep, &names);
+                for (i = 0; i < names.count; i++) {
+                    n = names.elements[i];
+                    if (n <= 0 || n >= idx->n_names)
+                        continue;
+                    if (pass == 0) {
+                        idx->start[n + 1]++;
+                    } else {
+                        idx->entries[2 * idx->start[n]] = p;
+                        idx->entries[2 * idx->start[n] + 1] = dep;
+                        idx->start[n]++;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (n = 0; n < idx->n_names; n++)
+                idx->start[n + 1] += idx->start[n];
+            idx->entries = solv_calloc(2 * idx->start[idx->n_names] + 1,
+                                       sizeof(Id));
+        }
+    }
+    queue_free(&names);
+
+    /* Filling moved each start along to the next name's. */
+    for (n = idx->n_names; n > 0; n--)
+        idx->start[n] = idx->start[n - 1];
+    idx->start[0] = 0;
+}
+
+static void rdep_index_free(struct rdep_index *idx)
+{
+    solv_free(idx->start);
+    solv_free(idx->entries);
+}
+
+static int dep_provided_by(Pool * pool, Id dep, Id p)
+{
+    Id p2, pp2;
+
+    FOR_PROVIDES(p2, pp2, dep) {
+        if (p2 == p)
+            return 1;
+    }
+    return 0;
+}
+
+/* Push the ids of the names matching pattern which something provides. */
+static void match_names(Pool * pool, const char *pattern, Queue * names)
+{
+    Id n;
+
+    if (strpbrk(pattern, GLOB_CHARS) == NULL) {
+        n = pool_str2id(pool, pattern, 0);
+        if (n)
+            queue_push(names, n);
+        return;
+    }
+
+    for (n = 1; n < pool->ss.nstrings; n++) {
+        if (fnmatch(pattern, pool_id2str(pool, n), 0) == 0
+                && *pool_whatprovides_ptr(pool, n) != 0)
+            queue_push(names, n);
+    }
+}
+
+/* Add the packages considered whose names match pattern to roots. */
+static void find_roots(Pool * pool, const char *pattern, Queue * roots,
+                       Map * seen)
+{
+    Queue names;
+    Solvable *s;
+    Id p, pp;
+    int i;
+
+    queue_init(&names);
+    match_names(pool, pattern, &names);
+    for (i = 0; i < names.count; i++) {
+        FOR_PROVIDES(p, pp, names.elements[i]) {
+            s = pool_id2solvable(pool, p);
+            if (s->name != names.elements[i] || MAPTST(seen, p)
+                    || !is_candidate(pool, p))
+                continue;
+            MAPSET(seen, p);
+            queue_push(roots, p);
+            opkg_msg(NOTICE, "  %s\n", pool_id2str(pool, s->name));
+        }
+    }
+    queue_free(&names);
+}
+
+/* Push the names p provides, its own included. */
+static void provided_names(Pool * pool, Id p, Queue * names)
+{
+    Solvable *s = pool_id2solvable(pool, p);
+    Id *dp;
+
+    queue_push(names, s->name);
+    if (!s->provides)
+        return;
+    for (dp = s->repo->idarraydata + s->provides; *dp; dp++)
+        dep_names(pool, *dp, names);
+}
+
+int opkg_what_depends(enum what_field_type type, int recursive, int argc,
+                      const char **patterns)
+{
+    Pool *pool = opkg_solv_pool;
+    struct rdep_index idx;
+    Queue todo, names;
+    Map seen;
+    Solvable *s;
+    Id r, n, p, dep;
+    Offset e;
+    int i, j;
+
+    opkg_solv_create_whatprovides();
+    rdep_index_build(&idx, pool, type);
+
+    map_init(&seen, pool->nsolvables);
+    queue_init(&todo);
+    queue_init(&names);
+
+    opkg_msg(NOTICE, "Root set:\n");
+    for (i = 0; i < argc; i++)
+        find_roots(pool, patterns[i], &todo, &seen);
+
+    /* Without recursion, only the root set is ever in todo. */
+    opkg_msg(NOTICE, "What %s root set\n", rel_str(type));
+    for (i = 0; i < todo.count; i++) {
+        r = todo.elements[i];
+        queue_empty(&names);
+        provided_names(pool, r, &names);
+
+        for (j = 0; j < names.count; j++) {
+            n = names.elements[j];
+            if (n <= 0 || n >= idx.n_names)
+                continue;
+            for (e = idx.start[n]; e < idx.start[n + 1]; e++) {
+                p = idx.entries[2 * e];
+                dep = idx.entries[2 * e + 1];
+                if (MAPTST(&seen, p) || !dep_provided_by(pool, dep, r))
+                    continue;
+
+                MAPSET(&seen, p);
+                if (recursive)
+                    queue_push(&todo, p);
+
+                s = pool_id2solvable(pool, p);
+                opkg_msg(NOTICE, "\t%s %s\t%s %s\n",
+                         pool_id2str(pool, s->name), pool_id2str(pool, s->evr),
+                         rel_str(type), pool_dep2str(pool, dep));
+            }
+        }
+    }
+
+    queue_free(&names);
+    queue_free(&todo);
+    map_free(&seen);
+    rdep_index_free(&idx);
+    return 0;
+}
+
+static void print_provider(Pool * pool, enum what_field_type type,
+                           const char *pattern, Id p, Id n)
+{
+    Solvable *s = pool_id2solvable(pool, p);
+    const char *name = pool_id2str(pool, n);
+
+    opkg_msg(NOTICE, "    %s", pool_id2str(pool, s->name));
+    if (strcmp(pattern, name) != 0)
+        opkg_message(NOTICE, "\t%s %s", rel_str(type), name);
+    opkg_message(NOTICE, "\n");
+}
+
+int opkg_what_provides(enum what_field_type type, int argc,
+                       const char **patterns)
+{
+    Pool *pool = opkg_solv_pool;
+    struct rdep_index idx = { 0, NULL, NULL };
+    Queue names;
+    Map seen;
+    Id n, p, pp;
+    Offset e;
+    int i, j;
+
+    opkg_solv_create_whatprovides();
+    if (type == WHATREPLACES)
+        rdep_index_build(&idx, pool, type);
+
+    map_init(&seen, pool->nsolvables);
+    queue_init(&names);
+
+    for (i = 0; i < argc; i++) {
+        opkg_msg(NOTICE, "What %s %s\n", rel_str(type), patterns[i]);
+
+        map_empty(&seen);
+        queue_empty(&names);
+        if (type == WHATREPLACES && strpbrk(patterns[i], GLOB_CHARS)) {
+            /* What is replaced need not be provided by anything. */
+            for (n = 1; n < idx.n_names; n++) {
+                if (idx.start[n] != idx.start[n + 1]
+                        && fnmatch(patterns[i], pool_id2str(pool, n), 0) == 0)
+                    queue_push(&names, n);
+            }
+        } else {
+            match_names(pool, patterns[i], &names);
+        }
+
+        for (j = 0; j < names.count; j++) {
+            n = names.elements[j];
+            if (type == WHATPROVIDES) {
+                FOR_PROVIDES(p, pp, n) {
+                    if (MAPTST(&seen, p) || !is_candidate(pool, p))
+                        continue;
+                    MAPSET(&seen, p);
+                    print_provider(pool, type, patterns[i], p, n);
+                }
+            } else if (n < idx.n_names) {
+                for (e = idx.start[n]; e < idx.start[n + 1]; e++) {
+                    p = idx.entries[2 * e];
+                    if (MAPTST(&seen, p))
+                        continue;
+                    MAPSET(&seen, p);
+                    print_provider(pool, type, patterns[i], p, n);
+                }
+            }
+        }
+    }
+
+    queue_free(&names);
+    map_free(&seen);
+    if (type == WHATREPLACES)
+        rdep_index_free(&idx);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_what.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_WHAT_H
+#define OPKG_WHAT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum what_field_type {
+    WHATDEPENDS,
+    WHATCONFLICTS,
+    WHATPROVIDES,
+    WHATREPLACES,
+    WHATRECOMMENDS,
+    WHATSUGGESTS
+};
+
+/* Lists the packages which depend on, recommend, suggest or conflict with
+ * the packages whose names match patterns and, if recursive, on those in
+ * turn. Only installed packages are considered, or every package with
+ * --query-all.
+ */
+int opkg_what_depends(enum what_field_type type, int recursive, int argc,
+                      const char **patterns);
+
+/* Lists the packages which provide or replace the names matching
+ * patterns.
+ */
+int opkg_what_provides(enum what_field_type type, int argc,
+                       const char **patterns);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_WHAT_H */
@@ -0,0 +1,117 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_work_pool.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* A pool of threads sharing out a numbered list of independent items.
+ *
+ * Items are handed out one at a time, in order, to whichever thread is free.
+ * The work function must only touch state belonging to its own item; all
+ * messages and shared updates are left to the caller once the pool returns.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "opkg_work_pool.h"
+#include "xfuncs.h"
+
+/* The number of threads worth starting for n_items: one per processor, up
+ * to 16, and never more than there are items. Always 1 without threads.
+ */
+unsigned int opkg_work_pool_size(unsigned int n_items)
+{
+#ifdef HAVE_PTHREAD
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (n < 1)
+        n = 1;
+    if (n > 16)
+        n = 16;
+    return (unsigned int)n < n_items ? (unsigned int)n : n_items;
+#else
+    return n_items ? 1 : 0;
+#endif
+}
+
+#ifdef HAVE_PTHREAD
+struct work_pool {
+    pthread_mutex_t lock;
+    opkg_work_fn_t fn;
+    void *arg;
+    unsigned int n_items;
+    unsigned int next;
+};
+
+static void *work_pool_worker(void *arg)
+{
+    struct work_pool *pool = arg;
+    unsigned int i;
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        i = pool->next < pool->n_items ? pool->next++ : pool->n_items;
+        pthread_mutex_unlock(&pool->lock);
+        if (i == pool->n_items)
+            break;
+
+        pool->fn(pool->arg, i);
+    }
+
+    return NULL;
+}
+#endif
+
+/* Call fn(arg, i) for each i below n_items, spread over
+ * opkg_work_pool_size() threads, and return once every call has.
+ */
+void opkg_work_pool_run(unsigned int n_items, opkg_work_fn_t fn, void *arg)
+{
+    unsigned int i;
+#ifdef HAVE_PTHREAD
+    struct work_pool pool;
+    pthread_t *threads;
+    unsigned int n_threads;
+
+    n_threads = opkg_work_pool_size(n_items);
+    if (n_threads > 1) {
+        memset(&pool, 0, sizeof(pool));
+        pool.fn = fn;
+        pool.arg = arg;
+        pool.n_items = n_items;
+        pthread_mutex_init(&pool.lock, NULL);
+        threads = xcalloc(n_threads, sizeof(pthread_t));
+        for (i = 0; i < n_threads; i++) {
+            if (pthread_create(&threads[i], NULL, work_pool_worker, &pool) != 0)
+                break;
+        }
+        n_threads = i;
+        /* If no thread could be started, do the work here. */
+        if (n_threads == 0)
+            work_pool_worker(&pool);
+        for (i = 0; i < n_threads; i++)
+            pthread_join(threads[i], NULL);
+        free(threads);
+        pthread_mutex_destroy(&pool.lock);
+        return;
+    }
+#endif
+
+    for (i = 0; i < n_items; i++)
+        fn(arg, i);
+}
@@ -0,0 +1,30 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_work_pool.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef OPKG_WORK_POOL_H
+#define OPKG_WORK_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*opkg_work_fn_t) (void *arg, unsigned int i);
+
+unsigned int opkg_work_pool_size(unsigned int n_items);
+void opkg_work_pool_run(unsigned int n_items, opkg_work_fn_t fn, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* OPKG_WORK_POOL_H */
@@ -26,6 +26,7 @@
 #include "opkg_message.h"
 #include "opkg_utils.h"
 #include "xfuncs.h"
+#include "line_scan.h"
 
 #include "parse_util.h"
 
@@ -173,3 +174,25 @@ int parse_from_stream_nomalloc(parse_line_t parse_line, void *ptr, FILE * fp,
 
     return ret;
 }
+
+int parse_from_file(parse_line_t parse_line, void *ptr, const char *file_name,
+                    uint mask)
+{
+    line_scan_t scan;
+    char *line;
+
+    if (line_scan_open(&scan, file_name) < 0) {
+        opkg_perror(ERROR, "Failed to open %s", file_name);
+        return -1;
+    }
+
+    while ((line = line_scan_next(&scan, NULL)) != NULL) {
+        if (scan.missing_nl)
+            opkg_msg(ERROR, "Missing new line character" " at end of file!\n");
+        if (parse_line(ptr, line, mask) != 0)
+            break;
+    }
+
+    line_scan_close(&scan);
+    return 0;
+}
@@ -35,6 +35,12 @@ int parse_from_stream_nomalloc(parse_line_t parse_line, void *item,
                                FILE * fp, uint mask, char **buf0,
                                size_t buf0len);
 
+/* The same as parse_from_stream_nomalloc() for the lines of file_name,
+ * which are scanned in place rather than copied to a buffer.
+ */
+int parse_from_file(parse_line_t parse_line, void *item,
+                    const char *file_name, uint mask);
+
 #define EXCESSIVE_LINE_LEN	(4096 << 8)
 
 #ifdef __cplusplus
@@ -18,6 +18,7 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <ctype.h>
@@ -26,6 +27,7 @@
 #include <malloc.h>
 #include <stdlib.h>
 #include <solv/chksum.h>
+#include <solv/util.h>
 #include <fcntl.h>
 
 #include "pkg.h"
@@ -41,6 +43,12 @@
 #include "file_util.h"
 #include "xsystem.h"
 #include "pkg_hash.h"
+#include "opkg_fsync.h"
+#include "opkg_journal.h"
+#include "opkg_digest_cache.h"
+#include "opkg_profile.h"
+#include "opkg_work_pool.h"
+#include "str_intern.h"
 
 typedef struct enum_map enum_map_t;
 struct enum_map {
@@ -80,14 +88,13 @@ static const enum_map_t pkg_state_status_map[] = {
 Pool *pkg_pool = NULL;
 
 void pkg_init_from_solvable(pkg_t *pkg, Solvable* s);
-char* get_solv_dep(pkg_t *pkg, Offset offset);
+const char *get_solv_dep(pkg_t *pkg, Offset offset);
 
 void pkg_init(pkg_t * pkg, Solvable *s)
 {
     pkg->name = NULL;
-    pkg->epoch = 0;
     pkg->version = NULL;
-    pkg->revision = NULL;
+    pkg->url = NULL;
     pkg->force_reinstall = 0;
     pkg->dest = NULL;
     pkg->src = NULL;
@@ -96,7 +103,8 @@ void pkg_init(pkg_t * pkg, Solvable *s)
     pkg->section = NULL;
     pkg->description = NULL;
     pkg->state_want = SW_UNKNOWN;
-    pkg->wanted_by = pkg_vec_alloc();
+    pkg->wanted_by.pkgs = NULL;
+    pkg->wanted_by.len = 0;
     pkg->state_flag = SF_OK;
     pkg->state_status = SS_NOT_INSTALLED;
     pkg->depends_str = NULL;
@@ -120,6 +128,7 @@ void pkg_init(pkg_t * pkg, Solvable *s)
     conffile_list_init(&pkg->conffiles);
     pkg->installed_files = NULL;
     pkg->installed_files_ref_cnt = 0;
+    pkg->data_files_fresh = 0;
     pkg->essential = 0;
     pkg->provided_by_hand = 0;
     pkg->tags = NULL;
@@ -132,7 +141,8 @@ pkg_t *pkg_new(Solvable *s)
 {
     pkg_t *pkg;
 
-    pkg = xcalloc(1, sizeof(pkg_t));
+    /* Packages live until the end of the run, and go with the arena. */
+    pkg = arena_calloc(&opkg_config->arena, sizeof(pkg_t));
     pkg_init(pkg, s);
 
     return pkg;
@@ -140,15 +150,25 @@ pkg_t *pkg_new(Solvable *s)
 
 void pkg_deinit(pkg_t * pkg)
 {
-    free(pkg->name);
+    /* The strings are interned, and freed with the rest at the end. */
     pkg->name = NULL;
-
-    pkg->epoch = 0;
-
-    free(pkg->version);
     pkg->version = NULL;
-    /* revision shares storage with version, so don't free */
-    pkg->revision = NULL;
+    pkg->url = NULL;
+    pkg->architecture = NULL;
+    pkg->maintainer = NULL;
+    pkg->section = NULL;
+    pkg->description = NULL;
+    pkg->replaces_str = NULL;
+    pkg->conflicts_str = NULL;
+    pkg->recommends_str = NULL;
+    pkg->depends_str = NULL;
+    pkg->provides_str = NULL;
+    pkg->suggests_str = NULL;
+    pkg->md5sum = NULL;
+    pkg->sha256sum = NULL;
+    pkg->priority = NULL;
+    pkg->source = NULL;
+    pkg->tags = NULL;
 
     pkg->force_reinstall = 0;
 
@@ -157,43 +177,15 @@ void pkg_deinit(pkg_t * pkg)
     /* owned by opkg_conf_t */
     pkg->src = NULL;
 
-    free(pkg->architecture);
-    pkg->architecture = NULL;
-
-    free(pkg->maintainer);
-    pkg->maintainer = NULL;
-
-    free(pkg->section);
-    pkg->section = NULL;
-
-    free(pkg->description);
-    pkg->description = NULL;
-
     pkg->state_want = SW_UNKNOWN;
-    pkg_vec_free(pkg->wanted_by);
+    free(pkg->wanted_by.pkgs);
+    pkg->wanted_by.pkgs = NULL;
+    pkg->wanted_by.len = 0;
     pkg->state_flag = SF_OK;
     pkg->state_status = SS_NOT_INSTALLED;
 
     active_list_clear(&pkg->list);
 
-    free(pkg->replaces_str);
-    pkg->replaces_str = NULL;
-
-    free(pkg->conflicts_str);
-    pkg->conflicts_str = NULL;
-
-    free(pkg->recommends_str);
-    pkg->recommends_str = NULL;
-
-    free(pkg->depends_str);
-    pkg->depends_str = NULL;
-
-    free(pkg->provides_str);
-    pkg->provides_str = NULL;
-
-    free(pkg->suggests_str);
-    pkg->suggests_str = NULL;
-
     free(pkg->filename);
     pkg->filename = NULL;
 
@@ -206,18 +198,6 @@ void pkg_deinit(pkg_t * pkg)
     free(pkg->tmp_unpack_dir);
     pkg->tmp_unpack_dir = NULL;
 
-    free(pkg->md5sum);
-    pkg->md5sum = NULL;
-
-    free(pkg->sha256sum);
-    pkg->sha256sum = NULL;
-
-    free(pkg->priority);
-    pkg->priority = NULL;
-
-    free(pkg->source);
-    pkg->source = NULL;
-
     conffile_list_deinit(&pkg->conffiles);
 
     /* XXX: QUESTION: Is forcing this to 1 correct? I suppose so,
@@ -226,9 +206,6 @@ void pkg_deinit(pkg_t * pkg)
     pkg->installed_files_ref_cnt = 1;
     pkg_free_installed_files(pkg);
     pkg->essential = 0;
-
-    free(pkg->tags);
-    pkg->tags = NULL;
 }
 
 int pkg_init_from_file(pkg_t * pkg, const char *filename)
@@ -406,7 +383,7 @@ void set_flags_from_control(pkg_t * pkg)
 #endif
 }
 
-static const char *pkg_state_want_to_str(pkg_state_want_t sw)
+const char *pkg_state_want_to_str(pkg_state_want_t sw)
 {
     unsigned int i;
 
@@ -550,32 +527,33 @@ void pkg_init_from_solvable(pkg_t *pkg, Solvable* s)
     Dataiterator di;
     int chksumtype;
     const char *chksum;
+    long user_installed;
 
     if (!pkg_pool)
         pkg_pool = s->repo->pool;
 
     pkg->id = s - pkg_pool->solvables;
-    pkg->name = xstrdup(solvable_lookup_str(s, SOLVABLE_NAME));
-    pkg->version = xstrdup(solvable_lookup_str(s, SOLVABLE_EVR));
-    pkg->url = xstrdup(solvable_lookup_location(s, NULL));
-    pkg->architecture = xstrdup(solvable_lookup_str(s, SOLVABLE_ARCH));
-    pkg->description = xstrdup(solvable_lookup_str(s, SOLVABLE_DESCRIPTION));
+    pkg->name = str_intern(solvable_lookup_str(s, SOLVABLE_NAME));
+    pkg->version = str_intern(solvable_lookup_str(s, SOLVABLE_EVR));
+    pkg->url = str_intern_unique(solvable_lookup_location(s, NULL));
+    pkg->architecture = str_intern(solvable_lookup_str(s, SOLVABLE_ARCH));
+    pkg->description = str_intern_unique(solvable_lookup_str(s, SOLVABLE_DESCRIPTION));
     //      pkg->filename = strdup(solvable_lookup_str(s, SOLVABLE_));
     pkg->installed_size = solvable_lookup_num(s, SOLVABLE_INSTALLSIZE, 0);
     pkg->installed_time = solvable_lookup_num(s, SOLVABLE_INSTALLTIME, 0);
-    pkg->maintainer = xstrdup(solvable_lookup_str(s, SOLVABLE_VENDOR));
+    pkg->maintainer = str_intern(solvable_lookup_str(s, SOLVABLE_VENDOR));
 
     /* get md5 sum */
     chksumtype = REPOKEY_TYPE_MD5;
     chksum = solvable_lookup_checksum(s, SOLVABLE_CHECKSUM, &chksumtype);
     if (chksumtype)
-        pkg->md5sum = xstrdup(chksum);
+        pkg->md5sum = str_intern_unique(chksum);
 
     /* get sha256 sum */
     chksumtype = REPOKEY_TYPE_SHA256;
     chksum = solvable_lookup_checksum(s, SOLVABLE_CHECKSUM, &chksumtype);
     if (chksumtype)
-        pkg->sha256sum = xstrdup(chksum);
+        pkg->sha256sum = str_intern_unique(chksum);
 
     /* get status */
     sstr = solvable_lookup_str(s, SOLVABLE_INSTALLSTATUS);
@@ -583,9 +561,8 @@ void pkg_init_from_solvable(pkg_t *pkg, Solvable* s)
         pkg_parse_status_str(pkg, sstr);
 
     /* Auto-Installed flag */
-    pkg->auto_installed = solvable_lookup_num(s, SOLVABLE_USERINSTALLED, -1);
-    if (pkg->auto_installed >= 0)
-        pkg->auto_installed = !pkg->auto_installed;
+    user_installed = solvable_lookup_num(s, SOLVABLE_USERINSTALLED, -1);
+    pkg->auto_installed = user_installed < 0 ? -1 : !user_installed;
 
     /* add the conffiles */
     dataiterator_init(&di, pkg_pool, s->repo, s - pkg_pool->solvables, SOLVABLE_DEB_CONFFILES, 0, 0);
@@ -634,14 +611,18 @@ int pkg_restore_status(pkg_t *pkg, str_list_t *status_tmp)
     return res;
 }
 
-char* get_solv_dep(pkg_t *pkg, Offset offset)
+/* Returns the dependencies at offset as an interned string such as
+ * "a (>= 1.0), b".
+ */
+const char *get_solv_dep(pkg_t *pkg, Offset offset)
 {
+    static char *buf;
+    static size_t buf_size;
+    size_t len = 0, need;
     Id d, *dp;
-    int first = 1;
     const char *dep, *ver;
     int name_len;
     int is_provides;
-    char *res = NULL;
     Solvable *s = pool_id2solvable(pkg_pool, pkg->id);
     dp = s->repo->idarraydata + offset;
     is_provides = s->provides == offset;
@@ -658,19 +639,18 @@ char* get_solv_dep(pkg_t *pkg, Offset offset)
         } else {
             name_len = strlen(dep);
         }
-        if (first) {
-            sprintf_alloc(&res, "%.*s", name_len, dep);
-            first = 0;
-        } else {
-            res = xrealloc(res, strlen(res) + name_len + 3);
-            sprintf(res + strlen(res), ", %.*s", name_len, dep);
-        }
-        if (ver) {
-            res = xrealloc(res, strlen(res) + strlen(ver) + 4);
-            sprintf(res + strlen(res), " (%s)", ver);
+
+        /* ", " + name + " (" + ver + ")" + NUL */
+        need = len + name_len + (ver ? strlen(ver) : 0) + 7;
+        if (need > buf_size) {
+            buf_size = need * 2;
+            buf = xrealloc(buf, buf_size);
         }
+        len += sprintf(buf + len, "%s%.*s", len ? ", " : "", name_len, dep);
+        if (ver)
+            len += sprintf(buf + len, " (%s)", ver);
     }
-    return res;
+    return len ? str_intern_len(buf, len) : NULL;
 }
 
 #if 0
@@ -1083,16 +1063,69 @@ int pkg_name_version_and_architecture_compare(const void *p1, const void *p2)
 #endif
 
 /*
- * XXX: this should be broken into two functions
+ * Read the file list of installed pkg from its dest's database into files.
+ * Nothing shared is touched, so that several lists may be read at once by
+ * pkg_info_preinstall_check(). Returns 0, or -1 with errno set.
  */
-str_list_t *pkg_get_installed_files(pkg_t * pkg)
+static int read_installed_files(pkg_t * pkg, str_vec_t * files)
+{
+    char *list_file_name;
+    FILE *list_file;
+    char *line = NULL, *path = NULL;
+    size_t line_size = 0, path_size = 0, root_len = 0;
+    ssize_t len;
+    int err = 0;
+
+    sprintf_alloc(&list_file_name, "%s/%s.list", pkg->dest->info_dir,
+                  pkg->name);
+    list_file = fopen(list_file_name, "r");
+    free(list_file_name);
+    if (list_file == NULL)
+        return -1;
+
+    if (opkg_config->offline_root)
+        root_len = strlen(opkg_config->offline_root);
+
+    /* One line buffer for the whole list, rather than one per file. */
+    while ((len = getline(&line, &line_size, list_file)) != -1) {
+        if (len > 0 && line[len - 1] == '\n')
+            line[--len] = '\0';
+
+        if (root_len && strncmp(line, opkg_config->offline_root, root_len)) {
+            if (path_size < root_len + len + 1) {
+                path_size = root_len + len + 1;
+                path = xrealloc(path, path_size);
+            }
+            memcpy(path, opkg_config->offline_root, root_len);
+            memcpy(path + root_len, line, len + 1);
+            str_vec_append(files, path);
+        } else {
+            // already contains root_dir as header -> ABSOLUTE
+            str_vec_append(files, line);
+        }
+    }
+    if (ferror(list_file))
+        err = -1;
+
+    free(path);
+    free(line);
+    fclose(list_file);
+    return err;
+}
+
+/*
+ * For installed packages, look at the package.list file in the database.
+ * For uninstalled packages, get the file list directly from the package.
+ */
+str_vec_t *pkg_get_installed_files(pkg_t * pkg)
 {
     int err, fd;
     char *list_file_name = NULL;
     FILE *list_file = NULL;
-    char *line;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
     char *installed_file_name;
-    int list_from_package;
 
     pkg->installed_files_ref_cnt++;
 
@@ -1100,106 +1133,75 @@ str_list_t *pkg_get_installed_files(pkg_t * pkg)
         return pkg->installed_files;
     }
 
-    pkg->installed_files = str_list_alloc();
+    pkg->installed_files = str_vec_alloc();
 
-    /*
-     * For installed packages, look at the package.list file in the database.
-     * For uninstalled packages, get the file list directly from the package.
-     */
-    if (pkg->state_status == SS_NOT_INSTALLED || pkg->dest == NULL)
-        list_from_package = 1;
-    else
-        list_from_package = 0;
+    if (pkg->state_status != SS_NOT_INSTALLED && pkg->dest != NULL) {
+        if (read_installed_files(pkg, pkg->installed_files) < 0)
+            opkg_perror(ERROR, "Failed to read %s/%s.list",
+                        pkg->dest->info_dir, pkg->name);
+        return pkg->installed_files;
+    }
 
-    if (list_from_package) {
-        if (pkg->local_filename == NULL) {
-            return pkg->installed_files;
-        }
-        /* XXX: CLEANUP: Maybe rewrite this to avoid using a temporary
-         * file. In other words, change deb_extract so that it can
-         * simply return the file list as a char *[] rather than
-         * insisting on writing it to a FILE * as it does now. */
-        sprintf_alloc(&list_file_name, "%s/%s.list.XXXXXX",
-                      opkg_config->tmp_dir, pkg->name);
-        fd = mkstemp(list_file_name);
-        if (fd == -1) {
-            opkg_perror(ERROR, "Failed to make temp file %s.", list_file_name);
-            free(list_file_name);
-            return pkg->installed_files;
-        }
-        list_file = fdopen(fd, "r+");
-        if (list_file == NULL) {
-            opkg_perror(ERROR, "Failed to fdopen temp file %s.",
-                        list_file_name);
-            close(fd);
-            unlink(list_file_name);
-            free(list_file_name);
-            return pkg->installed_files;
-        }
-        err = pkg_extract_data_file_names_to_stream(pkg, list_file);
-        if (err) {
-            opkg_msg(ERROR, "Error extracting file list from %s.\n",
-                     pkg->local_filename);
-            fclose(list_file);
-            unlink(list_file_name);
-            free(list_file_name);
-            str_list_deinit(pkg->installed_files);
-            pkg->installed_files = NULL;
-            return NULL;
-        }
-        rewind(list_file);
-    } else {
-        sprintf_alloc(&list_file_name, "%s/%s.list", pkg->dest->info_dir,
-                      pkg->name);
-        list_file = fopen(list_file_name, "r");
-        if (list_file == NULL) {
-            opkg_perror(ERROR, "Failed to open %s", list_file_name);
-            free(list_file_name);
-            return pkg->installed_files;
-        }
+    if (pkg->local_filename == NULL) {
+        return pkg->installed_files;
+    }
+    /* XXX: CLEANUP: Maybe rewrite this to avoid using a temporary
+     * file. In other words, change deb_extract so that it can
+     * simply return the file list as a char *[] rather than
+     * insisting on writing it to a FILE * as it does now. */
+    sprintf_alloc(&list_file_name, "%s/%s.list.XXXXXX",
+                  opkg_config->tmp_dir, pkg->name);
+    fd = mkstemp(list_file_name);
+    if (fd == -1) {
+        opkg_perror(ERROR, "Failed to make temp file %s.", list_file_name);
+        free(list_file_name);
+        return pkg->installed_files;
+    }
+    list_file = fdopen(fd, "r+");
+    if (list_file == NULL) {
+        opkg_perror(ERROR, "Failed to fdopen temp file %s.", list_file_name);
+        close(fd);
+        unlink(list_file_name);
+        free(list_file_name);
+        return pkg->installed_files;
+    }
+    err = pkg_extract_data_file_names_to_stream(pkg, list_file);
+    if (err) {
+        opkg_msg(ERROR, "Error extracting file list from %s.\n",
+                 pkg->local_filename);
+        fclose(list_file);
+        unlink(list_file_name);
         free(list_file_name);
+        str_vec_free(pkg->installed_files);
+        pkg->installed_files = NULL;
+        return NULL;
     }
+    rewind(list_file);
 
-    while (1) {
+    /* One line buffer for the whole list, rather than one per file. */
+    while ((len = getline(&line, &line_size, list_file)) != -1) {
         char *file_name;
 
-        line = file_read_line_alloc(list_file);
-        if (line == NULL) {
-            break;
-        }
+        if (len > 0 && line[len - 1] == '\n')
+            line[--len] = '\0';
         file_name = line;
 
-        if (list_from_package) {
-            if (*file_name == '.') {
-                file_name++;
-            }
-            if (*file_name == '/') {
-                file_name++;
-            }
-            sprintf_alloc(&installed_file_name, "%s%s", pkg->dest->root_dir,
-                          file_name);
-        } else {
-            int unmatched_offline_root = opkg_config->offline_root
-                    && !str_starts_with(file_name, opkg_config->offline_root);
-            if (unmatched_offline_root) {
-                sprintf_alloc(&installed_file_name, "%s%s",
-                              opkg_config->offline_root, file_name);
-            } else {
-                // already contains root_dir as header -> ABSOLUTE
-                sprintf_alloc(&installed_file_name, "%s", file_name);
-            }
+        if (*file_name == '.') {
+            file_name++;
+        }
+        if (*file_name == '/') {
+            file_name++;
         }
-        str_list_append(pkg->installed_files, installed_file_name);
-        free(installed_file_name);
-        free(line);
+        installed_file_name = arena_sprintf(&opkg_config->scratch, "%s%s",
+                                            pkg->dest->root_dir, file_name);
+        /* The scratch copy goes with the next reset. */
+        str_vec_append(pkg->installed_files, installed_file_name);
     }
 
+    free(line);
     fclose(list_file);
-
-    if (list_from_package) {
-        unlink(list_file_name);
-        free(list_file_name);
-    }
+    unlink(list_file_name);
+    free(list_file_name);
 
     return pkg->installed_files;
 }
@@ -1216,10 +1218,7 @@ void pkg_free_installed_files(pkg_t * pkg)
     if (pkg->installed_files_ref_cnt > 0)
         return;
 
-    if (pkg->installed_files) {
-        str_list_purge(pkg->installed_files);
-    }
-
+    str_vec_free(pkg->installed_files);
     pkg->installed_files = NULL;
 }
 
@@ -1257,11 +1256,12 @@ conffile_t *pkg_get_conffile(pkg_t * pkg, const char *file_name)
     return NULL;
 }
 
-int pkg_run_script(pkg_t * pkg, const char *script, const char *args)
+int pkg_script_cmd_alloc(pkg_t * pkg, const char *script, const char *args,
+                         char **cmd)
 {
-    int err;
     char *path;
-    char *cmd;
+
+    *cmd = NULL;
 
     if (opkg_config->noaction)
         return 0;
@@ -1301,47 +1301,120 @@ int pkg_run_script(pkg_t * pkg, const char *script, const char *args)
         return 0;
     }
 
-    sprintf_alloc(&cmd, "%s %s", path, args);
+    sprintf_alloc(cmd, "%s %s", path, args);
     free(path);
+    return 0;
+}
+
+void pkg_script_failed(pkg_t * pkg, const char *script, int err)
+{
+    if (!opkg_config->offline_root)
+        opkg_msg(ERROR, "package \"%s\" %s script returned status %d.\n",
+                 pkg->name, script, err);
+}
+
+int pkg_run_script(pkg_t * pkg, const char *script, const char *args)
+{
+    int err;
+    char *cmd;
+
+    err = pkg_script_cmd_alloc(pkg, script, args, &cmd);
+    if (err || !cmd)
+        return err;
+
     {
         const char *argv[] = { "sh", "-c", cmd, NULL };
+        opkg_profile_begin("script");
         err = xsystem(argv);
+        opkg_profile_end("script");
+        opkg_profile_count("scripts_run", 1);
     }
     free(cmd);
 
     if (err) {
-        if (!opkg_config->offline_root)
-            opkg_msg(ERROR, "package \"%s\" %s script returned status %d.\n",
-                     pkg->name, script, err);
+        pkg_script_failed(pkg, script, err);
         return err;
     }
 
     return 0;
 }
 
+struct file_lists {
+    pkg_vec_t *pkgs;
+    str_vec_t **files;
+    int *errs;
+};
+
+/* Workers only read lists; the file hash is left to the calling thread. */
+static void read_file_list(void *arg, unsigned int i)
+{
+    struct file_lists *lists = arg;
+
+    errno = 0;
+    if (read_installed_files(lists->pkgs->pkgs[i], lists->files[i]) < 0)
+        lists->errs[i] = errno ? errno : EIO;
+}
+
+/* Read the lists of installed_pkgs into files, setting errs[i] to the errno
+ * of any list which couldn't be read. The lists are read in parallel, by a
+ * thread per processor.
+ */
+static void read_file_lists(pkg_vec_t * installed_pkgs, str_vec_t ** files,
+                            int *errs)
+{
+    struct file_lists lists;
+
+    lists.pkgs = installed_pkgs;
+    lists.files = files;
+    lists.errs = errs;
+    opkg_work_pool_run(installed_pkgs->len, read_file_list, &lists);
+}
+
+/* Record the owner of every file listed by installed_pkgs, each of which
+ * must be installed in a dest. Later packages take files over from earlier
+ * ones, so those of a dest should come together and in the order loaded.
+ */
 void pkg_info_preinstall_check(pkg_vec_t *installed_pkgs)
 {
-    unsigned int i;
+    unsigned int i, n = installed_pkgs->len;
+    str_vec_t **files;
+    int *errs;
+
     /* update the file owner data structure */
     opkg_msg(INFO, "Updating file owner list.\n");
-    for (i = 0; i < installed_pkgs->len; i++) {
+
+    files = xcalloc(n + 1, sizeof(*files));
+    errs = xcalloc(n + 1, sizeof(*errs));
+    for (i = 0; i < n; i++)
+        files[i] = str_vec_alloc();
+    read_file_lists(installed_pkgs, files, errs);
+
+    for (i = 0; i < n; i++) {
         pkg_t *pkg = installed_pkgs->pkgs[i];
-        str_list_t *installed_files = pkg_get_installed_files(pkg);     /* this causes installed_files to be cached */
-        str_list_elt_t *iter, *niter;
-        if (installed_files == NULL) {
-            opkg_msg(ERROR,
-                     "Failed to determine installed " "files for pkg %s.\n",
-                     pkg->name);
-            break;
+        const char *installed_file;
+        unsigned int iter = 0;
+
+        if (errs[i]) {
+            errno = errs[i];
+            opkg_perror(ERROR, "Failed to read %s/%s.list",
+                        pkg->dest->info_dir, pkg->name);
         }
-        for (iter = str_list_first(installed_files), niter = str_list_next(installed_files, iter);
-                iter;
-                iter = niter, niter = str_list_next(installed_files, iter)) {
-            char *installed_file = (char *)iter->data;
-            file_hash_set_file_owner(installed_file, pkg);
+
+        /* Cache the list while it is hashed, as pkg_get_installed_files()
+         * would, so a file listed twice is found here rather than re-read. */
+        pkg->installed_files_ref_cnt++;
+        if (!pkg->installed_files) {
+            pkg->installed_files = files[i];
+            files[i] = NULL;
         }
+        while ((installed_file = str_vec_next(pkg->installed_files, &iter)))
+            file_hash_set_file_owner(installed_file, pkg);
         pkg_free_installed_files(pkg);
+        str_vec_free(files[i]);
     }
+
+    free(errs);
+    free(files);
 }
 
 struct pkg_write_filelist_data {
@@ -1380,6 +1453,7 @@ int pkg_write_filelist(pkg_t * pkg)
     hash_table_foreach(&opkg_config->file_hash, pkg_write_filelist_helper,
                        &data);
     fclose(data.stream);
+    opkg_fsync_track_file(list_file_name);
     free(list_file_name);
 
     pkg->state_flag &= ~SF_FILELIST_CHANGED;
@@ -1389,9 +1463,6 @@ int pkg_write_filelist(pkg_t * pkg)
 
 int pkg_write_status(pkg_t * pkg)
 {
-    FILE *f;
-    int ret;
-
     if (opkg_config->noaction)
         return 0;
 
@@ -1399,44 +1470,34 @@ int pkg_write_status(pkg_t * pkg)
         opkg_msg(ERROR, "Internal error: package %s has a NULL dest\n", pkg->name);
         return -1;
     }
-    f = fopen(pkg->dest->status_file_name, "a");
-    if (f == NULL) {
-        opkg_perror(ERROR, "Can't open status file %s", pkg->dest->status_file_name);
-        ret = -1;
-    } else {
-        pkg_print_status(pkg, f);
-        fclose(f);
-        ret = 0;
-    }
-    pkg->dest->changed = 1;
-    return ret;
+
+    return opkg_journal_append(pkg);
 }
 
 
 
 static int verify_checksum(const char *file, const unsigned char *chksum, Id chksumtype)
-{   
-	char buf[1024];
-	const unsigned char *sum;
-	Chksum *h;
-	int l, err, fd;
-
-	h = solv_chksum_create(chksumtype);
-	if (!h)
-	{
-		opkg_msg(ERROR, "%s: unknown checksum type\n", file);
-		return 0;
-	}   
-	fd = open(file, O_RDONLY);
-	while ((l = read(fd, buf, sizeof(buf))) > 0)
-		solv_chksum_add(h, buf, l);
-	lseek(fd, 0, SEEK_SET);
-	l = 0;
-	sum = solv_chksum_get(h, &l);
-	err = memcmp(sum, chksum, l);
-	solv_chksum_free(h, 0);
-	close(fd);
-	return err;
+{
+    char *hex, *expected;
+    int len, err;
+
+    len = solv_chksum_len(chksumtype);
+    if (!len) {
+        opkg_msg(ERROR, "%s: unknown checksum type\n", file);
+        return 0;
+    }
+
+    hex = opkg_digest_cache_file_alloc(file, chksumtype);
+    if (!hex)
+        return -1;
+
+    expected = xmalloc(2 * len + 1);
+    solv_bin2hex(chksum, len, expected);
+    err = strcmp(hex, expected);
+
+    free(expected);
+    free(hex);
+    return err;
 }
 
 int pkg_verify(pkg_t *pkg, int remove_corrupted)
@@ -24,6 +24,7 @@
 
 #include "pkg_vec.h"
 #include "str_list.h"
+#include "str_vec.h"
 #include "active_list.h"
 #include "pkg_src.h"
 #include "pkg_dest.h"
@@ -81,60 +82,68 @@ enum pkg_state_status {
 };
 typedef enum pkg_state_status pkg_state_status_t;
 
+/* The strings describing a package are interned with str_intern(), as
+ * many of them, such as the architecture, maintainer and dependencies,
+ * are the same for many packages. They are shared, so must not be
+ * modified or freed. The per-transaction file names are the package's
+ * own.
+ */
 struct pkg {
     Id id;
-    unsigned long epoch;
-    char *name;
-    char *version;
-    char *url;
-    char *revision;
-    int force_reinstall;
+    const char *name;
+    const char *version;
+    const char *url;
+    const char *architecture;
+    const char *section;
+    const char *depends_str;
+    const char *recommends_str;
+    const char *provides_str;
+    const char *replaces_str;
+    const char *suggests_str;
+    const char *conflicts_str;
+    const char *maintainer;
+    const char *description;
+    const char *tags;
+    const char *md5sum;
+    const char *sha256sum;
+    const char *priority;
+    const char *source;
     pkg_src_t *src;
     pkg_dest_t *dest;
-    char *architecture;
-    char *section;
-    char *depends_str;
-    char *recommends_str;
-    char *provides_str;
-    char *replaces_str;
-    char *suggests_str;
-    char *conflicts_str;
-    char *maintainer;
-    char *description;
-    char *tags;
-    pkg_state_want_t state_want;
-    pkg_vec_t *wanted_by;
-    pkg_state_flag_t state_flag;
-    pkg_state_status_t state_status;
+    pkg_vec_t wanted_by;
     struct active_list list;        /* Used for installing|upgrading */
     char *filename;
     char *local_filename;
     char *tmp_unpack_dir;
-    char *md5sum;
-    char *sha256sum;
     unsigned long size;     /* in bytes */
     unsigned long installed_size;   /* in bytes */
-    char *priority;
-    char *source;
     conffile_list_t conffiles;
     time_t installed_time;
     /* As pointer for lazy evaluation */
-    str_list_t *installed_files;
+    str_vec_t *installed_files;
     /* XXX: CLEANUP: I'd like to perhaps come up with a better
      * mechanism to avoid the problem here, (which is that the
      * installed_files list was being freed from an inner loop while
      * still being used within an outer loop. */
     int installed_files_ref_cnt;
-    int essential;
     int arch_priority;
+    /* pkg_state_want_t, pkg_state_flag_t and pkg_state_status_t */
+    unsigned int state_want:3;
+    unsigned int state_flag:10;
+    unsigned int state_status:4;
+    unsigned int force_reinstall:1;
+    /* Set by the data file clash check when none of the package's files
+     * already exist on disk, so extraction need not unlink before creating. */
+    unsigned int data_files_fresh:1;
+    unsigned int essential:1;
     /* Adding this flag, to "force" opkg to choose a "provided_by_hand"
      * package, if there are multiple choice */
-    int provided_by_hand;
+    unsigned int provided_by_hand:1;
 
     /* this flag specifies whether the package was installed to satisfy another
-     * package's dependancies
+     * package's dependancies, or -1 if the status didn't say
      */
-    int auto_installed;
+    signed int auto_installed:2;
 };
 
 pkg_t *pkg_new(Solvable *s);
@@ -166,14 +175,22 @@ void pkg_formatted_field(FILE * fp, pkg_t * pkg, const char *field);
 void set_flags_from_control(pkg_t * pkg);
 
 void pkg_print_status(pkg_t * pkg, FILE * file);
-str_list_t *pkg_get_installed_files(pkg_t * pkg);
+str_vec_t *pkg_get_installed_files(pkg_t * pkg);
 void pkg_free_installed_files(pkg_t * pkg);
 void pkg_remove_installed_files_list(pkg_t * pkg);
 conffile_t *pkg_get_conffile(pkg_t * pkg, const char *file_name);
 int pkg_run_script(pkg_t * pkg, const char *script, const char *args);
+/* The parts of pkg_run_script() for callers which run the script
+ * themselves: *cmd is set to the shell command to run, or to NULL if
+ * there is nothing to run.
+ */
+int pkg_script_cmd_alloc(pkg_t * pkg, const char *script, const char *args,
+                         char **cmd);
+void pkg_script_failed(pkg_t * pkg, const char *script, int err);
 
 /* enum mappings */
 pkg_state_want_t pkg_state_want_from_str(char *str);
+const char *pkg_state_want_to_str(pkg_state_want_t sw);
 pkg_state_flag_t pkg_state_flag_from_str(const char *str);
 pkg_state_status_t pkg_state_status_from_str(const char *str);
 const char *pkg_state_status_to_str(pkg_state_status_t ss);
@@ -51,6 +51,11 @@ int pkg_dest_init(pkg_dest_t * dest, const char *name, const char *root_dir)
                   opkg_config->status_file);
     dest->changed = 0;
 
+    sprintf_alloc(&dest->journal_file_name, "%s.journal",
+                  dest->status_file_name);
+    dest->journal_seq = 0;
+    dest->journal_size = -1;
+
     /* Ensure that the directory in which we will create the status file exists.
      */
     status_file_dir = xdirname(dest->status_file_name);
@@ -73,4 +78,7 @@ void pkg_dest_deinit(pkg_dest_t * dest)
 
     free(dest->status_file_name);
     dest->status_file_name = NULL;
+
+    free(dest->journal_file_name);
+    dest->journal_file_name = NULL;
 }
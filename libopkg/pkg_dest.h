@@ -33,6 +33,13 @@ struct pkg_dest {
     char *status_file_name;
     FILE *status_fp;
     int changed;
+
+    /* Status changes journaled since the last snapshot. journal_size is the
+     * length of the valid part of the journal, or -1 before it is loaded.
+     */
+    char *journal_file_name;
+    unsigned long journal_seq;
+    long journal_size;
 };
 
 int pkg_dest_init(pkg_dest_t * dest, const char *name,
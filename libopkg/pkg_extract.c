@@ -93,6 +93,9 @@ int pkg_extract_data_files_to_dir(pkg_t * pkg, const char *dir)
         return -1;
     }
 
+    if (pkg->data_files_fresh)
+        ar_set_no_unlink(ar);
+
     r = ar_extract_all(ar, dir);
     if (r < 0)
         opkg_msg(ERROR, "Failed to extract data files from package '%s'.\n",
@@ -19,13 +19,17 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <malloc.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 
+#include <solv/knownid.h>
+
 #include "opkg_message.h"
 #include "release.h"
 #include "opkg_utils.h"
 #include "xfuncs.h"
 
+#include "opkg_digest_cache.h"
 #include "opkg_download.h"
 #include "sprintf_alloc.h"
 
@@ -44,6 +48,7 @@ static void release_init(release_t * release)
     release->components_count = 0;
     release->complist = NULL;
     release->complist_count = 0;
+    release->entries = NULL;
 }
 
 release_t *release_new(void)
@@ -78,20 +83,17 @@ void release_deinit(release_t * release)
     }
     free(release->complist);
 
+    if (release->entries) {
+        hash_table_deinit(release->entries);
+        free(release->entries);
+    }
 }
 
 int release_init_from_file(release_t * release, const char *filename)
 {
-    int err = 0;
-    FILE *release_file;
-
-    release_file = fopen(filename, "r");
-    if (release_file == NULL) {
-        opkg_perror(ERROR, "Failed to open %s", filename);
-        return -1;
-    }
+    int err;
 
-    err = release_parse_from_stream(release, release_file);
+    err = release_parse_from_file(release, filename);
     if (!err) {
         if (!release_arch_supported(release)) {
             opkg_msg(ERROR, "No valid architecture found on Release file.\n");
@@ -243,93 +245,115 @@ int release_download(release_t * release, pkg_src_t * dist, char *lists_dir,
     return ret;
 }
 
-int release_get_size(release_t * release, const char *pathname)
-{
-    const cksum_t *cksum;
+struct release_entry {
+    const cksum_t *md5;
+    const cksum_t *sha256;
+};
 
-    if (release->md5sums) {
-        cksum = cksum_list_find(release->md5sums, pathname);
-        return cksum->size;
-    }
-#ifdef HAVE_SHA256
-    if (release->sha256sums) {
-        cksum = cksum_list_find(release->sha256sums, pathname);
-        return cksum->size;
+static void index_cksums(release_t * release, cksum_list_t * list, int sha256)
+{
+    cksum_list_elt_t *iter;
+    cksum_t *cksum;
+    struct release_entry *entry;
+
+    list_for_each_entry(iter, &list->head, node) {
+        cksum = (cksum_t *) iter->data;
+        entry = hash_table_get(release->entries, cksum->name);
+        if (!entry) {
+            /* The entries go with the table's keys. */
+            entry = arena_calloc(&release->entries->arena,
+                                 sizeof(struct release_entry));
+            hash_table_insert(release->entries, cksum->name, entry);
+        }
+        if (sha256)
+            entry->sha256 = cksum;
+        else
+            entry->md5 = cksum;
     }
-#endif
-
-    return -1;
 }
 
-const char *release_get_md5(release_t * release, const char *pathname)
+static int cksum_list_len(cksum_list_t * list)
 {
-    const cksum_t *cksum;
-
-    if (release->md5sums) {
-        cksum = cksum_list_find(release->md5sums, pathname);
-        return cksum->value;
-    }
+    cksum_list_elt_t *iter;
+    int n = 0;
 
-    return '\0';
+    if (list)
+        list_for_each_entry(iter, &list->head, node)
+            n++;
+    return n;
 }
 
-#ifdef HAVE_SHA256
-const char *release_get_sha256(release_t * release, const char *pathname)
+static const struct release_entry *release_entry_find(release_t * release,
+                                                      const char *pathname)
 {
-    const cksum_t *cksum;
+    int n;
+
+    if (!release->entries) {
+        n = cksum_list_len(release->md5sums);
+        n += cksum_list_len(release->sha256sums);
 
-    if (release->sha256sums) {
-        cksum = cksum_list_find(release->sha256sums, pathname);
-        return cksum->value;
+        release->entries = xcalloc(1, sizeof(hash_table_t));
+        hash_table_init("release-entries", release->entries, n + 1);
+        if (release->md5sums)
+            index_cksums(release, release->md5sums, 0);
+#ifdef HAVE_SHA256
+        if (release->sha256sums)
+            index_cksums(release, release->sha256sums, 1);
+#endif
     }
 
-    return '\0';
+    return hash_table_get(release->entries, pathname);
 }
-#endif
 
 int release_verify_file(release_t * release, const char *file_name,
                         const char *pathname)
 {
+    const struct release_entry *entry;
+    const cksum_t *cksum;
+    const char *type_name;
     struct stat f_info;
-    char *f_md5 = NULL;
-    const char *md5 = release_get_md5(release, pathname);
-#ifdef HAVE_SHA256
-    char *f_sha256 = NULL;
-    const char *sha256 = release_get_sha256(release, pathname);
-#endif
+    char *digest;
+    Id type;
+    int fd;
     int ret = 0;
-    int r;
 
-    r = stat(file_name, &f_info);
-    if ((r != 0) || (f_info.st_size != release_get_size(release, pathname))) {
+    entry = release_entry_find(release, pathname);
+    if (!entry) {
+        opkg_msg(ERROR, "No checksum for %s - %s.\n", release->name, pathname);
+        return 1;
+    }
+
+    /* Only the strongest listed digest is checked, so the file is read
+     * just once. */
+    if (entry->sha256) {
+        cksum = entry->sha256;
+        type = REPOKEY_TYPE_SHA256;
+        type_name = "SHA256";
+    } else {
+        cksum = entry->md5;
+        type = REPOKEY_TYPE_MD5;
+        type_name = "MD5";
+    }
+
+    fd = open(file_name, O_RDONLY);
+    if (fd == -1 || fstat(fd, &f_info) != 0
+            || f_info.st_size != cksum->size) {
         opkg_msg(ERROR, "Size verification failed for %s - %s.\n",
                  release->name, pathname);
         ret = 1;
-    } else {
-
-        f_md5 = file_md5sum_alloc(file_name);
-#ifdef HAVE_SHA256
-        f_sha256 = file_sha256sum_alloc(file_name);
-#endif
-
-        if (md5 && strcmp(md5, f_md5)) {
-            opkg_msg(ERROR, "MD5 verification failed for %s - %s.\n",
-                     release->name, pathname);
-            ret = 1;
-#ifdef HAVE_SHA256
-        } else if (sha256 && strcmp(sha256, f_sha256)) {
-            opkg_msg(ERROR, "SHA256 verification failed for %s - %s.\n",
-                     release->name, pathname);
-            ret = 1;
-#endif
-        }
-
+        goto out;
     }
 
-    free(f_md5);
-#ifdef HAVE_SHA256
-    free(f_sha256);
-#endif
+    digest = opkg_digest_fd_alloc(fd, type);
+    if (!digest || strcmp(cksum->value, digest) != 0) {
+        opkg_msg(ERROR, "%s verification failed for %s - %s.\n", type_name,
+                 release->name, pathname);
+        ret = 1;
+    }
+    free(digest);
 
+ out:
+    if (fd != -1)
+        close(fd);
     return ret;
 }
@@ -23,6 +23,7 @@ extern "C" {
 
 #include <stdio.h>
 #include "cksum_list.h"
+#include "hash_table.h"
 #include "pkg_src.h"
 
 struct release {
@@ -34,6 +35,8 @@ struct release {
     unsigned int components_count;
     cksum_list_t *md5sums;
     cksum_list_t *sha256sums;
+    /* Checksums by file name, built when the first file is verified. */
+    hash_table_t *entries;
     char **complist;
     unsigned int complist_count;
 };
@@ -126,3 +126,8 @@ int release_parse_from_stream(release_t * release, FILE * fp)
 
     return ret;
 }
+
+int release_parse_from_file(release_t * release, const char *file_name)
+{
+    return parse_from_file(release_parse_line, release, file_name, 0);
+}
@@ -22,6 +22,7 @@ extern "C" {
 #endif
 
 int release_parse_from_stream(release_t * release, FILE * fp);
+int release_parse_from_file(release_t * release, const char *file_name);
 
 #ifdef __cplusplus
 }
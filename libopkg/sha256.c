@@ -29,6 +29,36 @@
 #include <stddef.h>
 #include <string.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) \
+    && (__GNUC__ >= 5 || defined(__clang__))
+#define SHA256_SHANI 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) \
+    && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+#define SHA256_ARMV8 1
+#define SHA256_ARMV8_TARGET
+#include <arm_neon.h>
+#elif defined(__aarch64__) && defined(__linux__) && defined(__GNUC__) \
+    && (defined(__clang__) ? __clang_major__ >= 16 : __GNUC__ >= 8)
+/* Built for any ARMv8 processor, and only used where the kernel says the
+   processor has the SHA-2 instructions.  */
+#define SHA256_ARMV8 1
+#define SHA256_ARMV8_HWCAP 1
+#ifdef __clang__
+#define SHA256_ARMV8_TARGET __attribute__ ((target("crypto")))
+#else
+#define SHA256_ARMV8_TARGET __attribute__ ((target("+crypto")))
+#endif
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_SHA2
+#define HWCAP_SHA2 (1 << 6)
+#endif
+#endif
+
 #if USE_UNLOCKED_IO
 #include "unlocked-io.h"
 #endif
@@ -40,7 +70,7 @@
     (((n) << 24) | (((n) & 0xff00) << 8) | (((n) >> 8) & 0xff00) | ((n) >> 24))
 #endif
 
-#define BLOCKSIZE 4096
+#define BLOCKSIZE 32768
 #if BLOCKSIZE % 64 != 0
 #error "invalid BLOCKSIZE"
 #endif
@@ -387,12 +417,12 @@ static const uint32_t sha256_round_constants[64] = {
 #define F2(A,B,C) ( ( A & B ) | ( C & ( A | B ) ) )
 #define F1(E,F,G) ( G ^ ( E & ( F ^ G ) ) )
 
-/* Process LEN bytes of BUFFER, accumulating context into CTX.
+/* Process LEN bytes of BUFFER into the state of CTX.
    It is assumed that LEN % 64 == 0.
    Most of this code comes from GnuPG's cipher/sha1.c.  */
 
-void sha256_process_block(const void *buffer, size_t len,
-                          struct sha256_ctx *ctx)
+static void sha256_process_block_generic(const void *buffer, size_t len,
+                                         struct sha256_ctx *ctx)
 {
     const uint32_t *words = buffer;
     size_t nwords = len / sizeof(uint32_t);
@@ -407,13 +437,6 @@ void sha256_process_block(const void *buffer, size_t len,
     uint32_t g = ctx->state[6];
     uint32_t h = ctx->state[7];
 
-    /* First increment the byte count.  FIPS PUB 180-2 specifies the possible
-     * length of the file up to 2^64 bits.  Here we only compute the
-     * number of bytes.  Do a double word increment.  */
-    ctx->total[0] += len;
-    if (ctx->total[0] < len)
-        ++ctx->total[1];
-
 #define rol(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
 #define S0(x) (rol(x,25)^rol(x,14)^(x>>3))
 #define S1(x) (rol(x,15)^rol(x,13)^(x>>10))
@@ -517,3 +540,211 @@ void sha256_process_block(const void *buffer, size_t len,
         h = ctx->state[7] += h;
     }
 }
+
+#ifdef SHA256_SHANI
+/* The same as sha256_process_block_generic, using the SHA extensions of
+   x86 processors.  Based on the public domain intrinsics code by Jeffrey
+   Walton, Sean Gulley and Intel.  */
+__attribute__ ((target("sha,sse4.1,ssse3")))
+static void sha256_process_block_shani(const void *buffer, size_t len,
+                                       struct sha256_ctx *ctx)
+{
+    const unsigned char *data = buffer;
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp, abef_save, cdgh_save;
+    __m128i w[4];
+    int i;
+
+    /* Load the state as ABEF and CDGH, the order the instructions use.  */
+    tmp = _mm_loadu_si128((const __m128i *)&ctx->state[0]);
+    state1 = _mm_loadu_si128((const __m128i *)&ctx->state[4]);
+    tmp = _mm_shuffle_epi32(tmp, 0xb1);
+    state1 = _mm_shuffle_epi32(state1, 0x1b);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+    while (len >= 64) {
+        abef_save = state0;
+        cdgh_save = state1;
+
+        /* Four rounds at a time, with w[] holding the last 16 words of the
+           message schedule.  */
+        for (i = 0; i < 16; i++) {
+            if (i < 4) {
+                w[i] = _mm_shuffle_epi8(
+                        _mm_loadu_si128((const __m128i *)(data + 16 * i)),
+                        mask);
+            } else {
+                tmp = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(w[(i + 3) & 3],
+                                                         w[(i + 2) & 3], 4));
+                w[i & 3] = _mm_sha256msg2_epu32(tmp, w[(i + 3) & 3]);
+            }
+
+            msg = _mm_add_epi32(w[i & 3], _mm_loadu_si128(
+                        (const __m128i *)&sha256_round_constants[4 * i]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0e);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+
+        data += 64;
+        len -= 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1b);
+    state1 = _mm_shuffle_epi32(state1, 0xb1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128((__m128i *)&ctx->state[0], state0);
+    _mm_storeu_si128((__m128i *)&ctx->state[4], state1);
+}
+
+static int sha256_shani_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+    /* SSSE3 and SSE4.1 */
+    if (!(ecx & (1 << 9)) || !(ecx & (1 << 19)))
+        return 0;
+
+    if (__get_cpuid_max(0, NULL) < 7)
+        return 0;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 29)) != 0;
+}
+#endif
+
+#ifdef SHA256_ARMV8
+/* The same as sha256_process_block_generic, using the ARMv8 cryptography
+   extensions.  */
+SHA256_ARMV8_TARGET
+static void sha256_process_block_armv8(const void *buffer, size_t len,
+                                       struct sha256_ctx *ctx)
+{
+    const uint8_t *data = buffer;
+    uint32x4_t state0, state1, abcd, abcd_save, efgh_save, tmp;
+    uint32x4_t w[4];
+    int i;
+
+    state0 = vld1q_u32(&ctx->state[0]);
+    state1 = vld1q_u32(&ctx->state[4]);
+
+    while (len >= 64) {
+        abcd_save = state0;
+        efgh_save = state1;
+
+        for (i = 0; i < 16; i++) {
+            if (i < 4)
+                w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+            else
+                w[i & 3] = vsha256su1q_u32(vsha256su0q_u32(w[i & 3],
+                                                           w[(i + 1) & 3]),
+                                           w[(i + 2) & 3], w[(i + 3) & 3]);
+
+            tmp = vaddq_u32(w[i & 3], vld1q_u32(&sha256_round_constants[4 * i]));
+            abcd = state0;
+            state0 = vsha256hq_u32(state0, state1, tmp);
+            state1 = vsha256h2q_u32(state1, abcd, tmp);
+        }
+
+        state0 = vaddq_u32(state0, abcd_save);
+        state1 = vaddq_u32(state1, efgh_save);
+
+        data += 64;
+        len -= 64;
+    }
+
+    vst1q_u32(&ctx->state[0], state0);
+    vst1q_u32(&ctx->state[4], state1);
+}
+
+#ifdef SHA256_ARMV8_HWCAP
+static int sha256_armv8_supported(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+#else
+/* The compiler targets the extensions, so every processor the binary runs
+   on has them.  */
+#define sha256_armv8_supported NULL
+#endif
+#endif
+
+struct sha256_impl {
+    const char *name;
+    void (*process_block) (const void *buffer, size_t len,
+                           struct sha256_ctx *ctx);
+    int (*supported) (void);
+};
+
+static const struct sha256_impl sha256_impls[] = {
+#ifdef SHA256_SHANI
+    {"shani", sha256_process_block_shani, sha256_shani_supported},
+#endif
+#ifdef SHA256_ARMV8
+    {"armv8", sha256_process_block_armv8, sha256_armv8_supported},
+#endif
+    {"generic", sha256_process_block_generic, NULL},
+};
+
+static const struct sha256_impl *sha256_impl;
+
+static const struct sha256_impl *sha256_select(void)
+{
+    size_t i;
+
+    /* The generic implementation is last, and always supported.  */
+    for (i = 0; i < sizeof(sha256_impls) / sizeof(sha256_impls[0]); i++) {
+        if (!sha256_impls[i].supported || sha256_impls[i].supported())
+            break;
+    }
+    return &sha256_impls[i];
+}
+
+/* Return the name of the implementation in use.  */
+const char *sha256_implementation(void)
+{
+    if (!sha256_impl)
+        sha256_impl = sha256_select();
+    return sha256_impl->name;
+}
+
+/* Use the implementation called NAME, if it is built in and supported by
+   this processor, so that they can be compared.  Return 0 on success.  */
+int sha256_set_implementation(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(sha256_impls) / sizeof(sha256_impls[0]); i++) {
+        if (strcmp(sha256_impls[i].name, name) == 0
+                && (!sha256_impls[i].supported || sha256_impls[i].supported())) {
+            sha256_impl = &sha256_impls[i];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Process LEN bytes of BUFFER, accumulating context into CTX.
+   It is assumed that LEN % 64 == 0.  */
+void sha256_process_block(const void *buffer, size_t len,
+                          struct sha256_ctx *ctx)
+{
+    /* First increment the byte count.  FIPS PUB 180-2 specifies the possible
+     * length of the file up to 2^64 bits.  Here we only compute the
+     * number of bytes.  Do a double word increment.  */
+    ctx->total[0] += len;
+    if (ctx->total[0] < len)
+        ++ctx->total[1];
+
+    if (!sha256_impl)
+        sha256_impl = sha256_select();
+    sha256_impl->process_block(buffer, len, ctx);
+}
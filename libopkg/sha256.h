@@ -78,6 +78,14 @@ extern void *sha224_read_ctx(const struct sha256_ctx *ctx, void *resbuf);
 extern int sha256_stream(FILE * stream, void *resblock);
 extern int sha224_stream(FILE * stream, void *resblock);
 
+/* Return the name of the block function in use, which is picked at run time
+   from those built in.  */
+extern const char *sha256_implementation(void);
+
+/* Use the block function called NAME if it is available, returning 0, or
+   return -1.  */
+extern int sha256_set_implementation(const char *name);
+
 /* Compute SHA256 (SHA224) message digest for LEN bytes beginning at BUFFER. The
    result is always in little endian byte order, so that a byte-wise
    output yields to the wanted ASCII representation of the message
@@ -0,0 +1,147 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* str_intern.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+/* Interned strings are packed into an arena, so that they cost no malloc
+ * header each, and found again through an open addressed table of
+ * pointers with the hash of each string alongside.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "str_intern.h"
+#include "xfuncs.h"
+
+#define TABLE_MIN_SIZE 4096
+
+struct slot {
+    unsigned int hash;
+    const char *str;
+};
+
+static arena_t strings;
+static struct slot *table;
+static unsigned int table_size;
+static unsigned int n_strings;
+static size_t n_bytes;
+static unsigned long n_lookups;
+
+static unsigned int djb2_hash_len(const char *s, size_t len)
+{
+    unsigned int hash = 5381;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        hash = ((hash << 5) + hash) + (unsigned char)s[i];
+    return hash;
+}
+
+static void table_grow(void)
+{
+    struct slot *old = table;
+    unsigned int old_size = table_size;
+    unsigned int i, j;
+
+    table_size = table_size ? table_size * 2 : TABLE_MIN_SIZE;
+    table = xcalloc(table_size, sizeof(struct slot));
+
+    for (i = 0; i < old_size; i++) {
+        if (!old[i].str)
+            continue;
+        j = old[i].hash & (table_size - 1);
+        while (table[j].str)
+            j = (j + 1) & (table_size - 1);
+        table[j] = old[i];
+    }
+    free(old);
+}
+
+const char *str_intern_len(const char *s, size_t len)
+{
+    unsigned int hash, i;
+    char *copy;
+
+    if (!s)
+        return NULL;
+
+    /* Keep the load factor under 3/4. */
+    if ((n_strings + 1) * 4 > table_size * 3)
+        table_grow();
+
+    n_lookups++;
+    hash = djb2_hash_len(s, len);
+    i = hash & (table_size - 1);
+    while (table[i].str) {
+        if (table[i].hash == hash && strncmp(table[i].str, s, len) == 0
+                && table[i].str[len] == '\0')
+            return table[i].str;
+        i = (i + 1) & (table_size - 1);
+    }
+
+    copy = arena_strndup(&strings, s, len);
+
+    table[i].hash = hash;
+    table[i].str = copy;
+    n_strings++;
+    n_bytes += len + 1;
+
+    return copy;
+}
+
+const char *str_intern(const char *s)
+{
+    if (!s)
+        return NULL;
+    return str_intern_len(s, strlen(s));
+}
+
+const char *str_intern_unique(const char *s)
+{
+    if (!s)
+        return NULL;
+
+    n_bytes += strlen(s) + 1;
+    return arena_strdup(&strings, s);
+}
+
+void str_intern_stats(unsigned int *strings, size_t *bytes,
+                      unsigned long *lookups)
+{
+    *strings = n_strings;
+    *bytes = n_bytes;
+    *lookups = n_lookups;
+}
+
+void str_intern_print_stats(void)
+{
+    printf("str_intern: %u strings, %lu bytes in %lu bytes of chunks\n"
+           "\ttable_size=%u, n_lookups=%lu\n", n_strings,
+           (unsigned long)n_bytes, (unsigned long)strings.n_chunk_bytes, table_size,
+           n_lookups);
+}
+
+void str_intern_deinit(void)
+{
+    arena_deinit(&strings);
+    free(table);
+    table = NULL;
+    table_size = 0;
+    n_strings = 0;
+    n_bytes = 0;
+    n_lookups = 0;
+}
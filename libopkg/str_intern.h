@@ -0,0 +1,46 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* str_intern.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef STR_INTERN_H
+#define STR_INTERN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns the one copy of s kept for the rest of the run, so that equal
+ * strings share storage and can be compared by pointer. The copies are
+ * never moved and are only freed, all at once, by str_intern_deinit().
+ * A NULL s gives NULL.
+ */
+const char *str_intern(const char *s);
+const char *str_intern_len(const char *s, size_t len);
+
+/* For strings which are unlikely to be shared, such as checksums and
+ * descriptions: stores s with the interned strings, and frees it with
+ * them, but doesn't look for or index an equal string.
+ */
+const char *str_intern_unique(const char *s);
+
+void str_intern_stats(unsigned int *n_strings, size_t *n_bytes,
+                      unsigned long *n_lookups);
+void str_intern_print_stats(void);
+void str_intern_deinit(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* STR_INTERN_H */
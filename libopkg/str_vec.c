@@ -0,0 +1,187 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* str_vec.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "str_vec.h"
+#include "xfuncs.h"
+
+/* Shorter vectors are searched by a plain scan. */
+#define INDEX_MIN_LEN 16
+
+struct str_vec_slot {
+    unsigned int hash;
+    unsigned int n;             /* slot in strs plus one, 0 if empty */
+};
+
+static unsigned int djb2_hash(const char *s)
+{
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = (unsigned char)*s++))
+        hash = ((hash << 5) + hash) + c;
+    return hash;
+}
+
+str_vec_t *str_vec_alloc(void)
+{
+    str_vec_t *vec = xmalloc(sizeof(str_vec_t));
+    str_vec_init(vec);
+    return vec;
+}
+
+void str_vec_init(str_vec_t * vec)
+{
+    memset(vec, 0, sizeof(str_vec_t));
+}
+
+void str_vec_deinit(str_vec_t * vec)
+{
+    free(vec->strs);
+    free(vec->index);
+    arena_deinit(&vec->strings);
+    str_vec_init(vec);
+}
+
+void str_vec_free(str_vec_t * vec)
+{
+    if (!vec)
+        return;
+    str_vec_deinit(vec);
+    free(vec);
+}
+
+static void index_insert(str_vec_t * vec, unsigned int i)
+{
+    unsigned int hash = djb2_hash(vec->strs[i]);
+    unsigned int j = hash & (vec->index_size - 1);
+
+    while (vec->index[j].n)
+        j = (j + 1) & (vec->index_size - 1);
+    vec->index[j].hash = hash;
+    vec->index[j].n = i + 1;
+}
+
+static void index_build(str_vec_t * vec)
+{
+    unsigned int i;
+
+    free(vec->index);
+    vec->index_size = 64;
+    while (vec->index_size < vec->len * 2)
+        vec->index_size *= 2;
+    vec->index = xcalloc(vec->index_size, sizeof(struct str_vec_slot));
+
+    for (i = 0; i < vec->len; i++)
+        if (vec->strs[i])
+            index_insert(vec, i);
+}
+
+static void append_slot(str_vec_t * vec, const char *copy)
+{
+    if (vec->len == vec->size) {
+        vec->size = vec->size ? vec->size * 2 : 16;
+        vec->strs = xrealloc(vec->strs, vec->size * sizeof(char *));
+    }
+    vec->strs[vec->len++] = copy;
+
+    if (vec->index) {
+        if (vec->len * 2 > vec->index_size)
+            index_build(vec);
+        else
+            index_insert(vec, vec->len - 1);
+    }
+}
+
+const char *str_vec_append_len(str_vec_t * vec, const char *s, size_t len)
+{
+    const char *copy = arena_strndup(&vec->strings, s, len);
+
+    append_slot(vec, copy);
+    return copy;
+}
+
+const char *str_vec_append(str_vec_t * vec, const char *s)
+{
+    return str_vec_append_len(vec, s, strlen(s));
+}
+
+const char *str_vec_next(const str_vec_t * vec, unsigned int *iter)
+{
+    const char *s;
+
+    while (*iter < vec->len) {
+        s = vec->strs[(*iter)++];
+        if (s)
+            return s;
+    }
+    return NULL;
+}
+
+int str_vec_find(str_vec_t * vec, const char *s)
+{
+    unsigned int hash, i, j;
+    const char *t;
+
+    if (vec->len - vec->n_removed < INDEX_MIN_LEN && !vec->index) {
+        for (i = 0; i < vec->len; i++)
+            if (vec->strs[i] && strcmp(vec->strs[i], s) == 0)
+                return i;
+        return -1;
+    }
+
+    if (!vec->index)
+        index_build(vec);
+
+    /* Removed strings keep their place in the index, so that the probe
+     * sequences of the others aren't broken. */
+    hash = djb2_hash(s);
+    j = hash & (vec->index_size - 1);
+    while (vec->index[j].n) {
+        i = vec->index[j].n - 1;
+        t = vec->strs[i];
+        if (t && vec->index[j].hash == hash && strcmp(t, s) == 0)
+            return i;
+        j = (j + 1) & (vec->index_size - 1);
+    }
+    return -1;
+}
+
+int str_vec_contains(str_vec_t * vec, const char *s)
+{
+    return str_vec_find(vec, s) != -1;
+}
+
+void str_vec_remove_at(str_vec_t * vec, unsigned int i)
+{
+    if (i >= vec->len || !vec->strs[i])
+        return;
+    /* The string itself stays in the arena until the vector goes. */
+    vec->strs[i] = NULL;
+    vec->n_removed++;
+}
+
+int str_vec_remove(str_vec_t * vec, const char *s)
+{
+    int i = str_vec_find(vec, s);
+
+    if (i == -1)
+        return 0;
+    str_vec_remove_at(vec, i);
+    return 1;
+}
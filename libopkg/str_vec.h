@@ -0,0 +1,77 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* str_vec.h - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+*/
+
+#ifndef STR_VEC_H
+#define STR_VEC_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* A vector of strings, for long lists such as package file lists. The
+ * strings are copied into an arena owned by the vector, so a list costs a
+ * handful of allocations however long it is.
+ *
+ * Removing a string leaves a hole rather than moving the rest along, so
+ * it is safe while walking the vector with str_vec_next(). Lookups build
+ * a hash index the first time they are needed on a longer vector.
+ */
+typedef struct str_vec str_vec_t;
+
+struct str_vec_slot;
+
+struct str_vec {
+    const char **strs;
+    unsigned int len;           /* slots used, removed ones included */
+    unsigned int size;
+    unsigned int n_removed;
+    struct str_vec_slot *index;
+    unsigned int index_size;
+    arena_t strings;
+};
+
+str_vec_t *str_vec_alloc(void);
+void str_vec_init(str_vec_t * vec);
+void str_vec_deinit(str_vec_t * vec);
+void str_vec_free(str_vec_t * vec);
+
+const char *str_vec_append(str_vec_t * vec, const char *s);
+const char *str_vec_append_len(str_vec_t * vec, const char *s, size_t len);
+
+/* Returns the string at or after *iter which hasn't been removed, and
+ * moves *iter past it, or returns NULL at the end. Start with *iter = 0.
+ */
+const char *str_vec_next(const str_vec_t * vec, unsigned int *iter);
+
+/* Returns the slot holding s, or -1. */
+int str_vec_find(str_vec_t * vec, const char *s);
+int str_vec_contains(str_vec_t * vec, const char *s);
+
+void str_vec_remove_at(str_vec_t * vec, unsigned int i);
+/* Removes the first copy of s, returning 1 if there was one. */
+int str_vec_remove(str_vec_t * vec, const char *s);
+
+static inline unsigned int str_vec_count(const str_vec_t * vec)
+{
+    return vec->len - vec->n_removed;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif                          /* STR_VEC_H */
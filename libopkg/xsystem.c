@@ -39,14 +39,43 @@ int xsystem(const char *argv[])
     pid_t pid;
     int r;
 
-    pid = vfork();
+    pid = xsystem_spawn(argv, -1);
+    if (pid == -1)
+        return -1;
+
+    r = waitpid(pid, &status, 0);
+    if (r == -1) {
+        opkg_perror(ERROR, "%s: waitpid", argv[0]);
+        return -1;
+    }
+
+    return xsystem_status(argv[0], status);
+}
+
+pid_t xsystem_spawn(const char *argv[], int out_fd)
+{
+    pid_t pid;
+
+    /* The child has to redirect its output before the exec, which isn't
+     * allowed after a vfork. */
+    if (out_fd == -1)
+        pid = vfork();
+    else
+        pid = fork();
 
     switch (pid) {
     case -1:
-        opkg_perror(ERROR, "%s: vfork", argv[0]);
+        opkg_perror(ERROR, "%s: %s", argv[0],
+                    out_fd == -1 ? "vfork" : "fork");
         return -1;
     case 0:
         /* child */
+        if (out_fd != -1) {
+            if (dup2(out_fd, STDOUT_FILENO) == -1
+                    || dup2(out_fd, STDERR_FILENO) == -1)
+                _exit(-1);
+            close(out_fd);
+        }
         execvp(argv[0], (char *const *)argv);
         _exit(-1);
     default:
@@ -54,14 +83,13 @@ int xsystem(const char *argv[])
         break;
     }
 
-    r = waitpid(pid, &status, 0);
-    if (r == -1) {
-        opkg_perror(ERROR, "%s: waitpid", argv[0]);
-        return -1;
-    }
+    return pid;
+}
 
+int xsystem_status(const char *name, int status)
+{
     if (WIFSIGNALED(status)) {
-        opkg_msg(ERROR, "%s: Child killed by signal %d.\n", argv[0],
+        opkg_msg(ERROR, "%s: Child killed by signal %d.\n", name,
                  WTERMSIG(status));
         return -1;
     }
@@ -70,7 +98,7 @@ int xsystem(const char *argv[])
         /* shouldn't happen */
         opkg_msg(ERROR,
                  "%s: Your system is broken: got status %d " "from waitpid.\n",
-                 argv[0], status);
+                 name, status);
         return -1;
     }
 
@@ -19,6 +19,8 @@
 #ifndef XSYSTEM_H
 #define XSYSTEM_H
 
+#include <sys/types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,6 +35,16 @@ extern "C" {
 */
 int xsystem(const char *argv[]);
 
+/* Starts argv without waiting for it, with its stdout and stderr sent to
+   out_fd unless that is -1. Returns the child's pid, or -1.
+*/
+pid_t xsystem_spawn(const char *argv[], int out_fd);
+
+/* Turns a status from waitpid() for the child running name into a return
+   value as for xsystem().
+*/
+int xsystem_status(const char *name, int status);
+
 #ifdef __cplusplus
 }
 #endif
@@ -32,6 +32,8 @@
 #include "file_util.h"
 #include "opkg_message.h"
 #include "opkg_download.h"
+#include "opkg_profile.h"
+#include "opkg_solv.h"
 #include "xfuncs.h"
 
 enum {
@@ -58,6 +60,8 @@ enum {
     ARGS_OPT_VOLATILE_CACHE,
     ARGS_OPT_COMBINE,
     ARGS_OPT_NO_INSTALL_RECOMMENDS,
+    ARGS_OPT_PROFILE,
+    ARGS_OPT_PLAN_OUT,
 };
 
 static struct option long_options[] = {
@@ -101,6 +105,8 @@ static struct option long_options[] = {
     {"download-only", 0, 0, ARGS_OPT_DOWNLOAD_ONLY},
     {"nodeps", 0, 0, ARGS_OPT_NODEPS},
     {"no-install-recommends", 0, 0, ARGS_OPT_NO_INSTALL_RECOMMENDS},
+    {"profile", 1, 0, ARGS_OPT_PROFILE},
+    {"plan-out", 1, 0, ARGS_OPT_PLAN_OUT},
     {"offline", 1, 0, 'o'},
     {"offline-root", 1, 0, 'o'},
     {"add-arch", 1, 0, ARGS_OPT_ADD_ARCH},
@@ -227,6 +233,14 @@ static int args_parse(int argc, char *argv[])
         case ARGS_OPT_COMBINE:
             opkg_config->combine = 1;
             break;
+        case ARGS_OPT_PROFILE:
+            free(opkg_config->profile_file);
+            opkg_config->profile_file = xstrdup(optarg);
+            break;
+        case ARGS_OPT_PLAN_OUT:
+            free(opkg_config->plan_out);
+            opkg_config->plan_out = xstrdup(optarg);
+            break;
         case ':':
             parse_err = -1;
             break;
@@ -255,6 +269,9 @@ static void usage()
     printf("\tinstall <pkgs>                  Install package(s)\n");
     printf("\tconfigure <pkgs>                Configure unpacked package(s)\n");
     printf("\tremove <pkgs|glob>              Remove package(s)\n");
+    printf("\tapply-plan <file>               Commit a transaction written by --plan-out\n");
+    printf("\ttransaction <op>:<pkg>...       Install, remove, upgrade or lock (op)\n");
+    printf("\t                                packages in a single transaction\n");
     printf("\tclean                           Clean internal cache\n");
     printf("\tflag <flag> <pkgs>              Flag package(s)\n");
     printf("\t <flag>=hold|noprune|user|ok|installed|unpacked (one per invocation)\n");
@@ -265,9 +282,10 @@ static void usage()
     printf("\tlist-upgradable                 List installed and upgradable packages\n");
     printf("\tlist-changed-conffiles          List user modified configuration files\n");
     printf("\tfiles <pkg>                     List files belonging to <pkg>\n");
-    printf("\tsearch <file|glob>              List package providing <file>\n");
+    printf("\tsearch <file|glob>...           List packages providing <file>\n");
     printf("\tinfo [pkg|glob]                 Display all info for <pkg>\n");
     printf("\tstatus [pkg|glob]               Display all status for <pkg>\n");
+    printf("\tverify [pkg|glob]               Check installed files of <pkg> are unchanged\n");
     printf("\tdownload <pkg>                  Download <pkg> to current directory\n");
     printf("\tcompare-versions <v1> <op> <v2>\n");
     printf("\t                                compare versions using <= < > >= = << >>\n");
@@ -328,6 +346,10 @@ static void usage()
     printf("\t--tmp-dir                       Specify tmp-dir.\n");
     printf("\t--volatile-cache                Use volatile cache.\n");
     printf("\t                                Volatile cache will be cleared on exit\n");
+    printf("\t--profile <file>                Write timings of each phase of the run\n");
+    printf("\t                                to <file> as JSON\n");
+    printf("\t--plan-out <file>               Write the transaction to <file> for\n");
+    printf("\t                                apply-plan instead of committing it\n");
 
     printf("\n");
 
@@ -343,11 +365,9 @@ static void usage()
 
 int main(int argc, char *argv[])
 {
-    int opts, err = -1;
+    int opts, r, err = -1;
     char *cmd_name = NULL;
     opkg_cmd_t *cmd;
-    int nocheckfordirorfile;
-    int noreadfeedsfile;
 
     if (opkg_conf_init())
         goto err0;
@@ -362,55 +382,36 @@ int main(int argc, char *argv[])
 
     cmd_name = argv[opts++];
 
-    nocheckfordirorfile = !strcmp(cmd_name, "print-architecture")
-        || !strcmp(cmd_name, "print_architecture")
-        || !strcmp(cmd_name, "print-installation-architecture")
-        || !strcmp(cmd_name, "print_installation_architecture");
-
-    noreadfeedsfile = !strcmp(cmd_name, "flag")
-        || !strcmp(cmd_name, "configure")
-        || !strcmp(cmd_name, "remove")
-        || !strcmp(cmd_name, "files")
-        || !strcmp(cmd_name, "search")
-        || !strcmp(cmd_name, "compare_versions")
-        || !strcmp(cmd_name, "compare-versions")
-        || !strcmp(cmd_name, "list_installed")
-        || !strcmp(cmd_name, "list-installed")
-        || !strcmp(cmd_name, "list_changed_conffiles")
-        || !strcmp(cmd_name, "list-changed-conffiles")
-        || !strcmp(cmd_name, "status");
-
     cmd = opkg_cmd_find(cmd_name);
     if (cmd == NULL) {
         fprintf(stderr, "%s: unknown sub-command %s\n", argv[0], cmd_name);
         usage();
     }
 
-    if (opkg_conf_load())
+    opkg_profile_begin("conf_load");
+    r = opkg_conf_load();
+    opkg_profile_end("conf_load");
+    if (r)
         goto err0;
 
     opkg_solv_init();
 
-    if (!nocheckfordirorfile) {
-        if (!noreadfeedsfile) {
-            if (opkg_solv_load_feeds())
-                goto err1;
-        }
-
-        if (opkg_solv_load_status_files())
-            goto err1;
-    }
-
     if (cmd->requires_args && opts == argc) {
         fprintf(stderr, "%s: the ``%s'' command requires at least one argument\n",
                 argv[0], cmd_name);
         usage();
     }
 
+    if (opkg_cmd_load(cmd))
+        goto err1;
+
+    opkg_profile_begin("command");
     err = opkg_cmd_exec(cmd, argc - opts, (const char **)(argv + opts));
+    opkg_profile_end("command");
 
     opkg_download_cleanup();
  err1:
+    opkg_profile_write(cmd_name, err);
     opkg_conf_deinit();
 
  err0:
@@ -0,0 +1,638 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkg_bench.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   Micro-benchmarks of libopkg's primitives, built and run by "make bench".
+   Each benchmark runs its operation enough times to fill the minimum time
+   and reports ns/op and, with glibc, allocations and bytes allocated per
+   op. Inputs are generated from a fixed seed so that runs are comparable.
+*/
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <solv/pool.h>
+#include <solv/evr.h>
+
+#include "arena.h"
+#include "file_util.h"
+#include "hash_table.h"
+#include "line_scan.h"
+#include "md5.h"
+#include "parse_util.h"
+#include "release.h"
+#include "release_parse.h"
+#include "sprintf_alloc.h"
+#include "str_list.h"
+#include "str_vec.h"
+#include "void_list.h"
+#include "xfuncs.h"
+#ifdef HAVE_SHA256
+#include "sha256.h"
+#endif
+
+#define N_KEYS 16384
+#define HASH_BUF_LEN 4096
+#define LINES_FILE_LEN (1 << 20)
+
+/* Count allocations by wrapping glibc's allocator, which libopkg's calls
+ * resolve to as well.
+ */
+static unsigned long n_allocs;
+static unsigned long n_alloc_bytes;
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+void *malloc(size_t size)
+{
+    n_allocs++;
+    n_alloc_bytes += size;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    n_allocs++;
+    n_alloc_bytes += nmemb * size;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    n_allocs++;
+    n_alloc_bytes += size;
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+#define COUNTS_ALLOCS 1
+#else
+#define COUNTS_ALLOCS 0
+#endif
+
+struct bench {
+    const char *name;
+    void (*run)(unsigned long n);
+    /* Bytes processed per op, for a throughput figure. */
+    size_t bytes;
+    /* Name of the SHA-256 implementation to select before running. */
+    const char *impl;
+};
+
+/* Results are stored here so that the compiler can't drop the work. */
+static volatile unsigned long sink;
+
+static unsigned int rand_state = 0x6f706b67;
+
+static unsigned int bench_rand(void)
+{
+    /* xorshift32, so that inputs don't depend on the libc. */
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static char *keys[N_KEYS];
+static char *miss_keys[N_KEYS];
+static hash_table_t lookup_table;
+static char *versions[N_KEYS];
+static char *packages_text;
+static size_t packages_len;
+static char *release_text;
+static size_t release_len;
+static char hash_buf[HASH_BUF_LEN];
+static char lines_file[] = "/tmp/opkg-bench.XXXXXX";
+
+static const char *depends_line =
+    "libc6 (>= 2.13), libgcc1 (>= 1:4.1.1), libssl1.0.0 (>= 1.0.1), "
+    "zlib1g (>= 1:1.1.4), libcurl3 | libcurl4, debconf (>= 0.5) | "
+    "debconf-2.0, adduser, lsb-base (>= 3.0-6)";
+
+static void setup_inputs(void)
+{
+    unsigned int i, j, r;
+    size_t size = 0;
+    FILE *fp;
+    int fd;
+
+    for (i = 0; i < N_KEYS; i++) {
+        sprintf_alloc(&keys[i], "pkg-%05x-%x", i, bench_rand() & 0xffff);
+        sprintf_alloc(&miss_keys[i], "missing-%05x", i);
+
+        r = bench_rand();
+        switch (r % 4) {
+        case 0:
+            sprintf_alloc(&versions[i], "%u.%u.%u", r % 5, (r >> 3) % 20,
+                          (r >> 8) % 50);
+            break;
+        case 1:
+            sprintf_alloc(&versions[i], "%u.%u-r%u", r % 5, (r >> 3) % 20,
+                          (r >> 8) % 10);
+            break;
+        case 2:
+            sprintf_alloc(&versions[i], "%u:%u.%u~rc%u-%u", r % 3,
+                          (r >> 3) % 20, (r >> 8) % 50, (r >> 12) % 4,
+                          (r >> 16) % 3);
+            break;
+        default:
+            sprintf_alloc(&versions[i], "%u.%u+git%08x", r % 5,
+                          (r >> 3) % 20, bench_rand());
+            break;
+        }
+    }
+
+    hash_table_init("bench", &lookup_table, N_KEYS);
+    for (i = 0; i < N_KEYS; i++)
+        hash_table_insert(&lookup_table, keys[i], keys[i]);
+
+    fp = open_memstream(&packages_text, &size);
+    for (i = 0; i < 2048; i++) {
+        fprintf(fp, "Package: %s\nVersion: %s\nDepends: %s\n"
+                "Architecture: all\nFilename: %s_%s_all.opk\n"
+                "Size: %u\nMD5Sum: %08x%08x%08x%08x\n"
+                "Description: Package number %u\n\n",
+                keys[i], versions[i], depends_line, keys[i], versions[i],
+                bench_rand() % 100000, bench_rand(), bench_rand(),
+                bench_rand(), bench_rand(), i);
+    }
+    fclose(fp);
+    packages_len = size;
+
+    fp = open_memstream(&release_text, &size);
+    /* The parser stops at the first field it doesn't know. */
+    fprintf(fp, "Codename: bench\n"
+            "Date: Thu, 01 Jan 2015 00:00:00 UTC\n"
+            "Architectures: all armv7a i686 x86_64\n"
+            "Components: main contrib non-free\nMD5sum:\n");
+    for (i = 0; i < 64; i++) {
+        fprintf(fp, " ");
+        for (j = 0; j < 4; j++)
+            fprintf(fp, "%08x", bench_rand());
+        fprintf(fp, " %u main/binary-all/Packages%s\n", bench_rand() % 100000,
+                i % 2 ? ".gz" : "");
+    }
+    fprintf(fp, "SHA256:\n");
+    for (i = 0; i < 64; i++) {
+        fprintf(fp, " ");
+        for (j = 0; j < 8; j++)
+            fprintf(fp, "%08x", bench_rand());
+        fprintf(fp, " %u main/binary-all/Packages%s\n", bench_rand() % 100000,
+                i % 2 ? ".gz" : "");
+    }
+    fclose(fp);
+    release_len = size;
+
+    /* A file of Packages paragraphs for the line readers, cut to size. */
+    fd = mkstemp(lines_file);
+    if (fd == -1) {
+        perror(lines_file);
+        exit(1);
+    }
+    for (size = 0; size < LINES_FILE_LEN; size += r) {
+        r = LINES_FILE_LEN - size < packages_len ?
+                LINES_FILE_LEN - size : packages_len;
+        if (write(fd, packages_text, r) != (ssize_t) r) {
+            perror(lines_file);
+            exit(1);
+        }
+    }
+    close(fd);
+
+    for (i = 0; i < HASH_BUF_LEN; i++)
+        hash_buf[i] = bench_rand();
+}
+
+static void bench_hash_table_insert(unsigned long n)
+{
+    hash_table_t hash;
+    unsigned long i;
+
+    hash_table_init("bench-insert", &hash, N_KEYS);
+    for (i = 0; i < n; i++) {
+        if (i && i % N_KEYS == 0) {
+            hash_table_deinit(&hash);
+            hash_table_init("bench-insert", &hash, N_KEYS);
+        }
+        hash_table_insert(&hash, keys[i % N_KEYS], keys[i % N_KEYS]);
+    }
+    hash_table_deinit(&hash);
+}
+
+static void bench_hash_table_get_hit(unsigned long n)
+{
+    unsigned long i;
+
+    for (i = 0; i < n; i++)
+        sink += (unsigned long)hash_table_get(&lookup_table, keys[i % N_KEYS]);
+}
+
+static void bench_hash_table_get_miss(unsigned long n)
+{
+    unsigned long i;
+
+    for (i = 0; i < n; i++)
+        sink += (unsigned long)hash_table_get(&lookup_table,
+                                              miss_keys[i % N_KEYS]);
+}
+
+static void bench_str_list_append(unsigned long n)
+{
+    str_list_t *list = str_list_alloc();
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        if (i && i % 1024 == 0) {
+            str_list_purge(list);
+            list = str_list_alloc();
+        }
+        str_list_append(list, keys[i % N_KEYS]);
+    }
+    str_list_purge(list);
+}
+
+static void bench_str_list_contains(unsigned long n)
+{
+    str_list_t *list = str_list_alloc();
+    unsigned long i;
+
+    for (i = 0; i < 256; i++)
+        str_list_append(list, keys[i]);
+    for (i = 0; i < n; i++)
+        sink += str_list_contains(list, keys[i % 512]);
+    str_list_purge(list);
+}
+
+static void bench_str_vec_append(unsigned long n)
+{
+    str_vec_t *vec = str_vec_alloc();
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        if (i && i % 1024 == 0) {
+            str_vec_free(vec);
+            vec = str_vec_alloc();
+        }
+        str_vec_append(vec, keys[i % N_KEYS]);
+    }
+    str_vec_free(vec);
+}
+
+static void bench_str_vec_contains(unsigned long n)
+{
+    str_vec_t *vec = str_vec_alloc();
+    unsigned long i;
+
+    for (i = 0; i < 256; i++)
+        str_vec_append(vec, keys[i]);
+    for (i = 0; i < n; i++)
+        sink += str_vec_contains(vec, keys[i % 512]);
+    str_vec_free(vec);
+}
+
+static void bench_void_list_push_pop(unsigned long n)
+{
+    void_list_t list;
+    void_list_elt_t *elt;
+    unsigned long i;
+
+    void_list_init(&list);
+    for (i = 0; i < n; i++) {
+        void_list_push(&list, keys[i % N_KEYS]);
+        if (i % 4 == 3) {
+            while ((elt = void_list_pop(&list)) != NULL)
+                free(elt);
+        }
+    }
+    void_list_deinit(&list);
+}
+
+static void bench_evrcmp(unsigned long n)
+{
+    Pool *pool = pool_create();
+    unsigned long i;
+
+    for (i = 0; i < n; i++)
+        sink += pool_evrcmp_str(pool, versions[i % N_KEYS],
+                                versions[(i + 1) % N_KEYS], EVRCMP_COMPARE);
+    pool_free(pool);
+}
+
+static void bench_file_read_line_alloc(unsigned long n)
+{
+    FILE *fp = fmemopen(packages_text, packages_len, "r");
+    unsigned long i;
+    char *line;
+
+    for (i = 0; i < n; i++) {
+        line = file_read_line_alloc(fp);
+        if (!line) {
+            rewind(fp);
+            line = file_read_line_alloc(fp);
+        }
+        sink += line[0];
+        free(line);
+    }
+    fclose(fp);
+}
+
+/* The line readers each count the lines of the same file, once per op. */
+static int count_line(void *ptr, const char *line, unsigned int mask)
+{
+    (*(unsigned long *)ptr)++;
+    return 0;
+}
+
+static void bench_lines_read_line_alloc(unsigned long n)
+{
+    unsigned long i;
+    char *line;
+    FILE *fp;
+
+    for (i = 0; i < n; i++) {
+        fp = fopen(lines_file, "r");
+        while ((line = file_read_line_alloc(fp)) != NULL) {
+            sink++;
+            free(line);
+        }
+        fclose(fp);
+    }
+}
+
+static void bench_lines_parse_from_stream(unsigned long n)
+{
+    unsigned long i, count = 0;
+    const size_t len = 4096;
+    char *buf = xmalloc(len);
+    FILE *fp;
+
+    for (i = 0; i < n; i++) {
+        fp = fopen(lines_file, "r");
+        parse_from_stream_nomalloc(count_line, &count, fp, 0, &buf, len);
+        fclose(fp);
+    }
+    free(buf);
+    sink += count;
+}
+
+static void bench_lines_parse_from_file(unsigned long n)
+{
+    unsigned long i, count = 0;
+
+    for (i = 0; i < n; i++)
+        parse_from_file(count_line, &count, lines_file, 0);
+    sink += count;
+}
+
+static void bench_lines_line_scan(unsigned long n)
+{
+    line_scan_t scan;
+    unsigned long i;
+    size_t len;
+
+    for (i = 0; i < n; i++) {
+        line_scan_open(&scan, lines_file);
+        while (line_scan_next(&scan, &len) != NULL)
+            sink += len;
+        line_scan_close(&scan);
+    }
+}
+
+static void bench_sprintf_alloc(unsigned long n)
+{
+    unsigned long i;
+    char *s;
+
+    for (i = 0; i < n; i++) {
+        sprintf_alloc(&s, "%s_%s_%s.opk", keys[i % N_KEYS],
+                      versions[i % N_KEYS], "all");
+        sink += s[0];
+        free(s);
+    }
+}
+
+static void bench_arena_sprintf(unsigned long n)
+{
+    unsigned long i;
+    arena_t arena;
+    char *s;
+
+    /* Reset every 256 strings, as the scratch arena is between packages. */
+    arena_init(&arena);
+    for (i = 0; i < n; i++) {
+        s = arena_sprintf(&arena, "%s_%s_%s.opk", keys[i % N_KEYS],
+                          versions[i % N_KEYS], "all");
+        sink += s[0];
+        if ((i & 255) == 255)
+            arena_reset(&arena);
+    }
+    arena_deinit(&arena);
+}
+
+static void bench_parse_list(unsigned long n)
+{
+    unsigned long i;
+    unsigned int j, count;
+    char **list;
+
+    for (i = 0; i < n; i++) {
+        list = parse_list(depends_line, &count, ',', 1);
+        for (j = 0; j < count; j++)
+            free(list[j]);
+        free(list);
+        sink += count;
+    }
+}
+
+static void free_cksum_list(cksum_list_t * list)
+{
+    if (list) {
+        cksum_list_deinit(list);
+        free(list);
+    }
+}
+
+static void bench_release_parse(unsigned long n)
+{
+    release_t *release;
+    unsigned long i;
+    FILE *fp;
+
+    for (i = 0; i < n; i++) {
+        fp = fmemopen(release_text, release_len, "r");
+        release = release_new();
+        sink += release_parse_from_stream(release, fp);
+        fclose(fp);
+        free_cksum_list(release->md5sums);
+        free_cksum_list(release->sha256sums);
+        release_deinit(release);
+        free(release);
+    }
+}
+
+static void bench_md5_buffer(unsigned long n)
+{
+    unsigned char md5sum[16];
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        md5_buffer(hash_buf, HASH_BUF_LEN, md5sum);
+        sink += md5sum[0];
+    }
+}
+
+#ifdef HAVE_SHA256
+static void bench_sha256_buffer(unsigned long n)
+{
+    unsigned char sha256sum[32];
+    unsigned long i;
+
+    for (i = 0; i < n; i++) {
+        sha256_buffer(hash_buf, HASH_BUF_LEN, sha256sum);
+        sink += sha256sum[0];
+    }
+}
+#endif
+
+static const struct bench benches[] = {
+    {"hash_table_insert", bench_hash_table_insert, 0, NULL},
+    {"hash_table_get_hit", bench_hash_table_get_hit, 0, NULL},
+    {"hash_table_get_miss", bench_hash_table_get_miss, 0, NULL},
+    {"str_list_append", bench_str_list_append, 0, NULL},
+    {"str_list_contains_256", bench_str_list_contains, 0, NULL},
+    {"str_vec_append", bench_str_vec_append, 0, NULL},
+    {"str_vec_contains_256", bench_str_vec_contains, 0, NULL},
+    {"void_list_push_pop", bench_void_list_push_pop, 0, NULL},
+    {"evrcmp", bench_evrcmp, 0, NULL},
+    {"file_read_line_alloc", bench_file_read_line_alloc, 0, NULL},
+    {"lines_file_read_line_alloc", bench_lines_read_line_alloc,
+     LINES_FILE_LEN, NULL},
+    {"lines_parse_from_stream", bench_lines_parse_from_stream, LINES_FILE_LEN,
+     NULL},
+    {"lines_parse_from_file", bench_lines_parse_from_file, LINES_FILE_LEN,
+     NULL},
+    {"lines_line_scan", bench_lines_line_scan, LINES_FILE_LEN, NULL},
+    {"sprintf_alloc", bench_sprintf_alloc, 0, NULL},
+    {"arena_sprintf", bench_arena_sprintf, 0, NULL},
+    {"parse_list_depends", bench_parse_list, 0, NULL},
+    {"release_parse", bench_release_parse, 0, NULL},
+    {"md5_buffer_4k", bench_md5_buffer, HASH_BUF_LEN, NULL},
+#ifdef HAVE_SHA256
+    {"sha256_buffer_4k_generic", bench_sha256_buffer, HASH_BUF_LEN,
+     "generic"},
+    {"sha256_buffer_4k_shani", bench_sha256_buffer, HASH_BUF_LEN, "shani"},
+    {"sha256_buffer_4k_armv8", bench_sha256_buffer, HASH_BUF_LEN, "armv8"},
+#endif
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_bench(const struct bench *b, double min_ns)
+{
+    unsigned long n = 1, allocs;
+    double start, elapsed;
+
+#ifdef HAVE_SHA256
+    if (b->impl && sha256_set_implementation(b->impl) < 0) {
+        printf("%-28s %12s\n", b->name, "unsupported");
+        return;
+    }
+#endif
+
+    /* Grow n until a run fills the minimum time. */
+    for (;;) {
+        n_allocs = 0;
+        n_alloc_bytes = 0;
+        start = now_ns();
+        b->run(n);
+        elapsed = now_ns() - start;
+        if (elapsed >= min_ns || n >= 1UL << 40)
+            break;
+        if (elapsed < min_ns / 100)
+            n *= 100;
+        else
+            n = n * (min_ns / elapsed) * 1.2 + 1;
+    }
+    allocs = n_allocs;
+
+    printf("%-28s %12lu %12.1f ns/op", b->name, n, elapsed / n);
+    if (COUNTS_ALLOCS)
+        printf(" %8.2f allocs/op %10.1f B/op", (double)allocs / n,
+               (double)n_alloc_bytes / n);
+    if (b->bytes)
+        printf(" %8.1f MB/s", b->bytes * n / (elapsed / 1e9) / 1e6);
+    printf("\n");
+}
+
+static void usage(const char *prog)
+{
+    printf("usage: %s [-l] [-t <ms>] [name...]\n", prog);
+    printf("\t-l         List the benchmarks\n");
+    printf("\t-t <ms>    Run each benchmark for at least <ms> (default 200)\n");
+    printf("\tname...    Run only the benchmarks whose names contain one of\n");
+    printf("\t           these\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    double min_ns = 200e6;
+    unsigned int i;
+    int c, j, selected;
+
+    while ((c = getopt(argc, argv, "lt:h")) != -1) {
+        switch (c) {
+        case 'l':
+            for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++)
+                printf("%s\n", benches[i].name);
+            return 0;
+        case 't':
+            min_ns = atof(optarg) * 1e6;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    setup_inputs();
+
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        selected = optind == argc;
+        for (j = optind; j < argc; j++) {
+            if (strstr(benches[i].name, argv[j]))
+                selected = 1;
+        }
+        if (selected)
+            run_bench(&benches[i], min_ns);
+    }
+
+    unlink(lines_file);
+    return 0;
+}
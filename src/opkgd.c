@@ -0,0 +1,636 @@
+/* vi: set expandtab sw=4 sts=4: */
+/* opkgd.c - the opkg package management system
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License as
+   published by the Free Software Foundation; either version 2, or (at
+   your option) any later version.
+
+   This program is distributed in the hope that it will be useful, but
+   WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   opkg daemon: loads the configuration, package lists and status once and
+   serves opkg commands from them over a Unix socket.
+
+   A client connects, writes one line holding a command and its arguments
+   separated by spaces, as they would be given to opkg, and reads what the
+   command prints until the connection is closed. The last line is
+   "opkgd: exit <status>".
+
+   Each request is served in a child forked from the loaded state, so
+   that one can't disturb the next. A request has to arrive within
+   OPKGD_REQUEST_TIMEOUT seconds of connecting. Requests which only look
+   are served alongside each other. One which changes the system takes the
+   opkg lock, as opkg would, once it has been read and checked; it waits
+   for the previous such request to finish, and holds the lock until it
+   has finished itself. Requests which look in the meantime are answered
+   from the state loaded before it. If the package lists or status files
+   have changed since they were loaded, or on SIGHUP, the daemon executes
+   itself again to reload them, keeping its socket and leaving requests
+   being served to finish.
+*/
+
+#include "config.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "opkg_conf.h"
+#include "opkg_cmd.h"
+#include "opkg_download.h"
+#include "opkg_message.h"
+#include "opkg_solv.h"
+#include "sprintf_alloc.h"
+#include "xfuncs.h"
+
+#define OPKGD_DEFAULT_SOCKET "/var/run/opkgd.sock"
+#define OPKGD_MAX_REQUEST 4096
+#define OPKGD_MAX_ARGS 256
+#define OPKGD_REQUEST_TIMEOUT 10
+
+/* Passed on to ourselves when reloading. */
+#define OPKGD_LISTEN_FD_ENV "OPKGD_LISTEN_FD"
+#define OPKGD_CONN_FD_ENV "OPKGD_CONN_FD"
+#define OPKGD_REQUEST_ENV "OPKGD_REQUEST"
+
+static char **saved_argv;
+static const char *socket_path = OPKGD_DEFAULT_SOCKET;
+static int listen_fd = -1;
+static unsigned long long loaded_stamp;
+/* The child serving the request which holds the lock, if any, and our
+ * copy of its connection, closed once the lock has been released so that
+ * the client can't get in first with another request. */
+static pid_t locked_pid = -1;
+static int locked_conn = -1;
+/* Our signals are blocked but while waiting for a connection, and in the
+ * children, which run with this mask instead. */
+static sigset_t run_mask;
+
+static volatile sig_atomic_t reload_requested;
+static volatile sig_atomic_t exit_requested;
+
+static void usage(void)
+{
+    printf("usage: opkgd [options...] [socket]\n");
+    printf("\t-f <conf_file>                  Use <conf_file> as the opkg configuration file\n");
+    printf("\t-o <dir>                        Use <dir> as the root directory for\n");
+    printf("\t                                offline installation of packages.\n");
+    printf("\t-V[<level>]                     Set verbosity level to <level>.\n");
+    printf("\n");
+    printf(" The socket defaults to %s.\n", OPKGD_DEFAULT_SOCKET);
+    exit(1);
+}
+
+static void mix(unsigned long long *stamp, unsigned long long v)
+{
+    *stamp = *stamp * 1099511628211ULL ^ v;
+}
+
+static void mix_stat(unsigned long long *stamp, const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st) == -1) {
+        mix(stamp, 0);
+        return;
+    }
+    mix(stamp, st.st_ino);
+    mix(stamp, st.st_size);
+    mix(stamp, st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec);
+}
+
+/* Changes whenever a package list or status file is written. */
+static unsigned long long state_stamp(void)
+{
+    unsigned long long stamp = 14695981039346656037ULL;
+    pkg_dest_list_elt_t *iter;
+    pkg_dest_t *dest;
+    struct dirent **entries;
+    char *path;
+    int i, n;
+
+    for (iter = void_list_first(&opkg_config->pkg_dest_list); iter;
+            iter = void_list_next(&opkg_config->pkg_dest_list, iter)) {
+        dest = (pkg_dest_t *) iter->data;
+        mix_stat(&stamp, dest->status_file_name);
+        mix_stat(&stamp, dest->journal_file_name);
+    }
+
+    n = scandir(opkg_config->lists_dir, &entries, NULL, alphasort);
+    for (i = 0; i < n; i++) {
+        sprintf_alloc(&path, "%s/%s", opkg_config->lists_dir,
+                      entries[i]->d_name);
+        mix_stat(&stamp, path);
+        free(path);
+        free(entries[i]);
+    }
+    if (n > 0)
+        free(entries);
+    mix(&stamp, n);
+
+    return stamp;
+}
+
+static int load(void)
+{
+    int r;
+
+    r = opkg_conf_load();
+    if (r)
+        return r;
+
+    opkg_solv_init();
+
+    r = opkg_solv_load_feeds();
+    if (r == 0)
+        r = opkg_solv_load_status_files();
+    if (r == 0)
+        r = opkg_solv_load_file_owners();
+    if (r) {
+        opkg_conf_deinit();
+        return r;
+    }
+
+    /* Forked requests inherit the prepared pool, and only solve. */
+    opkg_solv_prepare_pool();
+    loaded_stamp = state_stamp();
+
+    /* Nobody can answer questions, so behave as with --batch. */
+    opkg_config->batch = 1;
+
+    print_error_list();
+    free_error_list();
+
+    return opkg_unlock();
+}
+
+static void reload(int conn, const char *request)
+{
+    char fd_str[16];
+
+    opkg_msg(NOTICE, "Reloading package lists and status.\n");
+
+    snprintf(fd_str, sizeof(fd_str), "%d", listen_fd);
+    setenv(OPKGD_LISTEN_FD_ENV, fd_str, 1);
+    if (conn != -1) {
+        /* Serve the request which found the change once reloaded. */
+        fcntl(conn, F_SETFD, 0);
+        snprintf(fd_str, sizeof(fd_str), "%d", conn);
+        setenv(OPKGD_CONN_FD_ENV, fd_str, 1);
+        setenv(OPKGD_REQUEST_ENV, request, 1);
+    } else {
+        unsetenv(OPKGD_CONN_FD_ENV);
+        unsetenv(OPKGD_REQUEST_ENV);
+    }
+
+    opkg_conf_deinit();
+    fflush(stdout);
+    fflush(stderr);
+
+    execv("/proc/self/exe", saved_argv);
+    execvp(saved_argv[0], saved_argv);
+    opkg_perror(ERROR, "Failed to execute %s", saved_argv[0]);
+    exit(1);
+}
+
+static int split_request(char *line, const char **args)
+{
+    char *save, *arg;
+    int n = 0;
+
+    for (arg = strtok_r(line, " \t\r\n", &save); arg;
+            arg = strtok_r(NULL, " \t\r\n", &save)) {
+        if (n == OPKGD_MAX_ARGS)
+            return -1;
+        args[n++] = arg;
+    }
+    return n;
+}
+
+/* Read the request line, giving up on a client which doesn't send one in
+ * time rather than keeping everyone else waiting.
+ */
+static int read_request(int conn, char *line, size_t size)
+{
+    struct timeval tv = { OPKGD_REQUEST_TIMEOUT, 0 };
+    size_t len = 0;
+    ssize_t r;
+
+    if (setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) == -1) {
+        opkg_perror(ERROR, "Failed to set a timeout on the connection");
+        return -1;
+    }
+
+    while (len < size - 1) {
+        r = read(conn, line + len, size - 1 - len);
+        if (r == -1 && errno == EINTR)
+            continue;
+        if (r == -1)
+            return -1;
+        if (r == 0)
+            break;
+        len += r;
+        if (memchr(line + len - r, '\n', r))
+            break;
+    }
+    line[len] = '\0';
+
+    return len > 0 ? 0 : -1;
+}
+
+static int run_child(int conn, opkg_cmd_t * cmd, int argc, const char **argv)
+{
+    pid_t pid;
+    int status, fd, err;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid = fork();
+    if (pid == -1) {
+        opkg_perror(ERROR, "Failed to fork");
+        return 1;
+    }
+
+    if (pid == 0) {
+        signal(SIGPIPE, SIG_DFL);
+        fd = open("/dev/null", O_RDONLY);
+        if (fd != -1) {
+            dup2(fd, STDIN_FILENO);
+            close(fd);
+        }
+        dup2(conn, STDOUT_FILENO);
+        dup2(conn, STDERR_FILENO);
+        close(conn);
+
+        err = opkg_cmd_load(cmd);
+        if (err == 0)
+            err = opkg_cmd_exec(cmd, argc, argv);
+        opkg_download_cleanup();
+        print_error_list();
+        fflush(stdout);
+        fflush(stderr);
+        _exit(err ? 1 : 0);
+    }
+
+    while (waitpid(pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            opkg_perror(ERROR, "Failed to wait for child %d", (int)pid);
+            return 1;
+        }
+    }
+
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    return 128 + WTERMSIG(status);
+}
+
+/* Serve a request from a child of its own, which writes the exit status
+ * once it is done, so that we needn't wait for it. Returns its pid.
+ */
+static pid_t start_child(int conn, opkg_cmd_t * cmd, int argc,
+                         const char **argv)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid = fork();
+    if (pid == -1) {
+        opkg_perror(ERROR, "Failed to fork");
+        return -1;
+    }
+
+    if (pid == 0) {
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGCHLD, SIG_DFL);
+        sigprocmask(SIG_SETMASK, &run_mask, NULL);
+        close(listen_fd);
+        if (locked_conn != -1)
+            close(locked_conn);
+
+        status = run_child(conn, cmd, argc, argv);
+        dprintf(conn, "opkgd: exit %d\n", status);
+        print_error_list();
+        fflush(stdout);
+        fflush(stderr);
+        _exit(0);
+    }
+
+    return pid;
+}
+
+static void locked_done(void)
+{
+    locked_pid = -1;
+    opkg_unlock();
+    close(locked_conn);
+    locked_conn = -1;
+}
+
+/* Reap the children which have finished, releasing the lock if one of
+ * them held it.
+ */
+static void reap_children(void)
+{
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        if (pid == locked_pid)
+            locked_done();
+    }
+}
+
+/* Wait for the request holding the lock to finish, so that the next one
+ * to need it, or a reload, sees what it did.
+ */
+static void wait_for_locked(void)
+{
+    int status;
+
+    if (locked_pid == -1)
+        return;
+
+    while (waitpid(locked_pid, &status, 0) == -1) {
+        if (errno != EINTR) {
+            opkg_perror(ERROR, "Failed to wait for child %d",
+                        (int)locked_pid);
+            break;
+        }
+    }
+    locked_done();
+}
+
+static void serve_request(int conn, const char *request)
+{
+    char line[OPKGD_MAX_REQUEST];
+    const char *args[OPKGD_MAX_ARGS];
+    opkg_cmd_t *cmd;
+    int n, needs_lock;
+    pid_t pid;
+
+    /* Split a copy, the request is passed on as is if we reload. */
+    snprintf(line, sizeof(line), "%s", request);
+    n = split_request(line, args);
+    if (n <= 0) {
+        dprintf(conn, "opkgd: bad request\n");
+        goto out;
+    }
+
+    cmd = opkg_cmd_find(args[0]);
+    if (cmd == NULL) {
+        dprintf(conn, "opkgd: unknown sub-command %s\n", args[0]);
+        goto out;
+    }
+    if (cmd->requires_args && n == 1) {
+        dprintf(conn, "opkgd: the %s command requires at least one argument\n",
+                args[0]);
+        goto out;
+    }
+
+    reap_children();
+    needs_lock = (cmd->needs & OPKG_CMD_NEEDS_LOCK) != 0;
+    if (needs_lock) {
+        wait_for_locked();
+        if (opkg_lock()) {
+            dprintf(conn, "opkgd: %s is locked\n", opkg_config->lock_file);
+            goto out;
+        }
+    }
+
+    /* While a change is being made, what was loaded before it is still the
+     * last complete state, so only look once nothing holds the lock. */
+    if ((needs_lock || locked_pid == -1) && state_stamp() != loaded_stamp) {
+        if (needs_lock)
+            opkg_unlock();
+        reload(conn, request);
+    }
+
+    opkg_msg(INFO, "Serving %s.\n", args[0]);
+    pid = start_child(conn, cmd, n - 1, args + 1);
+    if (pid == -1) {
+        if (needs_lock)
+            opkg_unlock();
+        goto out;
+    }
+    if (needs_lock) {
+        locked_pid = pid;
+        locked_conn = fcntl(conn, F_DUPFD_CLOEXEC, 0);
+    }
+
+    print_error_list();
+    free_error_list();
+    return;
+
+ out:
+    dprintf(conn, "opkgd: exit 1\n");
+
+    /* Our own errors, such as failing to lock, go to our stderr. */
+    print_error_list();
+    free_error_list();
+}
+
+static void serve(int conn)
+{
+    char request[OPKGD_MAX_REQUEST];
+
+    if (read_request(conn, request, sizeof(request)))
+        return;
+
+    serve_request(conn, request);
+}
+
+static int listen_socket(void)
+{
+    struct sockaddr_un addr;
+    const char *env;
+    mode_t old_umask;
+    int fd, r;
+
+    env = getenv(OPKGD_LISTEN_FD_ENV);
+    if (env) {
+        fd = atoi(env);
+        unsetenv(OPKGD_LISTEN_FD_ENV);
+        return fd;
+    }
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        opkg_msg(ERROR, "Socket path %s is too long.\n", socket_path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        opkg_perror(ERROR, "Failed to create socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    unlink(socket_path);
+
+    /* Create the socket private to us rather than narrowing it after. */
+    old_umask = umask(0177);
+    r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_umask);
+
+    if (r == -1 || listen(fd, 16) == -1) {
+        opkg_perror(ERROR, "Failed to listen on %s", socket_path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void handle_signal(int sig)
+{
+    /* SIGCHLD only has to interrupt the wait, for the child to be reaped. */
+    if (sig == SIGHUP)
+        reload_requested = 1;
+    else if (sig != SIGCHLD)
+        exit_requested = 1;
+}
+
+int main(int argc, char *argv[])
+{
+    struct sigaction sa;
+    struct pollfd pfd;
+    sigset_t signals;
+    const char *env;
+    char *request;
+    int c, conn;
+
+    saved_argv = argv;
+
+    if (opkg_conf_init())
+        return 1;
+    opkg_config->verbosity = NOTICE;
+
+    while ((c = getopt(argc, argv, "f:o:V::")) != -1) {
+        switch (c) {
+        case 'f':
+            opkg_config->conf_file = xstrdup(optarg);
+            break;
+        case 'o':
+            opkg_config->offline_root = xstrdup(optarg);
+            break;
+        case 'V':
+            opkg_config->verbosity = INFO;
+            if (optarg != NULL)
+                opkg_config->verbosity = atoi(optarg);
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind < argc)
+        socket_path = argv[optind++];
+    if (optind < argc)
+        usage();
+
+    listen_fd = listen_socket();
+    if (listen_fd == -1)
+        return 1;
+
+    if (load()) {
+        print_error_list();
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGCHLD, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Only let our signals in while waiting for a connection, so that none
+     * is missed between looking at the flags and waiting. They may still
+     * be blocked from before a reload, so run_mask is made without them. */
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &signals, &run_mask);
+    sigdelset(&run_mask, SIGHUP);
+    sigdelset(&run_mask, SIGTERM);
+    sigdelset(&run_mask, SIGINT);
+    sigdelset(&run_mask, SIGCHLD);
+
+    /* A client may give up between poll() and accept(). */
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    env = getenv(OPKGD_CONN_FD_ENV);
+    if (env) {
+        conn = atoi(env);
+        unsetenv(OPKGD_CONN_FD_ENV);
+        fcntl(conn, F_SETFD, FD_CLOEXEC);
+        request = getenv(OPKGD_REQUEST_ENV);
+        if (request) {
+            request = xstrdup(request);
+            unsetenv(OPKGD_REQUEST_ENV);
+            serve_request(conn, request);
+            free(request);
+        }
+        close(conn);
+    }
+
+    opkg_msg(INFO, "Listening on %s.\n", socket_path);
+    while (!exit_requested) {
+        reap_children();
+        if (reload_requested) {
+            wait_for_locked();
+            reload(-1, NULL);
+        }
+
+        pfd.fd = listen_fd;
+        pfd.events = POLLIN;
+        if (ppoll(&pfd, 1, NULL, &run_mask) == -1) {
+            if (errno != EINTR)
+                opkg_perror(ERROR, "Failed to wait for a connection");
+            continue;
+        }
+
+        conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn == -1) {
+            if (errno != EINTR && errno != EAGAIN)
+                opkg_perror(ERROR, "Failed to accept a connection");
+            continue;
+        }
+        serve(conn);
+        close(conn);
+    }
+
+    wait_for_locked();
+    close(listen_fd);
+    unlink(socket_path);
+    opkg_download_cleanup();
+    opkg_conf_deinit();
+
+    return 0;
+}
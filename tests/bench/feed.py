@@ -0,0 +1,223 @@
+#!/usr/bin/python3
+"""
+Generate a synthetic feed of a given size for benchmarking opkg.
+
+Packages come in three tiers: applications, which depend on libraries and
+on virtual packages, libraries, which depend on core packages, and core
+packages, some of which provide the virtual packages. Each tier only
+depends on the one below it, so that installing a few applications pulls
+in a bounded closure however large the feed is. Applications may also
+conflict with applications that the benchmark never installs.
+
+The index lists every package, but only those which the benchmark installs
+are built as .opk files, as building 200k of them would take longer than
+the benchmark itself. Version 2 of the feed bumps the version of a share of
+the packages, to give upgrade something to do.
+
+Usage: feed.py <directory> [--packages N] [--version 1|2] [...]
+"""
+
+import argparse, hashlib, os, random, sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+		".."))
+import opk
+
+class FeedSpec:
+	def __init__(self, packages=1000, fanout=3, files=10, roots=20,
+			provides=0.1, conflicts=0.05, bump=0.2, seed=1):
+		self.packages = packages
+		self.fanout = fanout
+		self.files = files
+		self.roots = roots
+		self.provides = provides
+		self.conflicts = conflicts
+		self.bump = bump
+		self.seed = seed
+
+	def as_dict(self):
+		return dict(self.__dict__)
+
+def pkg_name(tier, i):
+	return "{}-{:06d}".format(tier, i)
+
+class Feed:
+	"""
+	The packages of a feed as control dicts, with their dependencies as
+	lists of package names so that the install closure can be computed.
+	"""
+
+	def __init__(self, spec, version):
+		self.spec = spec
+		self.version = version
+		rnd = random.Random(spec.seed)
+
+		n_core = max(spec.packages // 10, 2)
+		n_libs = max(spec.packages // 5, 1)
+		n_apps = max(spec.packages - n_core - n_libs, spec.roots)
+		n_virtual = max(int(n_core * spec.provides), 1)
+
+		self.roots = [pkg_name("app", i) for i in range(spec.roots)]
+		self.control = {}
+		self.deps = {}
+
+		# Bump versions from a generator of its own, so that both versions
+		# of the feed have the same dependencies.
+		bump = random.Random(spec.seed + 1)
+
+		def add(name, depends, **fields):
+			version = "1.0"
+			if bump.random() < spec.bump and self.version > 1:
+				version = "{}.0".format(self.version)
+			control = dict(Package=name, Version=version,
+					Architecture="all")
+			if depends:
+				control["Depends"] = ", ".join(depends)
+			control.update(fields)
+			self.control[name] = control
+			self.deps[name] = depends
+
+		# Each virtual package has two providers, so that the solver has
+		# to choose between them.
+		providers = {}
+		for v in range(n_virtual):
+			for i in rnd.sample(range(n_core), min(2, n_core)):
+				providers.setdefault(i, []).append("virtual-{:06d}".format(v))
+
+		for i in range(n_core):
+			fields = {}
+			if i in providers:
+				fields["Provides"] = ", ".join(providers[i])
+			add(pkg_name("core", i), [], **fields)
+
+		for i in range(n_libs):
+			depends = [pkg_name("core", j) for j in
+					rnd.sample(range(n_core), min(spec.fanout, n_core))]
+			add(pkg_name("lib", i), depends)
+
+		for i in range(n_apps):
+			depends = [pkg_name("lib", j) for j in
+					rnd.sample(range(n_libs), min(spec.fanout, n_libs))]
+			fields = {"Section": "bench",
+				"Description": "Synthetic application {}".format(i)}
+			if rnd.random() < spec.provides:
+				depends.append("virtual-{:06d}".format(
+						rnd.randrange(n_virtual)))
+			# Only conflict with applications which are never installed.
+			if rnd.random() < spec.conflicts and n_apps > spec.roots:
+				fields["Conflicts"] = pkg_name("app",
+						rnd.randrange(spec.roots, n_apps))
+			add(pkg_name("app", i), depends, **fields)
+
+		self.virtual = {}
+		for i, names in providers.items():
+			for v in names:
+				self.virtual.setdefault(v, []).append(pkg_name("core", i))
+
+	def closure(self):
+		"""The packages which installing the roots may pull in."""
+		seen = set()
+		todo = list(self.roots)
+		while todo:
+			name = todo.pop()
+			if name in seen:
+				continue
+			seen.add(name)
+			for d in self.deps.get(name, self.virtual.get(name, [])):
+				todo.append(d)
+		return sorted(n for n in seen if n in self.control)
+
+def opk_filename(control):
+	return "{Package}_{Version}_{Architecture}.opk".format(**control)
+
+def build_opk(control, n_files):
+	"""
+	Build the .opk for control in the current directory, with n_files
+	small files under /usr/share/bench/<package>.
+	"""
+	name = control["Package"]
+	staged = []
+	for i in range(n_files):
+		path = os.path.join("usr", "share", "bench", name,
+				"file-{}".format(i))
+		os.makedirs(os.path.dirname(path), exist_ok=True)
+		with open(path, "w") as f:
+			f.write("{} {} {}\n".format(name, control["Version"], i))
+		staged.append(path)
+
+	opk.Opk(**control).write(data_files=staged)
+
+	for path in staged:
+		os.unlink(path)
+
+def write_feed(directory, spec, version):
+	"""
+	Write version of the feed described by spec to directory, returning
+	the Feed.
+	"""
+	feed = Feed(spec, version)
+	os.makedirs(directory, exist_ok=True)
+	cwd = os.getcwd()
+	os.chdir(directory)
+	try:
+		built = set()
+		for name in feed.closure():
+			control = feed.control[name]
+			fname = opk_filename(control)
+			if not os.path.exists(fname):
+				build_opk(control, spec.files)
+			built.add(name)
+
+		with open("Packages", "w") as f:
+			for name in sorted(feed.control):
+				control = feed.control[name]
+				for k, v in control.items():
+					f.write("{}: {}\n".format(k, v))
+				fname = opk_filename(control)
+				f.write("Filename: {}\n".format(fname))
+				if name in built:
+					f.write("Size: {}\n".format(os.path.getsize(fname)))
+					f.write("MD5Sum: {}\n".format(opk.md5sum_file(fname)))
+				else:
+					# Never downloaded, so only needs to look right.
+					digest = hashlib.md5(fname.encode()).hexdigest()
+					f.write("Size: 1024\nMD5Sum: {}\n".format(digest))
+				f.write("\n")
+		if os.path.isdir("usr"):
+			os.system("rm -rf usr")
+	finally:
+		os.chdir(cwd)
+	return feed
+
+def add_spec_arguments(parser):
+	parser.add_argument("--packages", type=int, default=1000,
+			help="number of packages in the feed")
+	parser.add_argument("--fanout", type=int, default=3,
+			help="dependencies of each application and library")
+	parser.add_argument("--files", type=int, default=10,
+			help="files in each built package")
+	parser.add_argument("--roots", type=int, default=20,
+			help="applications which the benchmark installs")
+	parser.add_argument("--provides", type=float, default=0.1,
+			help="share of packages providing or depending on a "
+			"virtual package")
+	parser.add_argument("--conflicts", type=float, default=0.05,
+			help="share of applications with a conflict")
+	parser.add_argument("--bump", type=float, default=0.2,
+			help="share of packages upgraded by version 2")
+	parser.add_argument("--seed", type=int, default=1)
+
+def spec_from_args(args):
+	return FeedSpec(packages=args.packages, fanout=args.fanout,
+			files=args.files, roots=args.roots, provides=args.provides,
+			conflicts=args.conflicts, bump=args.bump, seed=args.seed)
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(description="Generate a synthetic feed.")
+	parser.add_argument("directory")
+	parser.add_argument("--version", type=int, default=1)
+	add_spec_arguments(parser)
+	args = parser.parse_args()
+	feed = write_feed(args.directory, spec_from_args(args), args.version)
+	print("{} packages, {} built".format(len(feed.control),
+			len(feed.closure())))
@@ -0,0 +1,227 @@
+#!/usr/bin/python3
+"""
+End-to-end benchmark of opkg against a synthetic feed.
+
+Serves a generated feed over HTTP from a local server and runs update,
+list, info, install, upgrade (after switching the server to version 2 of
+the feed) and remove in an offline root, recording the wall time and peak
+RSS of each step and, where opkg supports --profile, the timings of its
+phases. The whole scenario is run --repeat times and the median of each
+step is reported, so that two reports can be compared with --compare.
+
+Usage: run.py [--packages N] [--report report.json] [...]
+       run.py --compare before.json after.json
+"""
+
+import argparse, functools, http.server, json, os, shutil, statistics
+import subprocess, sys, threading, time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+		".."))
+import cfg
+import feed
+
+benchdir = "/tmp/opkg-bench"
+
+class FeedServer:
+	"""
+	Serve <root>/current, which is switched between the versions of the
+	feed by repointing the symlink.
+	"""
+
+	def __init__(self, root):
+		self.root = root
+		handler = functools.partial(QuietHandler,
+				directory=os.path.join(root, "current"))
+		self.httpd = http.server.ThreadingHTTPServer(("127.0.0.1", 0),
+				handler)
+		self.thread = threading.Thread(target=self.httpd.serve_forever,
+				daemon=True)
+		self.thread.start()
+
+	def url(self):
+		return "http://127.0.0.1:{}".format(self.httpd.server_address[1])
+
+	def switch(self, version):
+		link = os.path.join(self.root, "current")
+		if os.path.lexists(link):
+			os.unlink(link)
+		os.symlink("v{}".format(version), link)
+
+	def stop(self):
+		self.httpd.shutdown()
+		self.httpd.server_close()
+
+class QuietHandler(http.server.SimpleHTTPRequestHandler):
+	def log_message(self, format, *args):
+		pass
+
+def write_conf(offline_root, url):
+	os.makedirs("{}/etc/opkg".format(offline_root))
+	with open("{}/etc/opkg/opkg.conf".format(offline_root), "w") as f:
+		f.write("arch all 1\n")
+		f.write("src bench {}\n".format(url))
+
+def run_step(name, offline_root, args, verbose):
+	"""
+	Run opkg with args and return the step's result, with the peak RSS
+	taken from the rusage of that child alone.
+	"""
+	profile = os.path.join(benchdir, "profile.json")
+	if os.path.exists(profile):
+		os.unlink(profile)
+
+	cmd = [cfg.opkgcl, "--batch", "--profile", profile, "-o", offline_root]
+	cmd += args
+	if verbose:
+		print(" ".join(cmd))
+
+	start = time.monotonic()
+	p = subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+			stderr=subprocess.DEVNULL)
+	(pid, status, rusage) = os.wait4(p.pid, 0)
+	wall = time.monotonic() - start
+	p.returncode = os.waitstatus_to_exitcode(status)
+
+	result = {"name": name, "status": p.returncode,
+		"wall_s": round(wall, 4), "max_rss_kb": rusage.ru_maxrss,
+		"cpu_s": round(rusage.ru_utime + rusage.ru_stime, 4)}
+	if os.path.exists(profile):
+		with open(profile) as f:
+			try:
+				result["phases"] = json.load(f)["phases"]
+			except ValueError:
+				pass
+	if p.returncode != 0:
+		print("{}: {} exited with {}".format(sys.argv[0], name,
+				p.returncode))
+	return result
+
+def run_scenario(server, spec, verbose):
+	offline_root = os.path.join(benchdir, "root")
+	shutil.rmtree(offline_root, ignore_errors=True)
+	write_conf(offline_root, server.url())
+
+	fd = feed.Feed(spec, 1)
+	some = fd.roots[len(fd.roots) // 2]
+
+	server.switch(1)
+	steps = []
+	steps.append(run_step("update", offline_root, ["update"], verbose))
+	steps.append(run_step("list", offline_root, ["list"], verbose))
+	steps.append(run_step("info", offline_root, ["info", some], verbose))
+	steps.append(run_step("install", offline_root,
+			["install"] + fd.roots, verbose))
+	steps.append(run_step("list-installed", offline_root,
+			["list-installed"], verbose))
+
+	server.switch(2)
+	steps.append(run_step("update-v2", offline_root, ["update"], verbose))
+	steps.append(run_step("upgrade", offline_root, ["upgrade"], verbose))
+	steps.append(run_step("remove", offline_root,
+			["--autoremove", "remove"] + fd.roots, verbose))
+	return steps
+
+def median_steps(runs):
+	"""Merge repeated runs of the scenario, step by step."""
+	merged = []
+	for i, first in enumerate(runs[0]):
+		same = [r[i] for r in runs]
+		step = dict(first)
+		for k in ("wall_s", "cpu_s", "max_rss_kb"):
+			step[k] = statistics.median_low(s[k] for s in same)
+		step["status"] = max((s["status"] for s in same), key=abs)
+		merged.append(step)
+	return merged
+
+def opkg_version():
+	try:
+		out = subprocess.check_output([cfg.opkgcl, "--version"],
+				stderr=subprocess.STDOUT)
+		return out.decode("utf-8").strip()
+	except (OSError, subprocess.CalledProcessError):
+		return "unknown"
+
+def bench(args):
+	if not os.access(cfg.opkgcl, os.X_OK):
+		print("{}: Cannot exec {}".format(sys.argv[0], cfg.opkgcl))
+		return -1
+
+	spec = feed.spec_from_args(args)
+	feeds = os.path.join(benchdir, "feeds")
+	if not args.keep_feed:
+		shutil.rmtree(feeds, ignore_errors=True)
+
+	start = time.monotonic()
+	for version in (1, 2):
+		directory = os.path.join(feeds, "v{}".format(version))
+		if not os.path.exists(os.path.join(directory, "Packages")):
+			feed.write_feed(directory, spec, version)
+	print("Generated feed of {} packages in {:.1f}s".format(
+			spec.packages, time.monotonic() - start))
+
+	server = FeedServer(feeds)
+	try:
+		runs = [run_scenario(server, spec, args.verbose)
+				for i in range(args.repeat)]
+	finally:
+		server.stop()
+
+	report = {"opkg": opkg_version(), "spec": spec.as_dict(),
+		"repeat": args.repeat, "steps": median_steps(runs)}
+	with open(args.report, "w") as f:
+		json.dump(report, f, indent=2)
+		f.write("\n")
+
+	print_report(report)
+	return 0 if all(s["status"] == 0 for s in report["steps"]) else 1
+
+def print_report(report):
+	print("{:<16} {:>6} {:>10} {:>10} {:>12}".format("step", "status",
+			"wall_s", "cpu_s", "max_rss_kb"))
+	for s in report["steps"]:
+		print("{:<16} {:>6} {:>10.3f} {:>10.3f} {:>12}".format(s["name"],
+				s["status"], s["wall_s"], s["cpu_s"], s["max_rss_kb"]))
+
+def change(before, after):
+	if not before:
+		return "    n/a"
+	return "{:+6.1f}%".format(100.0 * (after - before) / before)
+
+def compare(before_file, after_file):
+	with open(before_file) as f:
+		before = json.load(f)
+	with open(after_file) as f:
+		after = json.load(f)
+	if before["spec"] != after["spec"]:
+		print("Warning: the reports were made with different feeds.")
+
+	old = {s["name"]: s for s in before["steps"]}
+	print("{:<16} {:>10} {:>10} {:>8} {:>12} {:>12} {:>8}".format("step",
+			"wall_s", "wall_s", "", "max_rss_kb", "max_rss_kb", ""))
+	for s in after["steps"]:
+		o = old.get(s["name"])
+		if not o:
+			continue
+		print("{:<16} {:>10.3f} {:>10.3f} {:>8} {:>12} {:>12} {:>8}".format(
+				s["name"], o["wall_s"], s["wall_s"],
+				change(o["wall_s"], s["wall_s"]), o["max_rss_kb"],
+				s["max_rss_kb"], change(o["max_rss_kb"], s["max_rss_kb"])))
+	return 0
+
+if __name__ == '__main__':
+	parser = argparse.ArgumentParser(
+			description="Benchmark opkg against a synthetic feed.")
+	feed.add_spec_arguments(parser)
+	parser.add_argument("--repeat", type=int, default=3)
+	parser.add_argument("--report", default="bench-report.json")
+	parser.add_argument("--keep-feed", action="store_true",
+			help="reuse a feed generated by an earlier run")
+	parser.add_argument("--compare", nargs=2, metavar="REPORT",
+			help="compare two reports instead of running")
+	parser.add_argument("-v", "--verbose", action="store_true")
+	args = parser.parse_args()
+
+	if args.compare:
+		exit(compare(*args.compare))
+	exit(bench(args))
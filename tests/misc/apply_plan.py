@@ -0,0 +1,69 @@
+#!/usr/bin/python3
+#
+# Write the plan of an install with --plan-out, then apply it to a fresh
+# root and check the same packages end up installed. A plan whose
+# fingerprint or checksums don't match has to be rejected as a whole.
+#
+
+import os, re
+import opk, cfg, opkgcl
+
+plan = "{}/test.plan".format(cfg.opkdir)
+
+opk.regress_init()
+
+o = opk.OpkGroup()
+o.add(Package="a", Depends="b")
+o.add(Package="b")
+o.add(Package="c")
+o.write_opk()
+o.write_list()
+
+opkgcl.update()
+
+(status, output) = opkgcl.opkgcl("--plan-out {} install a".format(plan))
+if status != 0:
+	opk.fail("Writing the plan failed.")
+if not os.path.exists(plan):
+	opk.fail("No plan written.")
+if opkgcl.is_installed("a") or opkgcl.is_installed("b"):
+	opk.fail("Writing the plan installed packages.")
+
+f = open(plan, "r")
+plan_text = f.read()
+f.close()
+
+# A fresh root, without the package lists.
+opk.regress_init()
+
+(status, output) = opkgcl.opkgcl("apply-plan {}".format(plan))
+if status != 0:
+	opk.fail("Applying the plan failed.")
+if not opkgcl.is_installed("a") or not opkgcl.is_installed("b"):
+	opk.fail("Plan applied but 'a' and 'b' are not installed.")
+if opkgcl.is_installed("c"):
+	opk.fail("Package 'c' installed but wasn't in the plan.")
+
+# The installed packages have changed since the plan was made.
+(status, output) = opkgcl.opkgcl("apply-plan {}".format(plan))
+if status == 0:
+	opk.fail("Plan applied to packages it wasn't made for.")
+
+# A plan whose checksums have been changed.
+tampered = re.sub(r"(\w+):([0-9a-f]+)",
+		lambda m: m.group(1) + ":" + "0" * len(m.group(2)), plan_text)
+if tampered == plan_text:
+	opk.fail("Plan has no checksums to change.")
+f = open(plan, "w")
+f.write(tampered)
+f.close()
+
+opk.regress_init()
+
+(status, output) = opkgcl.opkgcl("apply-plan {}".format(plan))
+if status == 0:
+	opk.fail("Plan with bad checksums applied.")
+if opkgcl.is_installed("a") or opkgcl.is_installed("b"):
+	opk.fail("Packages installed from a plan with bad checksums.")
+
+os.unlink(plan)
@@ -0,0 +1,81 @@
+#!/usr/bin/python3
+#
+# With configure_jobs above 1, the postinsts of packages which don't depend
+# on each other run at the same time, but a package is still only
+# configured once everything it depends on has been. The output of each
+# postinst is shown after its "Configuring" line, not mixed with the others.
+
+import os
+import opk, cfg, opkgcl
+
+opk.regress_init()
+
+with open("{}/etc/opkg/opkg.conf".format(cfg.offline_root), "a") as f:
+	f.write("option configure_jobs 4\n")
+
+log = "{}/configure.log".format(cfg.opkdir)
+if os.path.exists(log):
+	os.unlink(log)
+
+def postinst(name):
+	return """#!/bin/sh
+echo "start {name}" >> {log}
+echo "output of {name}"
+sleep 1
+echo "end {name}" >> {log}
+exit 0
+""".format(name=name, log=log)
+
+o = opk.OpkGroup()
+for name, depends in (("base", None), ("x", "base"), ("y", "base"),
+		      ("z", "base"), ("lone", None)):
+	if depends:
+		p = opk.Opk(Package=name, Depends=depends)
+	else:
+		p = opk.Opk(Package=name)
+	p.write(control_files={"postinst": postinst(name)})
+	o.addOpk(p)
+o.write_list()
+
+opkgcl.update()
+
+(status, output) = opkgcl.opkgcl("install --force-postinstall x y z lone")
+if status != 0:
+	opk.fail("Install returned {}.".format(status))
+
+for name in ("base", "x", "y", "z", "lone"):
+	if not opkgcl.is_installed(name):
+		opk.fail("Package '{}' not installed.".format(name))
+
+with open(log) as f:
+	events = f.read().splitlines()
+
+def at(event):
+	if event not in events:
+		opk.fail("'{}' missing from the log: {}".format(event, events))
+	return events.index(event)
+
+# Dependencies first.
+for name in ("x", "y", "z"):
+	if at("start {}".format(name)) < at("end base"):
+		opk.fail("'{}' configured before 'base': {}".format(name, events))
+
+# Independent packages together.
+if at("start lone") > at("end base"):
+	opk.fail("'lone' waited for 'base': {}".format(events))
+if min(at("end x"), at("end y"), at("end z")) \
+		< max(at("start x"), at("start y"), at("start z")):
+	opk.fail("'x', 'y' and 'z' weren't configured together: {}"
+		.format(events))
+
+# Each postinst's output follows the line announcing it.
+for name in ("base", "x", "y", "z", "lone"):
+	line = output.find("Configuring {}.".format(name))
+	out = output.find("output of {}\n".format(name))
+	if line == -1 or out == -1:
+		opk.fail("Missing output for '{}'.".format(name))
+	nxt = output.find("Configuring ", line + 1)
+	if out < line or (nxt != -1 and out > nxt):
+		opk.fail("Output of '{}' not under its own line.".format(name))
+
+os.unlink(log)
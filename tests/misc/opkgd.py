@@ -0,0 +1,103 @@
+#!/usr/bin/python3
+#
+# opkgd serves opkg commands over a Unix socket: the client writes one
+# request line and reads the reply, which ends with "opkgd: exit <status>".
+# Check a query and an install through it, and that the install is seen
+# both by the next query and by opkg itself.
+#
+# opkgd is only built with --enable-daemon.
+
+import os, socket, subprocess, time
+import opk, cfg, opkgcl
+
+if not os.access(cfg.opkgd, os.X_OK):
+	print("{} not built, skipping.".format(cfg.opkgd))
+	exit(0)
+
+opk.regress_init()
+
+o = opk.OpkGroup()
+o.add(Package="a", Version="1.0")
+o.add(Package="b", Version="2.0", Depends="a")
+o.write_opk()
+o.write_list()
+
+opkgcl.update()
+
+sock_path = "{}/opkgd.sock".format(cfg.opkdir)
+if os.path.exists(sock_path):
+	os.unlink(sock_path)
+
+daemon = subprocess.Popen([cfg.opkgd, "-o", cfg.offline_root, sock_path])
+
+def request(line):
+	s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+	s.settimeout(60)
+	s.connect(sock_path)
+	s.sendall("{}\n".format(line).encode("utf-8"))
+	reply = b""
+	while True:
+		data = s.recv(4096)
+		if not data:
+			break
+		reply += data
+	s.close()
+	reply = reply.decode("utf-8")
+	print(reply)
+	lines = reply.splitlines()
+	if not lines or not lines[-1].startswith("opkgd: exit "):
+		stop()
+		opk.fail("Reply to '{}' didn't end with the exit status."
+			.format(line))
+	return (int(lines[-1].split()[2]), "\n".join(lines[:-1]))
+
+def stop():
+	daemon.terminate()
+	daemon.wait(timeout=10)
+
+for i in range(100):
+	if os.path.exists(sock_path):
+		break
+	if daemon.poll() is not None:
+		opk.fail("opkgd exited with {}.".format(daemon.returncode))
+	time.sleep(0.1)
+else:
+	stop()
+	opk.fail("opkgd didn't create {}.".format(sock_path))
+
+(status, output) = request("list")
+if status != 0:
+	stop()
+	opk.fail("list returned {}.".format(status))
+if "a - 1.0" not in output or "b - 2.0" not in output:
+	stop()
+	opk.fail("list didn't show the feed's packages.")
+
+(status, output) = request("list-installed")
+if status != 0 or "b - " in output:
+	stop()
+	opk.fail("'b' listed as installed before it was.")
+
+(status, output) = request("install b")
+if status != 0:
+	stop()
+	opk.fail("install returned {}.".format(status))
+
+(status, output) = request("list-installed")
+if status != 0 or "a - 1.0" not in output or "b - 2.0" not in output:
+	stop()
+	opk.fail("Installed packages not listed after the install.")
+
+(status, output) = request("no-such-command")
+if status == 0 or "unknown sub-command" not in output:
+	stop()
+	opk.fail("An unknown command wasn't refused.")
+
+stop()
+
+if not opkgcl.is_installed("a", "1.0"):
+	opk.fail("Package 'a' not installed.")
+if not opkgcl.is_installed("b", "2.0"):
+	opk.fail("Package 'b' not installed.")
+if os.path.exists(sock_path):
+	opk.fail("opkgd left {} behind.".format(sock_path))
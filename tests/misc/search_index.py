@@ -0,0 +1,78 @@
+#!/usr/bin/python3
+#
+# search answers from an index of the installed files. Check that it finds
+# the same owners as matching the patterns against every package's file
+# list, after installs and after a removal.
+#
+
+import os, glob, fnmatch
+import opk, cfg, opkgcl
+
+patterns = ["/usr/bin/a-tool", "/usr/bin/*", "/usr/share/*/README",
+		"*/shared", "/etc/*.conf", "/nonexistent"]
+
+def scan_owners(pattern):
+	"""Owners found by reading every file list, as search used to."""
+	owners = set()
+	info_dir = "{}/var/lib/opkg/info".format(cfg.offline_root)
+	for list_file in glob.glob("{}/*.list".format(info_dir)):
+		pkg = os.path.basename(list_file)[:-len(".list")]
+		for path in open(list_file).read().splitlines():
+			if path.startswith(cfg.offline_root):
+				path = path[len(cfg.offline_root):]
+			if fnmatch.fnmatchcase(path, pattern):
+				owners.add(pkg)
+	return owners
+
+def search_owners(pattern):
+	out = opkgcl.opkgcl("search '{}'".format(pattern))[1]
+	return set([l.split()[0] for l in out.splitlines()
+			if len(l.split()) > 2 and l.split()[1] == "-"])
+
+def check(when):
+	for pattern in patterns:
+		expected = scan_owners(pattern)
+		found = search_owners(pattern)
+		if found != expected:
+			opk.fail("{}: search '{}' found {}, the file lists "
+				"give {}.".format(when, pattern, sorted(found),
+					sorted(expected)))
+
+opk.regress_init()
+
+def add_file(path):
+	os.makedirs(os.path.dirname(path), exist_ok=True)
+	open(path, "w").close()
+
+add_file("usr/bin/a-tool")
+add_file("usr/share/a/README")
+add_file("usr/lib/a/shared")
+a = opk.Opk(Package="a")
+a.write(data_files=["usr/bin/a-tool", "usr/share/a/README",
+			"usr/lib/a/shared"])
+
+add_file("usr/bin/b-tool")
+add_file("etc/b.conf")
+add_file("usr/lib/b/shared")
+b = opk.Opk(Package="b")
+b.write(data_files=["usr/bin/b-tool", "etc/b.conf", "usr/lib/b/shared"])
+
+os.system("rm -rf usr etc")
+
+opkgcl.install("a_1.0_all.opk")
+if not opkgcl.is_installed("a"):
+	opk.fail("Package 'a' not installed.")
+check("After installing a")
+
+opkgcl.install("b_1.0_all.opk")
+if not opkgcl.is_installed("b"):
+	opk.fail("Package 'b' not installed.")
+check("After installing b")
+
+opkgcl.remove("a")
+if opkgcl.is_installed("a"):
+	opk.fail("Package 'a' not removed.")
+check("After removing a")
+
+if search_owners("/usr/bin/b-tool") != set(["b"]):
+	opk.fail("search didn't find the owner of /usr/bin/b-tool.")
@@ -0,0 +1,58 @@
+#!/usr/bin/python3
+#
+# list_installed answers from the status snapshot when it is current. Check
+# that a snapshot which no longer matches the status file, or which is
+# corrupt, is ignored and the status file re-read.
+#
+
+import os, shutil
+import opk, cfg, opkgcl
+
+def installed_names():
+	out = opkgcl.opkgcl("list_installed")[1]
+	return sorted([l.split()[0] for l in out.splitlines()
+			if len(l.split()) > 2 and l.split()[1] == "-"])
+
+opk.regress_init()
+
+o = opk.OpkGroup()
+o.add(Package="a")
+o.add(Package="b")
+o.write_opk()
+o.write_list()
+
+opkgcl.update()
+opkgcl.install("a")
+opkgcl.install("b")
+
+status = "{}/var/lib/opkg/status".format(cfg.offline_root)
+snapshot = "{}.snapshot".format(status)
+
+if installed_names() != ["a", "b"]:
+	opk.fail("Expected 'a' and 'b' installed.")
+if not os.path.exists(snapshot):
+	opk.fail("list_installed didn't write a status snapshot.")
+shutil.copy(snapshot, "old.snapshot")
+
+# Change the status file behind the snapshot's back.
+f = open(status, "a")
+f.write("Package: c\nVersion: 1.0\nArchitecture: all\n"
+		"Status: install ok installed\n\n")
+f.close()
+
+if installed_names() != ["a", "b", "c"]:
+	opk.fail("Stale snapshot used after the status file changed.")
+
+# A snapshot written for an older status file.
+shutil.copy("old.snapshot", snapshot)
+if installed_names() != ["a", "b", "c"]:
+	opk.fail("Snapshot of an older status file was used.")
+
+# A snapshot which isn't one at all.
+f = open(snapshot, "w")
+f.write("garbage\n")
+f.close()
+if installed_names() != ["a", "b", "c"]:
+	opk.fail("Corrupt snapshot was used.")
+
+os.unlink("old.snapshot")
@@ -0,0 +1,71 @@
+#!/usr/bin/python3
+#
+# Upgrade, remove and install in one transaction: first with --noaction,
+# which only lists the steps, then for real. A transaction which can't be
+# solved as a whole must change nothing.
+#
+
+import opk, cfg, opkgcl
+
+def steps(args):
+	(status, out) = opkgcl.opkgcl("--noaction transaction {}".format(args))
+	if status != 0:
+		opk.fail("Solving transaction {} failed.".format(args))
+	return sorted([l for l in out.splitlines()
+			if l.split()[:1] in (["install"], ["remove"], ["upgrade"])])
+
+opk.regress_init()
+
+o = opk.OpkGroup()
+o.add(Package="a", Version="1.0")
+o.add(Package="b")
+o.write_opk()
+o.write_list()
+
+opkgcl.update()
+opkgcl.install("a")
+opkgcl.install("b")
+
+o.add(Package="a", Version="2.0")
+o.add(Package="c", Depends="d")
+o.add(Package="d")
+o.write_opk()
+o.write_list()
+opkgcl.update()
+
+args = "upgrade:a remove:b install:c"
+expected = ["install c 1.0", "install d 1.0", "remove b 1.0",
+		"upgrade a 1.0 2.0"]
+found = steps(args)
+if found != expected:
+	opk.fail("Expected steps {}, got {}.".format(expected, found))
+if not opkgcl.is_installed("a", "1.0") or not opkgcl.is_installed("b") \
+		or opkgcl.is_installed("c"):
+	opk.fail("Listing the steps of a transaction changed what's installed.")
+
+(status, out) = opkgcl.opkgcl("transaction {}".format(args))
+if status != 0:
+	opk.fail("Committing transaction {} failed.".format(args))
+if not opkgcl.is_installed("a", "2.0"):
+	opk.fail("Package 'a' not upgraded by the transaction.")
+if opkgcl.is_installed("b"):
+	opk.fail("Package 'b' not removed by the transaction.")
+if not opkgcl.is_installed("c") or not opkgcl.is_installed("d"):
+	opk.fail("Packages 'c' and 'd' not installed by the transaction.")
+
+# 'e' needs a newer 'a', which is locked.
+o.add(Package="a", Version="3.0")
+o.add(Package="e", Depends="a (>= 3.0)")
+o.write_opk()
+o.write_list()
+opkgcl.update()
+
+(status, out) = opkgcl.opkgcl("transaction lock:a install:e")
+if status == 0:
+	opk.fail("Transaction needing a locked package to change succeeded.")
+if opkgcl.is_installed("e") or not opkgcl.is_installed("a", "2.0"):
+	opk.fail("Transaction which couldn't be solved changed packages.")
+
+(status, out) = opkgcl.opkgcl("transaction frobnicate:a")
+if status == 0:
+	opk.fail("Transaction with an unknown operation succeeded.")
@@ -0,0 +1,122 @@
+#!/usr/bin/python3
+#
+# A package declaring triggers has its postinst run once, as
+# "postinst triggered <names>", when another package installs a file below
+# a path it is interested in or activates a name it is interested in, and
+# not at all while it is itself unconfigured.
+#
+# Triggers are only run in an offline root with --force-postinstall.
+
+import os, shutil
+import opk, cfg, opkgcl
+
+opk.regress_init()
+
+log = "{}/triggered.log".format(cfg.opkdir)
+fail_flag = "{}/fail-configure".format(cfg.opkdir)
+for f in (log, fail_flag):
+	if os.path.exists(f):
+		os.unlink(f)
+
+postinst = """#!/bin/sh
+case "$1" in
+configure)
+	[ -e {} ] && exit 1
+	;;
+triggered)
+	echo "$2" >> {}
+	;;
+esac
+exit 0
+""".format(fail_flag, log)
+
+triggers = """# Comments and blank lines are skipped.
+
+interest /usr/share/watched/
+interest cache-refresh
+interest
+"""
+
+def read_log():
+	if not os.path.exists(log):
+		return []
+	with open(log) as f:
+		return f.read().splitlines()
+
+def data_file(path):
+	os.makedirs(os.path.dirname(path), exist_ok=True)
+	open(path, "w").close()
+	return path
+
+o = opk.OpkGroup()
+
+watcher = opk.Opk(Package="watcher")
+watcher.write(control_files={"postinst": postinst, "triggers": triggers})
+o.addOpk(watcher)
+
+payload = opk.Opk(Package="payload")
+payload.write(data_files=[data_file("usr/share/watched/payload")])
+o.addOpk(payload)
+
+activator = opk.Opk(Package="activator")
+activator.write(control_files={"triggers": "activate cache-refresh\n"})
+o.addOpk(activator)
+
+other = opk.Opk(Package="other")
+other.write(data_files=[data_file("usr/share/unwatched/other"),
+			data_file("usr/share/watched-not/other")])
+o.addOpk(other)
+
+late = opk.Opk(Package="late")
+late.write(data_files=[data_file("usr/share/watched/late")])
+o.addOpk(late)
+
+shutil.rmtree("usr")
+o.write_list()
+
+opkgcl.update()
+
+(status, output) = opkgcl.opkgcl("install --force-postinstall watcher")
+if not opkgcl.is_installed("watcher"):
+	opk.fail("Package 'watcher' not installed.")
+if read_log():
+	opk.fail("Installing 'watcher' triggered itself: {}".format(read_log()))
+
+# A file below an interested path.
+(status, output) = opkgcl.opkgcl("install --force-postinstall payload")
+if "'interest' needs an argument" not in output:
+	opk.fail("An interest without an argument wasn't reported.")
+if read_log() != ["/usr/share/watched/"]:
+	opk.fail("Installing 'payload' didn't trigger the watched path once: "
+		"{}".format(read_log()))
+
+# A named trigger activated by another package.
+opkgcl.opkgcl("install --force-postinstall activator")
+if read_log()[1:] != ["cache-refresh"]:
+	opk.fail("Installing 'activator' didn't trigger 'cache-refresh' once: "
+		"{}".format(read_log()))
+
+# Files beside, but not below, the interested path.
+opkgcl.opkgcl("install --force-postinstall other")
+if len(read_log()) != 2:
+	opk.fail("Installing 'other' triggered 'watcher': {}".format(read_log()))
+
+# Without --force-postinstall nothing is run in an offline root.
+opkgcl.remove("other")
+opkgcl.install("other")
+if len(read_log()) != 2:
+	opk.fail("Triggers were run without --force-postinstall.")
+
+# An unconfigured package isn't triggered.
+open(fail_flag, "w").close()
+opkgcl.flag_unpacked("watcher")
+(status, output) = opkgcl.opkgcl("install --force-postinstall late")
+if not opkgcl.is_installed("late"):
+	opk.fail("Package 'late' not installed.")
+if "Not processing triggers for unconfigured package watcher" not in output:
+	opk.fail("Unconfigured 'watcher' wasn't reported as skipped.")
+if len(read_log()) != 2:
+	opk.fail("Unconfigured 'watcher' was triggered: {}".format(read_log()))
+
+os.unlink(fail_flag)
+os.unlink(log)
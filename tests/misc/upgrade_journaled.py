@@ -0,0 +1,44 @@
+#!/usr/bin/python3
+#
+# Upgrade a package while the status change is kept in the journal rather
+# than compacted into the status file, then check that a fresh load sees
+# only the new version as installed.
+#
+
+import os
+import opk, cfg, opkgcl
+
+opk.regress_init()
+
+# An offline root compacts the journal on every run; don't.
+f = open("{}/etc/opkg/opkg.conf".format(cfg.offline_root), "a")
+f.write("option status_journal_max 1048576\n")
+f.close()
+
+o = opk.OpkGroup()
+o.add(Package="a", Version="1.0")
+o.write_opk()
+o.write_list()
+
+opkgcl.update()
+opkgcl.install("a")
+if not opkgcl.is_installed("a", "1.0"):
+	opk.fail("Package 'a' installed but reports as not installed.")
+
+o.add(Package="a", Version="2.0")
+o.write_opk()
+o.write_list()
+
+opkgcl.update()
+opkgcl.upgrade()
+
+journal = "{}/var/lib/opkg/status.journal".format(cfg.offline_root)
+if not os.path.exists(journal):
+	opk.fail("Status journal was compacted, test doesn't cover replay.")
+
+out = opkgcl.opkgcl("list_installed a")[1]
+versions = [l.split()[2] for l in out.splitlines()
+		if len(l.split()) > 2 and l.split()[0] == "a"]
+if versions != ["2.0"]:
+	opk.fail("Expected only 'a' 2.0 installed after replay, "
+			"got {}.".format(versions))
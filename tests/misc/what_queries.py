@@ -0,0 +1,64 @@
+#!/usr/bin/python3
+#
+# Check whatdepends, whatdependsrec, whatrecommends and whatprovides
+# against a small feed, both for packages in the feed and once installed.
+#
+
+import opk, cfg, opkgcl
+
+def dependents(query):
+	"""Packages listed by a whatdepends style query."""
+	out = opkgcl.opkgcl(query)[1]
+	return sorted([l.split()[0] for l in out.splitlines()
+			if l.startswith("\t")])
+
+def providers(query):
+	"""Packages listed by whatprovides."""
+	out = opkgcl.opkgcl(query)[1]
+	return sorted([l.split()[0] for l in out.splitlines()
+			if l.startswith("    ")])
+
+def check(query, found, expected):
+	if found != expected:
+		opk.fail("{}: expected {}, got {}.".format(query, expected, found))
+
+def check_dependents(query, expected):
+	check(query, dependents(query), expected)
+
+def check_providers(query, expected):
+	check(query, providers(query), expected)
+
+opk.regress_init()
+
+o = opk.OpkGroup()
+o.add(Package="lib", Provides="libfoo")
+o.add(Package="alt", Provides="libfoo")
+o.add(Package="app", Depends="libfoo")
+o.add(Package="tool", Depends="app (>= 1.0)")
+o.add(Package="extra", Recommends="app")
+o.add(Package="other")
+o.write_opk()
+o.write_list()
+
+opkgcl.update()
+
+check_dependents("-A whatdepends app", ["tool"])
+check_dependents("-A whatdepends lib", ["app"])
+check_dependents("-A whatdepends other", [])
+check_dependents("-A whatdependsrec lib", ["app", "tool"])
+check_dependents("-A whatrecommends app", ["extra"])
+check_dependents("-A whatrecommends lib", [])
+check_providers("-A whatprovides libfoo", ["alt", "lib"])
+check_providers("-A whatprovides 'lib*'", ["alt", "lib"])
+check_providers("-A whatprovides app", ["app"])
+
+# Without -A only installed packages are considered.
+opkgcl.install("lib")
+opkgcl.install("tool")
+if not opkgcl.is_installed("app"):
+	opk.fail("Package 'app' not installed as a dependency of 'tool'.")
+
+check_dependents("whatdepends lib", ["app"])
+check_dependents("whatdependsrec lib", ["app", "tool"])
+check_dependents("whatrecommends app", [])
+check_providers("whatprovides libfoo", ["lib"])
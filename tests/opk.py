@@ -26,7 +26,7 @@ class Opk:
 			control["Version"] = "1.0"
 		self.control = control
 
-	def write(self, tar_not_ar=False, data_files=None):
+	def write(self, tar_not_ar=False, data_files=None, control_files=None):
 		filename = "{Package}_{Version}_{Architecture}.opk"\
 						.format(**self.control)
 		if os.path.exists(filename):
@@ -46,8 +46,18 @@ class Opk:
 			f.write("{}: {}\n".format(k, self.control[k]))
 		f.close()
 
+		# Maintainer scripts and the like, as a map of name to contents.
+		if control_files:
+			for name in control_files.keys():
+				with open(name, "w") as f:
+					f.write(control_files[name])
+				os.chmod(name, 0o755)
+
 		tar = tarfile.open("control.tar.gz", "w|gz")
 		tar.add("control")
+		if control_files:
+			for name in control_files.keys():
+				tar.add(name)
 		tar.close()
 
 		tar = tarfile.open("data.tar.gz", "w:gz")
@@ -71,6 +81,9 @@ class Opk:
 		os.unlink("control")
 		os.unlink("control.tar.gz")
 		os.unlink("data.tar.gz")
+		if control_files:
+			for name in control_files.keys():
+				os.unlink(name)
 
 import hashlib
 def md5sum_file(fname):